@@ -0,0 +1,90 @@
+/* Counts every heap allocation of the program for the profiler by
+ * replacing the global operator new and delete. Replacing them affects
+ * everything linked into a program, so this is not part of BallsCore:
+ * link it into a program to see allocations in its profiles, without it
+ * Profiler::GetAllocationCount stays zero. */
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "Profiler.h"
+
+// Visual Studio 2012 has no noexcept yet.
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define noexcept throw()
+#endif
+
+// Bumped by every allocation through operator new, wherever it comes from.
+static std::atomic<unsigned long long> allocationCount(0);
+
+// Hands the counter to the profiler before main runs.
+struct AllocationHook
+{
+  AllocationHook()
+  {
+    Profiler::SetAllocationCounter(&allocationCount);
+  }
+};
+
+static AllocationHook allocationHook;
+
+void *operator new(size_t size)
+{
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+  void *memory = malloc(size > 0 ? size : 1);
+  if(memory == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  return malloc(size > 0 ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+  return operator new(size, tag);
+}
+
+void operator delete(void *memory) noexcept
+{
+  free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+  free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept
+{
+  free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept
+{
+  free(memory);
+}
+
+// Sized delete came with C++14, the size is not needed to free.
+#if defined(__cpp_sized_deallocation) || (defined(_MSC_VER) && _MSC_VER >= 1900)
+void operator delete(void *memory, size_t) noexcept
+{
+  free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+  free(memory);
+}
+#endif
@@ -0,0 +1,393 @@
+#include "BallStore.h"
+#include <algorithm>
+#include "Snapshot.h"
+
+// Index stored for slots that no longer refer to a ball.
+const unsigned int InvalidIndex = ~0u;
+
+/* Forces are written field by field, so their padding never ends up in a
+ * snapshot and equal worlds give equal bytes. */
+const size_t ForceSnapshotSize = sizeof(Vector2D) + 2 * sizeof(float) + 1;
+
+static void WriteForces(SnapshotWriter &writer, const std::vector<Force> &forces)
+{
+  writer.Write(static_cast<unsigned int>(forces.size()));
+  for(const Force &force : forces)
+  {
+    writer.Write(force.Direction);
+    writer.Write(force.Magnitude);
+    writer.Write(force.TimeLeft);
+    writer.Write(force.Permanent);
+  }
+}
+
+// Reads what WriteForces wrote, failing unless there are exactly count forces.
+static bool ReadForces(SnapshotReader &reader, std::vector<Force> &forces, size_t count)
+{
+  unsigned int stored = 0;
+  if(!reader.Read(stored) || stored != count || count > reader.GetRemaining() / ForceSnapshotSize)
+  {
+    return false;
+  }
+
+  forces.resize(count, Force(Vector2D(0, 0), 0, 0));
+  for(Force &force : forces)
+  {
+    reader.Read(force.Direction);
+    reader.Read(force.Magnitude);
+    reader.Read(force.TimeLeft);
+    reader.Read(force.Permanent);
+  }
+  return reader.IsValid();
+}
+
+BallStore::BallStore()
+{
+  awakeCount = 0;
+}
+
+BallStore::~BallStore()
+{
+
+}
+
+BallHandle BallStore::Add(double mass, double radius, const Vector2D &position)
+{
+  unsigned int index = Count();
+  Resize(index + 1);
+
+  Position[index] = position;
+  Velocity[index] = Vector2D(0, 0);
+  Acceleration[index] = Vector2D(0, 0);
+  ForceAccumulator[index] = Vector2D(0, 0);
+  Mass[index] = mass;
+  InverseMass[index] = 1.0 / mass;
+  Radius[index] = radius;
+  AngularVelocity[index] = 0;
+  AngularAcceleration[index] = 0;
+  Orientation[index] = 0;
+  PreviousPosition[index] = position;
+  PreviousOrientation[index] = 0;
+  SleepTime[index] = 0;
+  Island[index] = 0;
+  ForceCount[index] = 0;
+
+  // Reuse a free slot if there is one, so the slot table stays small.
+  unsigned int slot;
+  if(freeSlots.empty())
+  {
+    slot = static_cast<unsigned int>(slotIndex.size());
+    slotIndex.push_back(index);
+    slotGeneration.push_back(0);
+  }
+  else
+  {
+    slot = freeSlots.back();
+    freeSlots.pop_back();
+    slotIndex[slot] = index;
+  }
+
+  indexSlot[index] = slot;
+
+  // New balls are awake, so move it in front of the sleeping ones.
+  if(index != awakeCount)
+  {
+    Swap(index, awakeCount);
+  }
+  awakeCount++;
+
+  BallHandle handle;
+  handle.Slot = slot;
+  handle.Generation = slotGeneration[slot];
+  return handle;
+}
+
+void BallStore::Remove(BallHandle handle)
+{
+  if(!IsValid(handle))
+  {
+    return;
+  }
+
+  unsigned int index = slotIndex[handle.Slot];
+  unsigned int last = Count() - 1;
+
+  // An awake ball is replaced by the last awake ball, which in turn is
+  // replaced by the last ball, so both parts stay packed.
+  if(index < awakeCount)
+  {
+    unsigned int lastAwake = awakeCount - 1;
+    if(index != lastAwake)
+    {
+      Move(lastAwake, index);
+    }
+
+    index = lastAwake;
+    awakeCount--;
+  }
+
+  // Keep the arrays packed by moving the last ball into the hole.
+  if(index != last)
+  {
+    Move(last, index);
+  }
+
+  Resize(last);
+
+  // Bump the generation so that old handles to this slot go stale.
+  slotIndex[handle.Slot] = InvalidIndex;
+  slotGeneration[handle.Slot]++;
+  freeSlots.push_back(handle.Slot);
+}
+
+void BallStore::Clear()
+{
+  for(unsigned int slot = 0; slot < slotIndex.size(); ++slot)
+  {
+    if(slotIndex[slot] != InvalidIndex)
+    {
+      slotIndex[slot] = InvalidIndex;
+      slotGeneration[slot]++;
+      freeSlots.push_back(slot);
+    }
+  }
+
+  Resize(0);
+  awakeCount = 0;
+}
+
+void BallStore::Save(SnapshotWriter &writer) const
+{
+  writer.Write(Count());
+  writer.Write(awakeCount);
+  writer.Write(static_cast<unsigned int>(slotIndex.size()));
+  writer.Write(static_cast<unsigned int>(freeSlots.size()));
+
+  writer.WriteArray(Position);
+  writer.WriteArray(Velocity);
+  writer.WriteArray(Acceleration);
+  writer.WriteArray(ForceAccumulator);
+  writer.WriteArray(Mass);
+  writer.WriteArray(InverseMass);
+  writer.WriteArray(Radius);
+  writer.WriteArray(AngularVelocity);
+  writer.WriteArray(AngularAcceleration);
+  writer.WriteArray(Orientation);
+  writer.WriteArray(PreviousPosition);
+  writer.WriteArray(PreviousOrientation);
+  writer.WriteArray(SleepTime);
+  writer.WriteArray(Island);
+  WriteForces(writer, Forces);
+  writer.WriteArray(ForceCount);
+
+  writer.WriteArray(slotIndex);
+  writer.WriteArray(slotGeneration);
+  writer.WriteArray(indexSlot);
+  writer.WriteArray(freeSlots);
+}
+
+bool BallStore::Load(SnapshotReader &reader)
+{
+  unsigned int count = 0, awake = 0, slots = 0, unused = 0;
+  reader.Read(count);
+  reader.Read(awake);
+  reader.Read(slots);
+  reader.Read(unused);
+
+  // Every array is read with the size it has to have, so nothing below
+  // can point outside of them once this passes.
+  bool ok = reader.IsValid() && awake <= count && count <= slots && unused <= slots &&
+    reader.ReadArray(Position, count) &&
+    reader.ReadArray(Velocity, count) &&
+    reader.ReadArray(Acceleration, count) &&
+    reader.ReadArray(ForceAccumulator, count) &&
+    reader.ReadArray(Mass, count) &&
+    reader.ReadArray(InverseMass, count) &&
+    reader.ReadArray(Radius, count) &&
+    reader.ReadArray(AngularVelocity, count) &&
+    reader.ReadArray(AngularAcceleration, count) &&
+    reader.ReadArray(Orientation, count) &&
+    reader.ReadArray(PreviousPosition, count) &&
+    reader.ReadArray(PreviousOrientation, count) &&
+    reader.ReadArray(SleepTime, count) &&
+    reader.ReadArray(Island, count) &&
+    ReadForces(reader, Forces, static_cast<size_t>(count) * MaxForcesPerBall) &&
+    reader.ReadArray(ForceCount, count) &&
+    reader.ReadArray(slotIndex, slots) &&
+    reader.ReadArray(slotGeneration, slots) &&
+    reader.ReadArray(indexSlot, count) &&
+    reader.ReadArray(freeSlots, unused);
+
+  for(unsigned int i = 0; ok && i < count; ++i)
+  {
+    ok = indexSlot[i] < slots && slotIndex[indexSlot[i]] == i &&
+      ForceCount[i] <= MaxForcesPerBall;
+  }
+
+  /* Every slot either holds a ball that points back to it or is free,
+   * and listed as free exactly once. Add would otherwise hand out a slot
+   * that is still in use. */
+  ok = ok && count + unused == slots;
+  std::vector<unsigned char> listed(ok ? slots : 0, 0);
+  for(unsigned int i = 0; ok && i < unused; ++i)
+  {
+    unsigned int slot = freeSlots[i];
+    ok = slot < slots && slotIndex[slot] == InvalidIndex && !listed[slot];
+    if(ok)
+    {
+      listed[slot] = 1;
+    }
+  }
+
+  for(unsigned int slot = 0; ok && slot < slots; ++slot)
+  {
+    ok = listed[slot] || (slotIndex[slot] < count && indexSlot[slotIndex[slot]] == slot);
+  }
+
+  if(!ok)
+  {
+    slotIndex.clear();
+    slotGeneration.clear();
+    freeSlots.clear();
+    Resize(0);
+    awakeCount = 0;
+    return false;
+  }
+
+  awakeCount = awake;
+  return true;
+}
+
+void BallStore::Exchange(BallStore &other)
+{
+  Position.swap(other.Position);
+  Velocity.swap(other.Velocity);
+  Acceleration.swap(other.Acceleration);
+  Mass.swap(other.Mass);
+  InverseMass.swap(other.InverseMass);
+  Radius.swap(other.Radius);
+  AngularVelocity.swap(other.AngularVelocity);
+  AngularAcceleration.swap(other.AngularAcceleration);
+  Orientation.swap(other.Orientation);
+  PreviousPosition.swap(other.PreviousPosition);
+  PreviousOrientation.swap(other.PreviousOrientation);
+  SleepTime.swap(other.SleepTime);
+  Island.swap(other.Island);
+  ForceAccumulator.swap(other.ForceAccumulator);
+  Forces.swap(other.Forces);
+  ForceCount.swap(other.ForceCount);
+
+  slotIndex.swap(other.slotIndex);
+  slotGeneration.swap(other.slotGeneration);
+  indexSlot.swap(other.indexSlot);
+  freeSlots.swap(other.freeSlots);
+  std::swap(awakeCount, other.awakeCount);
+}
+
+unsigned int BallStore::Wake(unsigned int index)
+{
+  if(index < awakeCount)
+  {
+    return index;
+  }
+
+  Swap(index, awakeCount);
+  SleepTime[awakeCount] = 0;
+  return awakeCount++;
+}
+
+unsigned int BallStore::Sleep(unsigned int index)
+{
+  if(index >= awakeCount)
+  {
+    return index;
+  }
+
+  awakeCount--;
+  Swap(index, awakeCount);
+
+  Velocity[awakeCount] = Vector2D(0, 0);
+  Acceleration[awakeCount] = Vector2D(0, 0);
+  AngularVelocity[awakeCount] = 0;
+  AngularAcceleration[awakeCount] = 0;
+  PreviousPosition[awakeCount] = Position[awakeCount];
+  PreviousOrientation[awakeCount] = Orientation[awakeCount];
+  return awakeCount;
+}
+
+void BallStore::Move(unsigned int from, unsigned int to)
+{
+  Position[to] = Position[from];
+  Velocity[to] = Velocity[from];
+  Acceleration[to] = Acceleration[from];
+  ForceAccumulator[to] = ForceAccumulator[from];
+  Mass[to] = Mass[from];
+  InverseMass[to] = InverseMass[from];
+  Radius[to] = Radius[from];
+  AngularVelocity[to] = AngularVelocity[from];
+  AngularAcceleration[to] = AngularAcceleration[from];
+  Orientation[to] = Orientation[from];
+  PreviousPosition[to] = PreviousPosition[from];
+  PreviousOrientation[to] = PreviousOrientation[from];
+  SleepTime[to] = SleepTime[from];
+  Island[to] = Island[from];
+  ForceCount[to] = ForceCount[from];
+  for(unsigned int f = 0; f < ForceCount[from]; ++f)
+  {
+    Forces[to * MaxForcesPerBall + f] = Forces[from * MaxForcesPerBall + f];
+  }
+
+  indexSlot[to] = indexSlot[from];
+  slotIndex[indexSlot[to]] = to;
+}
+
+void BallStore::Swap(unsigned int a, unsigned int b)
+{
+  if(a == b)
+  {
+    return;
+  }
+
+  std::swap(Position[a], Position[b]);
+  std::swap(Velocity[a], Velocity[b]);
+  std::swap(Acceleration[a], Acceleration[b]);
+  std::swap(ForceAccumulator[a], ForceAccumulator[b]);
+  std::swap(Mass[a], Mass[b]);
+  std::swap(InverseMass[a], InverseMass[b]);
+  std::swap(Radius[a], Radius[b]);
+  std::swap(AngularVelocity[a], AngularVelocity[b]);
+  std::swap(AngularAcceleration[a], AngularAcceleration[b]);
+  std::swap(Orientation[a], Orientation[b]);
+  std::swap(PreviousPosition[a], PreviousPosition[b]);
+  std::swap(PreviousOrientation[a], PreviousOrientation[b]);
+  std::swap(SleepTime[a], SleepTime[b]);
+  std::swap(Island[a], Island[b]);
+  std::swap(ForceCount[a], ForceCount[b]);
+  std::swap_ranges(Forces.begin() + a * MaxForcesPerBall,
+    Forces.begin() + (a + 1) * MaxForcesPerBall, Forces.begin() + b * MaxForcesPerBall);
+
+  std::swap(indexSlot[a], indexSlot[b]);
+  slotIndex[indexSlot[a]] = a;
+  slotIndex[indexSlot[b]] = b;
+}
+
+void BallStore::Resize(unsigned int count)
+{
+  Position.resize(count);
+  Velocity.resize(count);
+  Acceleration.resize(count);
+  ForceAccumulator.resize(count);
+  Mass.resize(count);
+  InverseMass.resize(count);
+  Radius.resize(count);
+  AngularVelocity.resize(count);
+  AngularAcceleration.resize(count);
+  Orientation.resize(count);
+  PreviousPosition.resize(count);
+  PreviousOrientation.resize(count);
+  SleepTime.resize(count);
+  Island.resize(count);
+  Forces.resize(count * MaxForcesPerBall, Force(Vector2D(0, 0), 0, 0));
+  ForceCount.resize(count);
+  indexSlot.resize(count);
+}
@@ -0,0 +1,207 @@
+#ifndef BALLSTORE_H
+#define BALLSTORE_H
+
+#include <vector>
+#include "Vector2D.h"
+#include "Force.h"
+
+class SnapshotWriter;
+class SnapshotReader;
+
+// Most timed forces that can act on a single ball at once.
+const unsigned int MaxForcesPerBall = 4;
+
+/* Handle used to refer to a single ball in a BallStore.
+ * Unlike an index into the arrays it stays valid while other balls are
+ * added and removed, and it is detected as stale once its ball is gone. */
+struct BallHandle
+{
+  unsigned int Slot;
+  unsigned int Generation;
+};
+
+/* Container holding all balls as a structure of arrays.
+ * Every ball lives at the same index in each of the arrays below and the
+ * arrays are always tightly packed, so the physics can run straight over
+ * them without chasing pointers. Removing a ball moves the last ball
+ * into its place; use a BallHandle to keep track of a particular ball.
+ *
+ * Balls that are awake come first, [0, AwakeCount()), followed by the
+ * sleeping ones. Waking a ball or putting it to sleep swaps it across
+ * that border, so the physics only has to run over the awake part. */
+class BallStore
+{
+public:
+  // Constructor
+  BallStore();
+
+  // Destructor
+  ~BallStore();
+
+  // Adds a ball at rest and returns its handle.
+  BallHandle Add(double mass, double radius, const Vector2D &position);
+
+  // Removes a ball. Does nothing if the handle is stale.
+  void Remove(BallHandle handle);
+
+  // Removes all balls, invalidating every handle.
+  void Clear();
+
+  // Returns the number of balls.
+  unsigned int Count() const;
+
+  // Returns the number of awake balls, they are the first ones.
+  unsigned int AwakeCount() const;
+  bool IsAwake(unsigned int index) const;
+
+  /* Wakes a sleeping ball or puts an awake ball to sleep, moving it to
+   * the other side of the border. Both return the new index of the ball.
+   * A ball going to sleep is stopped and its previous state is set to
+   * its current one. */
+  unsigned int Wake(unsigned int index);
+  unsigned int Sleep(unsigned int index);
+
+  // Returns true if the handle still refers to a ball.
+  bool IsValid(BallHandle handle) const;
+
+  /* Returns the current index of a ball in the arrays.
+   * The index is only stable until the next call to Remove, Wake or Sleep. */
+  unsigned int IndexOf(BallHandle handle) const;
+
+  // Returns the handle of the ball at an index.
+  BallHandle HandleOf(unsigned int index) const;
+
+  /* Adds a force to a ball. Returns false and drops the force if the ball
+   * already has MaxForcesPerBall forces acting on it. */
+  bool AddForce(unsigned int index, const Force &force);
+
+  // Removes one of the forces of a ball, the last one takes its place.
+  void RemoveForce(unsigned int index, unsigned int force);
+
+  void ApplyImpulse(unsigned int index, const Vector2D &impulse);
+  void ApplyAngularImpulse(unsigned int index, double impulse);
+
+  /* Writes every ball together with the handle table, or replaces the
+   * contents of the store with what was written. Handles taken out before
+   * a snapshot was saved are valid again after it is loaded. Load returns
+   * false and leaves the store empty if the data does not fit. */
+  void Save(SnapshotWriter &writer) const;
+  bool Load(SnapshotReader &reader);
+
+  // Swaps every ball and handle with another store, without copying.
+  void Exchange(BallStore &other);
+
+  // ---- Per ball state, indexed by ball ---- //
+  std::vector<Vector2D> Position;
+  std::vector<Vector2D> Velocity;
+  std::vector<Vector2D> Acceleration;
+  std::vector<double> Mass;
+  std::vector<double> InverseMass;
+  std::vector<double> Radius;
+  std::vector<double> AngularVelocity;
+  std::vector<double> AngularAcceleration;
+  std::vector<double> Orientation;
+
+  // State at the end of the previous full step, used to interpolate
+  // between steps when drawing.
+  std::vector<Vector2D> PreviousPosition;
+  std::vector<double> PreviousOrientation;
+
+  // How long an awake ball has been slow enough to fall asleep, in seconds.
+  std::vector<double> SleepTime;
+
+  // The island a sleeping ball fell asleep with, islands wake up together.
+  std::vector<unsigned int> Island;
+
+  // All forces acting on a ball over an update will be accumulated here.
+  std::vector<Vector2D> ForceAccumulator;
+
+  /* Timed forces acting on each ball, only touched by UpdateForces.
+   * Every ball has room for MaxForcesPerBall forces starting at
+   * Forces[index * MaxForcesPerBall], of which ForceCount are in use.
+   * Nothing is allocated when forces come and go. */
+  std::vector<Force> Forces;
+  std::vector<unsigned int> ForceCount;
+
+private:
+  // Moves the ball at index from into index to, overwriting it.
+  void Move(unsigned int from, unsigned int to);
+
+  // Swaps two balls.
+  void Swap(unsigned int a, unsigned int b);
+
+  // Resizes every per ball array.
+  void Resize(unsigned int count);
+
+  // Maps between handle slots and indices into the arrays.
+  std::vector<unsigned int> slotIndex;
+  std::vector<unsigned int> slotGeneration;
+  std::vector<unsigned int> indexSlot;
+  std::vector<unsigned int> freeSlots;
+
+  unsigned int awakeCount;
+};
+
+inline unsigned int BallStore::Count() const
+{
+  return static_cast<unsigned int>(indexSlot.size());
+}
+
+inline unsigned int BallStore::AwakeCount() const
+{
+  return awakeCount;
+}
+
+inline bool BallStore::IsAwake(unsigned int index) const
+{
+  return index < awakeCount;
+}
+
+inline bool BallStore::IsValid(BallHandle handle) const
+{
+  return handle.Slot < slotGeneration.size() &&
+    slotGeneration[handle.Slot] == handle.Generation &&
+    slotIndex[handle.Slot] < Count();
+}
+
+inline unsigned int BallStore::IndexOf(BallHandle handle) const
+{
+  return slotIndex[handle.Slot];
+}
+
+inline BallHandle BallStore::HandleOf(unsigned int index) const
+{
+  BallHandle handle;
+  handle.Slot = indexSlot[index];
+  handle.Generation = slotGeneration[handle.Slot];
+  return handle;
+}
+
+inline bool BallStore::AddForce(unsigned int index, const Force &force)
+{
+  if(ForceCount[index] >= MaxForcesPerBall)
+  {
+    return false;
+  }
+
+  Forces[index * MaxForcesPerBall + ForceCount[index]++] = force;
+  return true;
+}
+
+inline void BallStore::RemoveForce(unsigned int index, unsigned int force)
+{
+  unsigned int first = index * MaxForcesPerBall;
+  Forces[first + force] = Forces[first + --ForceCount[index]];
+}
+
+inline void BallStore::ApplyImpulse(unsigned int index, const Vector2D &impulse)
+{
+  Velocity[index] += impulse * InverseMass[index];
+}
+
+inline void BallStore::ApplyAngularImpulse(unsigned int index, double impulse)
+{
+  AngularVelocity[index] += impulse;
+}
+
+#endif
@@ -0,0 +1,615 @@
+/* Benchmarks the physics step on a set of reproducible scenes.
+ * Every scene is built from a seed, so two runs with the same options
+ * simulate exactly the same thing. For each scene the time spent in every
+ * phase of the step is reported, optionally as JSON so results can be
+ * compared between builds. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "World.h"
+#include "Line.h"
+#include "Integrator.h"
+#include "ThreadPool.h"
+#include "Random.h"
+#include "GameTimer.h"
+
+struct BenchOptions
+{
+  unsigned int Balls;
+  unsigned int Lines;
+  unsigned int Steps;
+  unsigned int Warmup;
+  double Dt;
+  unsigned int Seed;
+  unsigned int Threads;
+  bool Scaling;
+  bool Integrator;
+  bool Sleeping;
+
+  // Fails the run if a scene takes longer per step, 0 for no limit.
+  double MaxMs;
+  std::string Scene;
+  std::string JsonPath;
+};
+
+// A scene is built once and may add balls while it runs.
+struct BenchScene
+{
+  const char *Name;
+  const char *Description;
+  void (*Build)(World &world, const BenchOptions &options);
+  void (*Update)(World &world, const BenchOptions &options, unsigned int step);
+};
+
+// Results of running one scene with one thread count.
+struct BenchResult
+{
+  const char *Scene;
+  unsigned int Threads;
+  unsigned int Balls;
+  unsigned int Awake;
+  unsigned int Lines;
+  double Seconds;
+  double BallSteps;
+  StepTimings Phases;
+
+  // Slowest step but one in a hundred, in seconds.
+  double P99;
+  unsigned long long Checksum;
+};
+
+// Results of the integrator on its own with one instruction set.
+struct IntegratorResult
+{
+  IntegratorIsa Isa;
+  double BallsPerSecond;
+};
+
+// Scenes are built from this, seeded with --seed before every build so
+// that a seed gives the same scene on every platform.
+static Random sceneRandom;
+
+static double RandomRange(double min, double max)
+{
+  return sceneRandom.NextDouble(min, max);
+}
+
+// Ball sizes follow the window's AddBall.
+static void AddWindowBall(World &world, const Vector2D &position)
+{
+  float sz = sceneRandom.NextInt(18) + 19;
+  world.AddBall(sz / 13.0f, sz / 100.0f, position);
+}
+
+// ---- Ball rain ---- //
+
+// Scale of the window's box that leaves room for all the balls.
+static double RainScale(const BenchOptions &options)
+{
+  double scale = std::sqrt(options.Balls / 100.0);
+  return scale < 1.0 ? 1.0 : scale;
+}
+
+// The box and ramps built by Window::Initialize, scaled up.
+static void BuildRain(World &world, const BenchOptions &options)
+{
+  double s = RainScale(options);
+
+  world.AddLine(Line(Vector2D(0.5 * s, 5.0 * s), Vector2D(7.5 * s, 5.0 * s)));
+  world.AddLine(Line(Vector2D(7.5 * s, 5.0 * s), Vector2D(7.5 * s, 0.2 * s)));
+  world.AddLine(Line(Vector2D(0.5 * s, 0.2 * s), Vector2D(7.5 * s, 0.2 * s)));
+  world.AddLine(Line(Vector2D(0.5 * s, 5.0 * s), Vector2D(0.5 * s, 0.2 * s)));
+
+  world.AddLine(Line(Vector2D(2.7 * s, 2.3 * s), Vector2D(5.2 * s, 3.8 * s)));
+  world.AddLine(Line(Vector2D(3.2 * s, 0.2 * s), Vector2D(5.1 * s, 0.9 * s)));
+  world.AddLine(Line(Vector2D(5.1 * s, 0.9 * s), Vector2D(5.5 * s, 0.2 * s)));
+}
+
+// Drops a row of balls in under the lid every few steps until all are in.
+static void UpdateRain(World &world, const BenchOptions &options, unsigned int step)
+{
+  const unsigned int interval = 10;
+  if(step % interval != 0 || world.GetBalls().Count() >= options.Balls)
+  {
+    return;
+  }
+
+  double s = RainScale(options);
+  unsigned int perRow = static_cast<unsigned int>(7.0 * s / 0.8);
+
+  for(unsigned int i = 0; i < perRow && world.GetBalls().Count() < options.Balls; ++i)
+  {
+    double x = 0.5 * s + 0.4 + i * 0.8 + RandomRange(-0.05, 0.05);
+    AddWindowBall(world, Vector2D(x, 5.0 * s - 0.4));
+  }
+}
+
+// ---- Dense pile ---- //
+
+// Equal balls stacked in touching rows at the bottom of a narrow box.
+static void BuildPile(World &world, const BenchOptions &options)
+{
+  const double radius = 0.1;
+  unsigned int perRow = static_cast<unsigned int>(std::sqrt((double)options.Balls) / 2.0) + 1;
+  unsigned int numRows = (options.Balls + perRow - 1) / perRow;
+
+  double width = perRow * radius * 2.0;
+  double height = numRows * radius * 2.0 * 1.5 + 1.0;
+
+  world.AddLine(Line(Vector2D(0, height), Vector2D(width, height)));
+  world.AddLine(Line(Vector2D(width, height), Vector2D(width, 0)));
+  world.AddLine(Line(Vector2D(0, 0), Vector2D(width, 0)));
+  world.AddLine(Line(Vector2D(0, height), Vector2D(0, 0)));
+
+  for(unsigned int i = 0; i < options.Balls; ++i)
+  {
+    double x = radius + (i % perRow) * radius * 2.0 + RandomRange(-0.001, 0.001);
+    double y = radius + (i / perRow) * radius * 2.0;
+    world.AddBall(1.0, radius, Vector2D(x, y));
+  }
+}
+
+// ---- Line mesh ---- //
+
+/* A box whose floor is a long jagged terrain and whose inside is filled
+ * with small pegs, together making up options.Lines segments. */
+static void BuildMesh(World &world, const BenchOptions &options)
+{
+  unsigned int perRow = static_cast<unsigned int>(std::ceil(std::sqrt((double)options.Balls)));
+  if(perRow == 0) perRow = 1;
+
+  double width = perRow * 0.8 + 1.0;
+  double height = width;
+
+  world.AddLine(Line(Vector2D(0, height), Vector2D(width, height)));
+  world.AddLine(Line(Vector2D(width, height), Vector2D(width, 0)));
+  world.AddLine(Line(Vector2D(0, 0), Vector2D(width, 0)));
+  world.AddLine(Line(Vector2D(0, height), Vector2D(0, 0)));
+
+  unsigned int remaining = options.Lines > 4 ? options.Lines - 4 : 0;
+
+  // Half of the segments make up the terrain.
+  unsigned int terrain = remaining / 2;
+  Vector2D previous(0, 0.5);
+  for(unsigned int i = 1; i <= terrain; ++i)
+  {
+    Vector2D next(width * i / terrain, RandomRange(0.2, 0.8));
+    world.AddLine(Line(previous, next));
+    previous = next;
+  }
+
+  // The rest are short pegs spread over the lower half of the box.
+  for(unsigned int i = terrain; i < remaining; ++i)
+  {
+    Vector2D center(RandomRange(0.5, width - 0.5), RandomRange(1.0, height * 0.5));
+    Vector2D half(RandomRange(-0.15, 0.15), RandomRange(-0.05, 0.05));
+    world.AddLine(Line(center - half, center + half));
+  }
+
+  for(unsigned int i = 0; i < options.Balls; ++i)
+  {
+    double x = 0.5 + (i % perRow + 0.5) * 0.8;
+    double y = height - 0.5 - (i / perRow) * 0.4;
+    AddWindowBall(world, Vector2D(x, y));
+  }
+}
+
+// ---- Mixed sizes ---- //
+
+// Mostly window sized balls with a few tiny and a few huge ones mixed in.
+static void BuildMixed(World &world, const BenchOptions &options)
+{
+  const double spacing = 1.0;
+  unsigned int perRow = static_cast<unsigned int>(std::ceil(std::sqrt((double)options.Balls)));
+  if(perRow == 0) perRow = 1;
+  unsigned int numRows = (options.Balls + perRow - 1) / perRow;
+
+  double width = perRow * spacing + 1.0;
+  double height = numRows * spacing * 2.0 + 1.0;
+
+  world.AddLine(Line(Vector2D(0, height), Vector2D(width, height)));
+  world.AddLine(Line(Vector2D(width, height), Vector2D(width, 0)));
+  world.AddLine(Line(Vector2D(0, 0), Vector2D(width, 0)));
+  world.AddLine(Line(Vector2D(0, height), Vector2D(0, 0)));
+
+  for(unsigned int i = 0; i < options.Balls; ++i)
+  {
+    Vector2D position(0.5 + (i % perRow + 0.5) * spacing,
+      height - 0.5 - (i / perRow + 0.5) * spacing);
+
+    int kind = sceneRandom.NextInt(10);
+    if(kind == 0)
+    {
+      world.AddBall(0.1, 0.05, position);
+    }
+    else if(kind == 1)
+    {
+      world.AddBall(20.0, 0.45, position);
+    }
+    else
+    {
+      AddWindowBall(world, position);
+    }
+  }
+}
+
+static const BenchScene Scenes[] =
+{
+  { "rain", "balls dropped into the window's box", BuildRain, UpdateRain },
+  { "pile", "equal balls stacked at rest", BuildPile, nullptr },
+  { "mesh", "balls falling through many line segments", BuildMesh, nullptr },
+  { "mixed", "tiny, window sized and huge balls", BuildMixed, nullptr },
+};
+
+static const unsigned int NumScenes = sizeof(Scenes) / sizeof(Scenes[0]);
+
+// Hashes the bits of every ball position, equal runs give equal sums.
+static unsigned long long PositionChecksum(const BallStore &balls)
+{
+  unsigned long long sum = 1469598103934665603ULL;
+  for(unsigned int i = 0; i < balls.Count(); ++i)
+  {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&balls.Position[i]);
+    for(unsigned int b = 0; b < sizeof(Vector2D); ++b)
+    {
+      sum = (sum ^ bytes[b]) * 1099511628211ULL;
+    }
+  }
+  return sum;
+}
+
+static BenchResult RunScene(const BenchScene &scene, const BenchOptions &options,
+                            unsigned int threads)
+{
+  ThreadPool pool(threads);
+
+  sceneRandom.Seed(options.Seed);
+  World world;
+  world.SetThreadPool(&pool);
+  world.SetSleeping(options.Sleeping);
+  scene.Build(world, options);
+
+  BenchResult result;
+  result.Scene = scene.Name;
+  result.Threads = threads;
+  result.Seconds = 0.0;
+  result.BallSteps = 0.0;
+  result.Phases = StepTimings();
+  TimingStats stepTimes(options.Steps);
+
+  for(unsigned int step = 0; step < options.Warmup + options.Steps; ++step)
+  {
+    if(scene.Update)
+    {
+      scene.Update(world, options, step);
+    }
+
+    long long start = GameTimer::Now();
+    world.Step(options.Dt);
+    double seconds = GameTimer::TicksToSeconds(GameTimer::Now() - start);
+
+    if(step < options.Warmup)
+    {
+      continue;
+    }
+
+    stepTimes.Add(seconds);
+
+    const StepTimings &phases = world.GetStepTimings();
+    result.Phases.Forces += phases.Forces;
+    result.Phases.LineCollisions += phases.LineCollisions;
+    result.Phases.BallCollisions += phases.BallCollisions;
+    result.Phases.Integrate += phases.Integrate;
+    result.Phases.Solve += phases.Solve;
+    result.Phases.Sleeping += phases.Sleeping;
+    result.Seconds += seconds;
+    result.BallSteps += world.GetBalls().Count();
+  }
+
+  result.Balls = world.GetBalls().Count();
+  result.Awake = world.GetBalls().AwakeCount();
+  result.Lines = static_cast<unsigned int>(world.GetLines().size());
+  result.Checksum = PositionChecksum(world.GetBalls());
+  result.P99 = stepTimes.GetPercentile(99);
+  return result;
+}
+
+// Times IntegrateBalls alone on a large store with every supported ISA.
+static void RunIntegrator(const BenchOptions &options, std::vector<IntegratorResult> &results)
+{
+  const unsigned int count = 100000;
+  const unsigned int rounds = 200;
+
+  BallStore balls;
+  sceneRandom.Seed(options.Seed);
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    float sz = sceneRandom.NextInt(18) + 19;
+    balls.Add(sz / 13.0f, sz / 100.0f, Vector2D(RandomRange(0, 100), RandomRange(0, 100)));
+  }
+
+  Vector2D gravity(0, -9.82);
+
+  for(int isa = 0; isa < IsaCount; ++isa)
+  {
+    if(!IsIntegratorIsaSupported(static_cast<IntegratorIsa>(isa)))
+    {
+      continue;
+    }
+
+    long long start = GameTimer::Now();
+    for(unsigned int round = 0; round < rounds; ++round)
+    {
+      IntegrateBalls(static_cast<IntegratorIsa>(isa), balls, 0, count, gravity, options.Dt);
+    }
+    double seconds = GameTimer::TicksToSeconds(GameTimer::Now() - start);
+
+    IntegratorResult result;
+    result.Isa = static_cast<IntegratorIsa>(isa);
+    result.BallsPerSecond = seconds > 0.0 ? count * (double)rounds / seconds : 0.0;
+    results.push_back(result);
+  }
+}
+
+static double PerStepMs(double seconds, const BenchOptions &options)
+{
+  return options.Steps > 0 ? seconds * 1000.0 / options.Steps : 0.0;
+}
+
+static void PrintResults(const std::vector<BenchResult> &results,
+                         const std::vector<IntegratorResult> &integrator,
+                         const BenchOptions &options)
+{
+  printf("scene   threads  balls  awake  lines   ms/step   p99 ms   forces    lines    balls  integrate    solve  sleeping  balls/sec  checksum\n");
+
+  for(const BenchResult &result : results)
+  {
+    double ballsPerSecond = result.Seconds > 0.0 ? result.BallSteps / result.Seconds : 0.0;
+
+    printf("%-6s  %7u  %5u  %5u  %5u  %8.3f  %7.3f  %7.3f  %7.3f  %7.3f  %9.3f  %7.3f  %8.3f  %9.0f  %016llx\n",
+      result.Scene, result.Threads, result.Balls, result.Awake, result.Lines,
+      PerStepMs(result.Seconds, options),
+      result.P99 * 1000.0,
+      PerStepMs(result.Phases.Forces, options),
+      PerStepMs(result.Phases.LineCollisions, options),
+      PerStepMs(result.Phases.BallCollisions, options),
+      PerStepMs(result.Phases.Integrate, options),
+      PerStepMs(result.Phases.Solve, options),
+      PerStepMs(result.Phases.Sleeping, options),
+      ballsPerSecond, result.Checksum);
+  }
+
+  if(!integrator.empty())
+  {
+    printf("\nintegrator  balls/sec\n");
+    for(const IntegratorResult &result : integrator)
+    {
+      printf("%-10s  %9.0f\n", GetIntegratorIsaName(result.Isa), result.BallsPerSecond);
+    }
+  }
+}
+
+static bool WriteJson(const char *path, const std::vector<BenchResult> &results,
+                      const std::vector<IntegratorResult> &integrator,
+                      const BenchOptions &options)
+{
+  FILE *file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if(!file)
+  {
+    return false;
+  }
+
+  fprintf(file, "{\n");
+  fprintf(file, "  \"steps\": %u,\n", options.Steps);
+  fprintf(file, "  \"warmup\": %u,\n", options.Warmup);
+  fprintf(file, "  \"dt\": %g,\n", options.Dt);
+  fprintf(file, "  \"seed\": %u,\n", options.Seed);
+  fprintf(file, "  \"sleeping\": %s,\n", options.Sleeping ? "true" : "false");
+  fprintf(file, "  \"integrator_isa\": \"%s\",\n", GetIntegratorIsaName(GetIntegratorIsa()));
+  fprintf(file, "  \"scenes\": [\n");
+
+  for(size_t i = 0; i < results.size(); ++i)
+  {
+    const BenchResult &result = results[i];
+    double ballsPerSecond = result.Seconds > 0.0 ? result.BallSteps / result.Seconds : 0.0;
+
+    fprintf(file, "    {\n");
+    fprintf(file, "      \"name\": \"%s\",\n", result.Scene);
+    fprintf(file, "      \"threads\": %u,\n", result.Threads);
+    fprintf(file, "      \"balls\": %u,\n", result.Balls);
+    fprintf(file, "      \"awake\": %u,\n", result.Awake);
+    fprintf(file, "      \"lines\": %u,\n", result.Lines);
+    fprintf(file, "      \"seconds\": %.9f,\n", result.Seconds);
+    fprintf(file, "      \"ms_per_step\": %.6f,\n", PerStepMs(result.Seconds, options));
+    fprintf(file, "      \"p99_ms_per_step\": %.6f,\n", result.P99 * 1000.0);
+    fprintf(file, "      \"phases_ms_per_step\": {\n");
+    fprintf(file, "        \"forces\": %.6f,\n", PerStepMs(result.Phases.Forces, options));
+    fprintf(file, "        \"line_collisions\": %.6f,\n", PerStepMs(result.Phases.LineCollisions, options));
+    fprintf(file, "        \"ball_collisions\": %.6f,\n", PerStepMs(result.Phases.BallCollisions, options));
+    fprintf(file, "        \"integrate\": %.6f,\n", PerStepMs(result.Phases.Integrate, options));
+    fprintf(file, "        \"solve\": %.6f,\n", PerStepMs(result.Phases.Solve, options));
+    fprintf(file, "        \"sleeping\": %.6f\n", PerStepMs(result.Phases.Sleeping, options));
+    fprintf(file, "      },\n");
+    fprintf(file, "      \"balls_per_second\": %.1f,\n", ballsPerSecond);
+    fprintf(file, "      \"checksum\": \"%016llx\"\n", result.Checksum);
+    fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+  }
+
+  fprintf(file, "  ],\n");
+  fprintf(file, "  \"integrator\": [\n");
+
+  for(size_t i = 0; i < integrator.size(); ++i)
+  {
+    fprintf(file, "    { \"isa\": \"%s\", \"balls_per_second\": %.1f }%s\n",
+      GetIntegratorIsaName(integrator[i].Isa), integrator[i].BallsPerSecond,
+      i + 1 < integrator.size() ? "," : "");
+  }
+
+  fprintf(file, "  ]\n");
+  fprintf(file, "}\n");
+
+  if(file != stdout)
+  {
+    fclose(file);
+  }
+  return true;
+}
+
+static void PrintUsage()
+{
+  printf("Usage: BallsBenchmark [options]\n"
+         "  --scene NAME   scene to run, or all (default all)\n"
+         "  --balls N      number of balls (default 2000)\n"
+         "  --lines N      number of lines in the mesh scene (default 4000)\n"
+         "  --steps N      number of timed steps (default 500)\n"
+         "  --warmup N     steps run before timing starts (default 50)\n"
+         "  --dt SECONDS   length of each step (default 0.01)\n"
+         "  --seed N       seed for the scenes (default 1)\n"
+         "  --threads N    threads to step with, 0 for all cores (default 1)\n"
+         "  --scaling      run every scene for each thread count from 1 to --threads\n"
+         "  --integrator   also time the integrator alone with every ISA\n"
+         "  --no-sleeping  keep every ball awake\n"
+         "  --json FILE    write the results as JSON, - for stdout\n"
+         "  --max-ms MS    fail if a scene takes longer than MS per step on average\n"
+         "\nScenes:\n");
+
+  for(unsigned int i = 0; i < NumScenes; ++i)
+  {
+    printf("  %-6s %s\n", Scenes[i].Name, Scenes[i].Description);
+  }
+}
+
+static bool ParseOptions(int argc, char **argv, BenchOptions &options)
+{
+  for(int i = 1; i < argc; ++i)
+  {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if(strcmp(arg, "--scene") == 0 && hasValue)
+      options.Scene = argv[++i];
+    else if(strcmp(arg, "--balls") == 0 && hasValue)
+      options.Balls = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--lines") == 0 && hasValue)
+      options.Lines = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--steps") == 0 && hasValue)
+      options.Steps = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--warmup") == 0 && hasValue)
+      options.Warmup = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--dt") == 0 && hasValue)
+      options.Dt = atof(argv[++i]);
+    else if(strcmp(arg, "--seed") == 0 && hasValue)
+      options.Seed = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--threads") == 0 && hasValue)
+      options.Threads = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--scaling") == 0)
+      options.Scaling = true;
+    else if(strcmp(arg, "--integrator") == 0)
+      options.Integrator = true;
+    else if(strcmp(arg, "--no-sleeping") == 0)
+      options.Sleeping = false;
+    else if(strcmp(arg, "--json") == 0 && hasValue)
+      options.JsonPath = argv[++i];
+    else if(strcmp(arg, "--max-ms") == 0 && hasValue)
+      options.MaxMs = atof(argv[++i]);
+    else
+      return false;
+  }
+
+  if(options.Scene != "all")
+  {
+    bool found = false;
+    for(unsigned int i = 0; i < NumScenes; ++i)
+    {
+      found = found || options.Scene == Scenes[i].Name;
+    }
+
+    if(!found)
+    {
+      return false;
+    }
+  }
+
+  return options.Dt > 0.0;
+}
+
+int main(int argc, char **argv)
+{
+  BenchOptions options;
+  options.Balls = 2000;
+  options.Lines = 4000;
+  options.Steps = 500;
+  options.Warmup = 50;
+  options.Dt = 0.01;
+  options.Seed = 1;
+  options.Threads = 1;
+  options.Scaling = false;
+  options.Integrator = false;
+  options.Sleeping = true;
+  options.MaxMs = 0.0;
+  options.Scene = "all";
+
+  if(!ParseOptions(argc, argv, options))
+  {
+    PrintUsage();
+    return 1;
+  }
+
+  unsigned int threads = options.Threads;
+  if(threads == 0)
+  {
+    threads = ThreadPool().GetThreadCount();
+  }
+
+  std::vector<BenchResult> results;
+  for(unsigned int i = 0; i < NumScenes; ++i)
+  {
+    if(options.Scene != "all" && options.Scene != Scenes[i].Name)
+    {
+      continue;
+    }
+
+    for(unsigned int t = options.Scaling ? 1 : threads; t <= threads; ++t)
+    {
+      results.push_back(RunScene(Scenes[i], options, t));
+    }
+  }
+
+  std::vector<IntegratorResult> integrator;
+  if(options.Integrator)
+  {
+    RunIntegrator(options, integrator);
+  }
+
+  // With JSON going to stdout, leave the table out so the output parses.
+  if(options.JsonPath != "-")
+  {
+    PrintResults(results, integrator, options);
+  }
+
+  if(!options.JsonPath.empty() &&
+     !WriteJson(options.JsonPath.c_str(), results, integrator, options))
+  {
+    printf("Could not write %s\n", options.JsonPath.c_str());
+    return 1;
+  }
+
+  // Steps slower than this are too slow to watch the scene move.
+  bool fast = true;
+  for(const BenchResult &result : results)
+  {
+    double ms = PerStepMs(result.Seconds, options);
+    if(options.MaxMs > 0.0 && ms > options.MaxMs)
+    {
+      fprintf(stderr, "%s with %u threads took %.3f ms per step, more than %.3f\n",
+        result.Scene, result.Threads, ms, options.MaxMs);
+      fast = false;
+    }
+  }
+
+  return fast ? 0 : 1;
+}
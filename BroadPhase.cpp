@@ -0,0 +1,262 @@
+#include "BroadPhase.h"
+#include <cmath>
+
+// Upper limit on how many cells we allow per ball. Sparse scenes get
+// larger cells instead of a grid that is mostly empty.
+const double MaxCellsPerBall = 4.0;
+
+UniformGrid::UniformGrid()
+{
+  maxRadius = 0.0;
+  cellSize = 0.0;
+  columns = 0;
+  rows = 0;
+}
+
+UniformGrid::~UniformGrid()
+{
+
+}
+
+void UniformGrid::Clear()
+{
+  entries.clear();
+  maxRadius = 0.0;
+}
+
+void UniformGrid::Insert(unsigned int index, const Vector2D &position, double radius)
+{
+  if(entries.empty())
+  {
+    boundsMin = position;
+    boundsMax = position;
+  }
+  else
+  {
+    if(position.X < boundsMin.X) boundsMin.X = position.X;
+    if(position.Y < boundsMin.Y) boundsMin.Y = position.Y;
+    if(position.X > boundsMax.X) boundsMax.X = position.X;
+    if(position.Y > boundsMax.Y) boundsMax.Y = position.Y;
+  }
+
+  if(radius > maxRadius)
+  {
+    maxRadius = radius;
+  }
+
+  Entry entry;
+  entry.Position = position;
+  entry.Radius = radius;
+  entry.Index = index;
+  entry.Cell = 0;
+  entries.push_back(entry);
+}
+
+// Sorts the entries into cells with a counting sort.
+void UniformGrid::Build()
+{
+  if(entries.empty())
+  {
+    columns = 0;
+    rows = 0;
+    cellStart.assign(1, 0);
+    sorted.clear();
+    return;
+  }
+
+  double width = boundsMax.X - boundsMin.X;
+  double height = boundsMax.Y - boundsMin.Y;
+
+  // Any two touching balls are at most two of the largest radii apart,
+  // so with cells this wide they always share or neighbour a cell.
+  cellSize = maxRadius * 2.0;
+
+  if(cellSize <= 0.0 || !std::isfinite(width) || !std::isfinite(height))
+  {
+    // Degenerate scene, everything goes into a single cell.
+    cellSize = 0.0;
+    columns = 1;
+    rows = 1;
+  }
+  else
+  {
+    double maxCells = MaxCellsPerBall * entries.size() + 1.0;
+    double cols = std::floor(width / cellSize) + 1.0;
+    double rws = std::floor(height / cellSize) + 1.0;
+
+    if(cols * rws > maxCells)
+    {
+      cellSize *= std::sqrt(cols * rws / maxCells);
+      cols = std::floor(width / cellSize) + 1.0;
+      rws = std::floor(height / cellSize) + 1.0;
+    }
+
+    columns = static_cast<unsigned int>(cols);
+    rows = static_cast<unsigned int>(rws);
+  }
+
+  unsigned int numCells = columns * rows;
+  cellStart.assign(numCells + 1, 0);
+
+  // Count the number of balls in each cell.
+  for(Entry &entry : entries)
+  {
+    unsigned int x = 0, y = 0;
+    if(cellSize > 0.0)
+    {
+      x = static_cast<unsigned int>((entry.Position.X - boundsMin.X) / cellSize);
+      y = static_cast<unsigned int>((entry.Position.Y - boundsMin.Y) / cellSize);
+      if(x >= columns) x = columns - 1;
+      if(y >= rows) y = rows - 1;
+    }
+
+    entry.Cell = y * columns + x;
+    cellStart[entry.Cell + 1]++;
+  }
+
+  // Turn the counts into offsets.
+  for(unsigned int c = 0; c < numCells; ++c)
+  {
+    cellStart[c + 1] += cellStart[c];
+  }
+
+  // Scatter the balls into their cells, keeping the insertion order
+  // within each cell.
+  sorted.resize(entries.size());
+  for(const Entry &entry : entries)
+  {
+    sorted[cellStart[entry.Cell]++] = entry;
+  }
+
+  // The scatter advanced every offset to the start of the next cell.
+  for(unsigned int c = numCells; c > 0; --c)
+  {
+    cellStart[c] = cellStart[c - 1];
+  }
+  cellStart[0] = 0;
+}
+
+void UniformGrid::FindPairs(std::vector<BallPair> &pairs)
+{
+  Build();
+  FindPairs(0, rows, pairs);
+}
+
+unsigned long long UniformGrid::FindPairs(unsigned int firstRow, unsigned int endRow,
+                                          std::vector<BallPair> &pairs) const
+{
+  if(entries.size() < 2)
+  {
+    return 0;
+  }
+
+  if(endRow > rows)
+  {
+    endRow = rows;
+  }
+
+  /* Each cell is tested against itself and then against the four
+   * neighbours that come after it, so that no two cells are ever
+   * compared twice. */
+  unsigned long long tests = 0;
+  for(unsigned int y = firstRow; y < endRow; ++y)
+  {
+    for(unsigned int x = 0; x < columns; ++x)
+    {
+      unsigned int cell = y * columns + x;
+      if(cellStart[cell] == cellStart[cell + 1])
+      {
+        continue;
+      }
+
+      tests += TestCell(cell, pairs);
+
+      if(x + 1 < columns)
+      {
+        tests += TestCells(cell, cell + 1, pairs);
+      }
+
+      if(y + 1 < rows)
+      {
+        if(x > 0)
+        {
+          tests += TestCells(cell, cell + columns - 1, pairs);
+        }
+
+        tests += TestCells(cell, cell + columns, pairs);
+
+        if(x + 1 < columns)
+        {
+          tests += TestCells(cell, cell + columns + 1, pairs);
+        }
+      }
+    }
+  }
+
+  return tests;
+}
+
+// Returns true if the circles of the two balls overlap.
+static inline bool Touching(const Vector2D &posA, double radA,
+                            const Vector2D &posB, double radB)
+{
+  double minDistance = radA + radB;
+  return (posA - posB).LengthSquared() <= minDistance * minDistance;
+}
+
+// Stores the pair with the lower index first.
+static inline void AddPair(unsigned int a, unsigned int b, std::vector<BallPair> &pairs)
+{
+  BallPair pair;
+  pair.A = a < b ? a : b;
+  pair.B = a < b ? b : a;
+  pairs.push_back(pair);
+}
+
+unsigned long long UniformGrid::TestCell(unsigned int cell, std::vector<BallPair> &pairs) const
+{
+  unsigned int end = cellStart[cell + 1];
+
+  for(unsigned int i = cellStart[cell]; i < end; ++i)
+  {
+    const Entry &a = sorted[i];
+
+    for(unsigned int j = i + 1; j < end; ++j)
+    {
+      const Entry &b = sorted[j];
+      if(Touching(a.Position, a.Radius, b.Position, b.Radius))
+      {
+        AddPair(a.Index, b.Index, pairs);
+      }
+    }
+  }
+
+  unsigned long long count = end - cellStart[cell];
+  return count * (count - 1) / 2;
+}
+
+unsigned long long UniformGrid::TestCells(unsigned int cellA, unsigned int cellB,
+                                          std::vector<BallPair> &pairs) const
+{
+  if(cellStart[cellB] == cellStart[cellB + 1])
+  {
+    return 0;
+  }
+
+  for(unsigned int i = cellStart[cellA]; i < cellStart[cellA + 1]; ++i)
+  {
+    const Entry &a = sorted[i];
+
+    for(unsigned int j = cellStart[cellB]; j < cellStart[cellB + 1]; ++j)
+    {
+      const Entry &b = sorted[j];
+      if(Touching(a.Position, a.Radius, b.Position, b.Radius))
+      {
+        AddPair(a.Index, b.Index, pairs);
+      }
+    }
+  }
+
+  return static_cast<unsigned long long>(cellStart[cellA + 1] - cellStart[cellA]) *
+    (cellStart[cellB + 1] - cellStart[cellB]);
+}
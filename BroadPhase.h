@@ -0,0 +1,188 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include <vector>
+#include "Vector2D.h"
+
+// Two balls whose circles overlap. A is always smaller than B,
+// so every pair is reported exactly once.
+struct BallPair
+{
+  unsigned int A;
+  unsigned int B;
+};
+
+/* Uniform grid used as the broad phase for ball against ball collisions.
+ * It is meant to be rebuilt every step: balls are inserted, binned by their
+ * center into square cells at least as wide as the largest ball, and then
+ * only balls in the same or in neighbouring cells are ever compared.
+ * All storage is kept between steps, so rebuilding does not allocate
+ * once the grid has grown to the size of the scene. */
+class UniformGrid
+{
+public:
+  // Constructor
+  UniformGrid();
+
+  // Destructor
+  ~UniformGrid();
+
+  // Removes all balls from the grid.
+  void Clear();
+
+  // Adds a ball to the grid, index is what will be reported in the pairs.
+  void Insert(unsigned int index, const Vector2D &position, double radius);
+
+  /* Bins all inserted balls and appends every pair of balls that are
+   * touching to pairs. Pairs come out in the same order every time
+   * for the same input. */
+  void FindPairs(std::vector<BallPair> &pairs);
+
+  /* The same in two parts, so the search can be split up: Build bins the
+   * balls, then FindPairs looks for pairs starting in a range of rows.
+   * Searching all rows in order gives the same pairs as above. Different
+   * row ranges may be searched at the same time. Returns how many pairs
+   * of balls were tested. */
+  void Build();
+  unsigned long long FindPairs(unsigned int firstRow, unsigned int endRow,
+                               std::vector<BallPair> &pairs) const;
+
+  /* Calls func with the index of every ball touching the given circle.
+   * Only valid after Build. */
+  template<typename Func>
+  void Query(const Vector2D &position, double radius, Func func) const;
+
+  /* Calls func with the index of every ball whose circle reaches into
+   * the box [min, max], cell by cell. Only valid after Build. */
+  template<typename Func>
+  void QueryBox(const Vector2D &min, const Vector2D &max, Func func) const;
+
+  // Accessors
+  size_t GetBallCount() const;
+  double GetCellSize() const;
+  unsigned int GetRowCount() const;
+
+private:
+  struct Entry
+  {
+    Vector2D Position;
+    double Radius;
+    unsigned int Index;
+    unsigned int Cell;
+  };
+
+  // Returns the column or row an offset from the grid's corner falls in.
+  unsigned int CellCoord(double offset, unsigned int count) const;
+
+  // Tests every ball in cell a against every ball in cell b.
+  // Returns the number of tests.
+  unsigned long long TestCells(unsigned int a, unsigned int b, std::vector<BallPair> &pairs) const;
+
+  // Tests the balls within a single cell against each other.
+  unsigned long long TestCell(unsigned int cell, std::vector<BallPair> &pairs) const;
+
+  // Balls in the order they were inserted.
+  std::vector<Entry> entries;
+
+  // Balls sorted by cell, cellStart[c] is the first ball in cell c.
+  std::vector<Entry> sorted;
+  std::vector<unsigned int> cellStart;
+
+  Vector2D boundsMin, boundsMax;
+  double maxRadius;
+  double cellSize;
+  unsigned int columns, rows;
+};
+
+inline size_t UniformGrid::GetBallCount() const { return entries.size(); }
+inline double UniformGrid::GetCellSize() const { return cellSize; }
+inline unsigned int UniformGrid::GetRowCount() const { return rows; }
+
+inline unsigned int UniformGrid::CellCoord(double offset, unsigned int count) const
+{
+  double coord = offset / cellSize;
+  if(!(coord > 0.0)) return 0;
+  if(coord >= count) return count - 1;
+  return static_cast<unsigned int>(coord);
+}
+
+template<typename Func>
+void UniformGrid::Query(const Vector2D &position, double radius, Func func) const
+{
+  if(sorted.empty())
+  {
+    return;
+  }
+
+  unsigned int x0 = 0, y0 = 0;
+  unsigned int x1 = columns - 1, y1 = rows - 1;
+
+  // Balls touching the circle have their centers within this reach.
+  if(cellSize > 0.0)
+  {
+    double reach = radius + maxRadius;
+    x0 = CellCoord(position.X - reach - boundsMin.X, columns);
+    y0 = CellCoord(position.Y - reach - boundsMin.Y, rows);
+    x1 = CellCoord(position.X + reach - boundsMin.X, columns);
+    y1 = CellCoord(position.Y + reach - boundsMin.Y, rows);
+  }
+
+  for(unsigned int y = y0; y <= y1; ++y)
+  {
+    for(unsigned int x = x0; x <= x1; ++x)
+    {
+      unsigned int cell = y * columns + x;
+
+      for(unsigned int i = cellStart[cell]; i < cellStart[cell + 1]; ++i)
+      {
+        const Entry &entry = sorted[i];
+        double minDistance = radius + entry.Radius;
+        if((position - entry.Position).LengthSquared() <= minDistance * minDistance)
+        {
+          func(entry.Index);
+        }
+      }
+    }
+  }
+}
+
+template<typename Func>
+void UniformGrid::QueryBox(const Vector2D &min, const Vector2D &max, Func func) const
+{
+  if(sorted.empty())
+  {
+    return;
+  }
+
+  unsigned int x0 = 0, y0 = 0;
+  unsigned int x1 = columns - 1, y1 = rows - 1;
+
+  // Balls reaching into the box have their centers within maxRadius of it.
+  if(cellSize > 0.0)
+  {
+    x0 = CellCoord(min.X - maxRadius - boundsMin.X, columns);
+    y0 = CellCoord(min.Y - maxRadius - boundsMin.Y, rows);
+    x1 = CellCoord(max.X + maxRadius - boundsMin.X, columns);
+    y1 = CellCoord(max.Y + maxRadius - boundsMin.Y, rows);
+  }
+
+  for(unsigned int y = y0; y <= y1; ++y)
+  {
+    for(unsigned int x = x0; x <= x1; ++x)
+    {
+      unsigned int cell = y * columns + x;
+
+      for(unsigned int i = cellStart[cell]; i < cellStart[cell + 1]; ++i)
+      {
+        const Entry &entry = sorted[i];
+        if(entry.Position.X + entry.Radius >= min.X && entry.Position.X - entry.Radius <= max.X &&
+           entry.Position.Y + entry.Radius >= min.Y && entry.Position.Y - entry.Radius <= max.Y)
+        {
+          func(entry.Index);
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,124 @@
+#include "Camera.h"
+#include <algorithm>
+#include <cmath>
+
+// How quickly the camera catches up with what it follows, per second.
+const double FollowRate = 5.0;
+
+// Closer than this, in pixels, and the camera stops moving.
+const double FollowSlack = 0.25;
+
+Camera::Camera()
+{
+  width = 1;
+  height = 1;
+  center = Vector2D(0, 0);
+  zoom = 1.0;
+  following = false;
+  target = Vector2D(0, 0);
+  version = 0;
+}
+
+Camera::~Camera()
+{
+
+}
+
+void Camera::SetViewport(unsigned int width, unsigned int height)
+{
+  this->width = std::max(width, 1u);
+  this->height = std::max(height, 1u);
+  version++;
+}
+
+void Camera::SetCenter(const Vector2D &center)
+{
+  this->center = center;
+  version++;
+}
+
+void Camera::SetZoom(double zoom)
+{
+  this->zoom = std::min(std::max(zoom, MinCameraZoom), MaxCameraZoom);
+  version++;
+}
+
+void Camera::Fit(const Vector2D &min, const Vector2D &max)
+{
+  double sizeX = std::max(max.X - min.X, 1e-6);
+  double sizeY = std::max(max.Y - min.Y, 1e-6);
+
+  SetZoom(std::min(width / sizeX, height / sizeY));
+  SetCenter((min + max) * 0.5);
+}
+
+void Camera::Pan(double dx, double dy)
+{
+  // Dragging the view right shows more of the left, and y points down on the screen.
+  following = false;
+  center = center + Vector2D(-dx / zoom, dy / zoom);
+  version++;
+}
+
+void Camera::ZoomAt(double factor, double x, double y)
+{
+  Vector2D before = ToWorld(x, y);
+  SetZoom(zoom * factor);
+  Vector2D after = ToWorld(x, y);
+
+  // Following keeps the target in the middle, zoom around that instead.
+  if(!following)
+  {
+    center = center + (before - after);
+  }
+}
+
+void Camera::Follow(const Vector2D &target)
+{
+  following = true;
+  this->target = target;
+}
+
+void Camera::StopFollowing()
+{
+  following = false;
+}
+
+void Camera::Update(double dt)
+{
+  if(!following)
+  {
+    return;
+  }
+
+  Vector2D offset = target - center;
+  if(std::sqrt(offset.LengthSquared()) * zoom < FollowSlack)
+  {
+    return;
+  }
+
+  // Covers the same share of the way every second, whatever the frame rate.
+  double share = 1.0 - std::exp(-FollowRate * dt);
+  center = center + offset * share;
+  version++;
+}
+
+Matrix3x3 Camera::GetTransform() const
+{
+  return
+    Matrix3x3::Translation(-center.X, -center.Y) *
+    Matrix3x3::ScaleUniform(zoom) *
+    Matrix3x3::Scale(1, -1) *
+    Matrix3x3::Translation(width * 0.5, height * 0.5);
+}
+
+Vector2D Camera::ToWorld(double x, double y) const
+{
+  return Vector2D(center.X + (x - width * 0.5) / zoom, center.Y - (y - height * 0.5) / zoom);
+}
+
+void Camera::GetVisibleArea(Vector2D &min, Vector2D &max) const
+{
+  min = ToWorld(0, height);
+  max = ToWorld(width, 0);
+}
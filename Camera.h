@@ -0,0 +1,89 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include "Matrix3x3.h"
+#include "Vector2D.h"
+
+// How far the camera may zoom, in pixels per meter.
+const double MinCameraZoom = 2.0;
+const double MaxCameraZoom = 2000.0;
+
+/* Looks at a part of the world through a view of a fixed size in pixels.
+ * It is placed by the point in meters shown in the middle of the view
+ * and its zoom in pixels per meter, with the y axis pointing up. It can
+ * be panned and zoomed, or follow a point that moves, easing after it
+ * rather than jumping. */
+class Camera
+{
+public:
+  // Constructor, shows the origin at one pixel per meter.
+  Camera();
+
+  // Destructor
+  ~Camera();
+
+  // Size of the view in pixels.
+  void SetViewport(unsigned int width, unsigned int height);
+  unsigned int GetWidth() const;
+  unsigned int GetHeight() const;
+
+  // The point shown in the middle of the view, in meters.
+  void SetCenter(const Vector2D &center);
+  const Vector2D& GetCenter() const;
+
+  // Pixels per meter, kept within MinCameraZoom and MaxCameraZoom.
+  void SetZoom(double zoom);
+  double GetZoom() const;
+
+  // Shows [min, max] as large as it fits, with the y axis up.
+  void Fit(const Vector2D &min, const Vector2D &max);
+
+  // Moves what is shown by a number of pixels, stops following.
+  void Pan(double dx, double dy);
+
+  // Zooms by factor, the point under pixel (x, y) stays where it is.
+  void ZoomAt(double factor, double x, double y);
+
+  /* Eases the middle of the view towards target from now on, call it
+   * again as the target moves. */
+  void Follow(const Vector2D &target);
+  void StopFollowing();
+  bool IsFollowing() const;
+
+  // Moves towards the target being followed, dt seconds after the last update.
+  void Update(double dt);
+
+  // Turns meters into pixels.
+  Matrix3x3 GetTransform() const;
+
+  // Returns the point in meters a pixel shows.
+  Vector2D ToWorld(double x, double y) const;
+
+  // The part of the world the view shows, in meters.
+  void GetVisibleArea(Vector2D &min, Vector2D &max) const;
+
+  /* Goes up whenever what the view shows changes, to tell whether
+   * anything drawn with the old transform is still right. */
+  unsigned int GetVersion() const;
+
+private:
+  unsigned int width;
+  unsigned int height;
+  Vector2D center;
+  double zoom;
+
+  bool following;
+  Vector2D target;
+
+  unsigned int version;
+};
+
+// Inlined accessors
+inline unsigned int Camera::GetWidth() const { return width; }
+inline unsigned int Camera::GetHeight() const { return height; }
+inline const Vector2D& Camera::GetCenter() const { return center; }
+inline double Camera::GetZoom() const { return zoom; }
+inline bool Camera::IsFollowing() const { return following; }
+inline unsigned int Camera::GetVersion() const { return version; }
+
+#endif
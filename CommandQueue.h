@@ -0,0 +1,80 @@
+#ifndef COMMANDQUEUE_H
+#define COMMANDQUEUE_H
+
+#include <atomic>
+
+/* Fixed size queue handing items from one thread to another without
+ * locks. Exactly one thread may push and exactly one other thread may
+ * pop. Capacity has to be a power of two; pushing onto a full queue
+ * fails instead of waiting, and neither end ever allocates. */
+template<typename T, unsigned int Capacity>
+class CommandQueue
+{
+public:
+  // Constructor
+  CommandQueue();
+
+  // Adds an item, returns false if the queue is full.
+  bool Push(const T &item);
+
+  // Takes the oldest item, returns false if the queue is empty.
+  bool Pop(T &item);
+
+private:
+  // Not copyable, the ends are atomic.
+  CommandQueue(const CommandQueue &);
+  CommandQueue& operator=(const CommandQueue &);
+
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+    "Capacity has to be a power of two");
+
+  T items[Capacity];
+
+  /* Both counters only ever grow, the slot is the counter modulo the
+   * capacity. They are kept on their own cache lines so the two threads
+   * do not keep taking the line from each other. */
+  char headPad[64];
+  std::atomic<unsigned int> head;
+  char tailPad[64];
+  std::atomic<unsigned int> tail;
+  char endPad[64];
+};
+
+template<typename T, unsigned int Capacity>
+CommandQueue<T, Capacity>::CommandQueue()
+{
+  head.store(0);
+  tail.store(0);
+}
+
+template<typename T, unsigned int Capacity>
+bool CommandQueue<T, Capacity>::Push(const T &item)
+{
+  unsigned int back = tail.load(std::memory_order_relaxed);
+  if(back - head.load(std::memory_order_acquire) == Capacity)
+  {
+    return false;
+  }
+
+  // The item has to be in place before the consumer can see it.
+  items[back & (Capacity - 1)] = item;
+  tail.store(back + 1, std::memory_order_release);
+  return true;
+}
+
+template<typename T, unsigned int Capacity>
+bool CommandQueue<T, Capacity>::Pop(T &item)
+{
+  unsigned int front = head.load(std::memory_order_relaxed);
+  if(front == tail.load(std::memory_order_acquire))
+  {
+    return false;
+  }
+
+  // And it has to be copied out before the producer may reuse the slot.
+  item = items[front & (Capacity - 1)];
+  head.store(front + 1, std::memory_order_release);
+  return true;
+}
+
+#endif
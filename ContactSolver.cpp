@@ -0,0 +1,388 @@
+#include "ContactSolver.h"
+#include <algorithm>
+#include <cmath>
+#include "Physics.h"
+#include "Snapshot.h"
+
+// How much work goes into each chunk handed to the thread pool.
+const unsigned int ContactGrain = 128;
+
+// Contacts are split into at most this many batches in which no ball
+// appears twice, the rest go into one last batch solved on one thread.
+const unsigned int MaxContactColors = 64;
+
+// Balls approaching slower than this do not bounce, so they can come to rest.
+const double RestitutionThreshold = 0.5;
+
+// Overlap that is left alone, so resting contacts stay in touch.
+const double LinearSlop = 0.005;
+
+// Part of the overlap removed by each position pass, and the most any
+// one pass moves a ball.
+const double PositionCorrection = 0.2;
+const double MaxCorrection = 0.1;
+
+// Marks the second half of a cache key as a line rather than a ball.
+const unsigned long long LineKey = 1ULL << 31;
+
+ContactSolver::ContactSolver()
+{
+  balls = nullptr;
+  lines = nullptr;
+  batchFunc = nullptr;
+  velocityIterations = 8;
+  positionIterations = 3;
+}
+
+ContactSolver::~ContactSolver()
+{
+
+}
+
+void ContactSolver::Clear()
+{
+  contacts.clear();
+}
+
+void ContactSolver::Add(const Contact &contact)
+{
+  contacts.push_back(contact);
+}
+
+void ContactSolver::ResetCache()
+{
+  cache.clear();
+}
+
+void ContactSolver::Save(SnapshotWriter &writer) const
+{
+  writer.Write(velocityIterations);
+  writer.Write(positionIterations);
+  writer.WriteArray(cache);
+}
+
+bool ContactSolver::Load(SnapshotReader &reader)
+{
+  reader.Read(velocityIterations);
+  reader.Read(positionIterations);
+
+  if(!reader.IsValid() || !reader.ReadArray(cache))
+  {
+    cache.clear();
+    return false;
+  }
+
+  return true;
+}
+
+void ContactSolver::Exchange(ContactSolver &other)
+{
+  cache.swap(other.cache);
+  std::swap(velocityIterations, other.velocityIterations);
+  std::swap(positionIterations, other.positionIterations);
+}
+
+void ContactSolver::SetIterations(unsigned int velocity, unsigned int position)
+{
+  velocityIterations = velocity;
+  positionIterations = position;
+}
+
+void ContactSolver::ForEachBatch(ThreadPool *pool, ContactFunc func)
+{
+  // Kept out of the lambda so it stays small enough not to allocate.
+  batchFunc = func;
+
+  for(unsigned int color = 0; color <= MaxContactColors; ++color)
+  {
+    unsigned int first = batchStart[color];
+    unsigned int size = batchStart[color + 1] - first;
+    unsigned int grain = color < MaxContactColors ? ContactGrain : size;
+
+    ParallelFor(pool, size, grain, [this, first](unsigned int begin, unsigned int end)
+    {
+      for(unsigned int i = begin; i < end; ++i)
+      {
+        (this->*batchFunc)(contacts[batchOrder[first + i]]);
+      }
+    });
+  }
+}
+
+void ContactSolver::Solve(BallStore &balls, const std::vector<Line> &lines, ThreadPool *pool)
+{
+  this->balls = &balls;
+  this->lines = &lines;
+
+  if(!contacts.empty())
+  {
+    ColorContacts(balls.Count());
+
+    // The bounce has to be worked out from the velocities before any
+    // impulse is applied, so warm starting is a pass of its own.
+    ForEachBatch(pool, &ContactSolver::Prepare);
+    ForEachBatch(pool, &ContactSolver::WarmStart);
+
+    for(unsigned int i = 0; i < velocityIterations; ++i)
+    {
+      ForEachBatch(pool, &ContactSolver::SolveVelocity);
+    }
+
+    for(unsigned int i = 0; i < positionIterations; ++i)
+    {
+      ForEachBatch(pool, &ContactSolver::SolvePosition);
+    }
+  }
+
+  StoreCache();
+
+  this->balls = nullptr;
+  this->lines = nullptr;
+}
+
+// Inverse of the moment of inertia of a solid disc.
+static inline double InverseInertia(const BallStore &balls, unsigned int index)
+{
+  return 2.0 * balls.InverseMass[index] / (balls.Radius[index] * balls.Radius[index]);
+}
+
+// Velocity of a point of a ball, r is relative to its center.
+static inline Vector2D PointVelocity(const BallStore &balls, unsigned int index, const Vector2D &r)
+{
+  return balls.Velocity[index] + r.Perpendicular() * balls.AngularVelocity[index];
+}
+
+static inline void ApplyContactImpulse(BallStore &balls, unsigned int index,
+                                       const Vector2D &r, const Vector2D &impulse)
+{
+  balls.Velocity[index] += impulse * balls.InverseMass[index];
+  balls.AngularVelocity[index] += InverseInertia(balls, index) * Vector2D::Dot(r.Perpendicular(), impulse);
+}
+
+void ContactSolver::Prepare(Contact &contact)
+{
+  BallStore &b = *balls;
+  unsigned int slotA = b.HandleOf(contact.A).Slot;
+  unsigned long long other;
+  bool flipped = false;
+
+  // The same two bodies always get the same key, whatever their indices.
+  if(contact.B == NoBall)
+  {
+    other = LineKey | contact.Line;
+  }
+  else
+  {
+    other = b.HandleOf(contact.B).Slot;
+    flipped = other < slotA;
+  }
+
+  contact.Key = flipped ? (other << 32) | slotA : (static_cast<unsigned long long>(slotA) << 32) | other;
+
+  // Both balls touch in the point between them, along the normal.
+  Vector2D tangent = contact.Normal.Perpendicular();
+  Vector2D rA = contact.Normal * -b.Radius[contact.A];
+  double invMass = b.InverseMass[contact.A];
+  double rtA = Vector2D::Dot(rA.Perpendicular(), tangent);
+  double tangentMass = invMass + InverseInertia(b, contact.A) * rtA * rtA;
+  Vector2D velocity = PointVelocity(b, contact.A, rA);
+
+  if(contact.B != NoBall)
+  {
+    Vector2D rB = contact.Normal * b.Radius[contact.B];
+    double rtB = Vector2D::Dot(rB.Perpendicular(), tangent);
+    invMass += b.InverseMass[contact.B];
+    tangentMass += b.InverseMass[contact.B] + InverseInertia(b, contact.B) * rtB * rtB;
+    velocity = velocity - PointVelocity(b, contact.B, rB);
+  }
+
+  contact.NormalMass = invMass > 0.0 ? 1.0 / invMass : 0.0;
+  contact.TangentMass = tangentMass > 0.0 ? 1.0 / tangentMass : 0.0;
+
+  // Only a proper hit bounces, resting contacts just stop.
+  double approach = Vector2D::Dot(velocity, contact.Normal);
+  contact.VelocityBias = approach < -RestitutionThreshold ? -contact.Restitution * approach : 0.0;
+
+  // Start from where this contact ended up last step, if it was there.
+  contact.NormalImpulse = 0.0;
+  contact.TangentImpulse = 0.0;
+
+  CacheEntry probe;
+  probe.Key = contact.Key;
+  std::vector<CacheEntry>::const_iterator cached = std::lower_bound(cache.begin(), cache.end(), probe,
+    [](const CacheEntry &lhs, const CacheEntry &rhs) { return lhs.Key < rhs.Key; });
+
+  if(cached != cache.end() && cached->Key == contact.Key)
+  {
+    contact.NormalImpulse = cached->NormalImpulse;
+    contact.TangentImpulse = flipped ? -cached->TangentImpulse : cached->TangentImpulse;
+  }
+}
+
+void ContactSolver::WarmStart(Contact &contact)
+{
+  BallStore &b = *balls;
+  Vector2D tangent = contact.Normal.Perpendicular();
+  Vector2D impulse = contact.Normal * contact.NormalImpulse + tangent * contact.TangentImpulse;
+
+  ApplyContactImpulse(b, contact.A, contact.Normal * -b.Radius[contact.A], impulse);
+  if(contact.B != NoBall)
+  {
+    ApplyContactImpulse(b, contact.B, contact.Normal * b.Radius[contact.B], impulse * -1.0);
+  }
+}
+
+void ContactSolver::SolveVelocity(Contact &contact)
+{
+  BallStore &b = *balls;
+  Vector2D tangent = contact.Normal.Perpendicular();
+  Vector2D rA = contact.Normal * -b.Radius[contact.A];
+  Vector2D rB = contact.B != NoBall ? contact.Normal * b.Radius[contact.B] : Vector2D(0, 0);
+
+  // Friction first, limited by how hard the two are pressed together.
+  Vector2D velocity = PointVelocity(b, contact.A, rA);
+  if(contact.B != NoBall)
+  {
+    velocity = velocity - PointVelocity(b, contact.B, rB);
+  }
+
+  double maxFriction = contact.Friction * contact.NormalImpulse;
+  double lambda = -Vector2D::Dot(velocity, tangent) * contact.TangentMass;
+  double total = std::max(-maxFriction, std::min(contact.TangentImpulse + lambda, maxFriction));
+  lambda = total - contact.TangentImpulse;
+  contact.TangentImpulse = total;
+
+  ApplyContactImpulse(b, contact.A, rA, tangent * lambda);
+  if(contact.B != NoBall)
+  {
+    ApplyContactImpulse(b, contact.B, rB, tangent * -lambda);
+  }
+
+  // Then stop the two from approaching, the total may never pull.
+  velocity = PointVelocity(b, contact.A, rA);
+  if(contact.B != NoBall)
+  {
+    velocity = velocity - PointVelocity(b, contact.B, rB);
+  }
+
+  lambda = (contact.VelocityBias - Vector2D::Dot(velocity, contact.Normal)) * contact.NormalMass;
+  total = std::max(contact.NormalImpulse + lambda, 0.0);
+  lambda = total - contact.NormalImpulse;
+  contact.NormalImpulse = total;
+
+  ApplyContactImpulse(b, contact.A, rA, contact.Normal * lambda);
+  if(contact.B != NoBall)
+  {
+    ApplyContactImpulse(b, contact.B, rB, contact.Normal * -lambda);
+  }
+}
+
+void ContactSolver::SolvePosition(Contact &contact)
+{
+  BallStore &b = *balls;
+  Vector2D &posA = b.Position[contact.A];
+
+  // Measure the overlap again, earlier passes may have moved the balls.
+  Vector2D diff;
+  double reach = b.Radius[contact.A];
+  double invMass = b.InverseMass[contact.A];
+
+  if(contact.B != NoBall)
+  {
+    diff = posA - b.Position[contact.B];
+    reach += b.Radius[contact.B];
+    invMass += b.InverseMass[contact.B];
+  }
+  else
+  {
+    diff = posA - ClosestPointOnSegment(posA, (*lines)[contact.Line]);
+  }
+
+  double distance = diff.Length();
+  Vector2D normal = distance > 0.0 ? diff * (1.0 / distance) : contact.Normal;
+
+  double correction = PositionCorrection * (reach - distance - LinearSlop);
+  if(correction <= 0.0 || invMass <= 0.0)
+  {
+    return;
+  }
+
+  correction = std::min(correction, MaxCorrection) / invMass;
+
+  posA += normal * (correction * b.InverseMass[contact.A]);
+  if(contact.B != NoBall)
+  {
+    b.Position[contact.B] += normal * (-correction * b.InverseMass[contact.B]);
+  }
+}
+
+void ContactSolver::ColorContacts(unsigned int ballCount)
+{
+  unsigned int count = static_cast<unsigned int>(contacts.size());
+
+  // Colors already used by each ball, one bit per color.
+  ballColors.assign(ballCount, 0);
+  contactColor.resize(count);
+  batchStart.assign(MaxContactColors + 2, 0);
+
+  // Greedily give each contact the first color none of its balls has yet.
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    const Contact &contact = contacts[i];
+    unsigned long long used = ballColors[contact.A];
+    if(contact.B != NoBall)
+    {
+      used |= ballColors[contact.B];
+    }
+
+    unsigned int color = 0;
+    while(color < MaxContactColors && (used >> color) & 1)
+    {
+      color++;
+    }
+
+    if(color < MaxContactColors)
+    {
+      ballColors[contact.A] |= 1ULL << color;
+      if(contact.B != NoBall)
+      {
+        ballColors[contact.B] |= 1ULL << color;
+      }
+    }
+
+    contactColor[i] = color;
+    batchStart[color + 1]++;
+  }
+
+  for(unsigned int color = 0; color <= MaxContactColors; ++color)
+  {
+    batchStart[color + 1] += batchStart[color];
+  }
+
+  // Sort the contacts by color, keeping their order within a color.
+  batchNext.assign(batchStart.begin(), batchStart.end());
+  batchOrder.resize(count);
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    batchOrder[batchNext[contactColor[i]]++] = i;
+  }
+}
+
+void ContactSolver::StoreCache()
+{
+  cache.resize(contacts.size());
+
+  for(unsigned int i = 0; i < contacts.size(); ++i)
+  {
+    const Contact &contact = contacts[i];
+    bool flipped = contact.B != NoBall &&
+      balls->HandleOf(contact.B).Slot < balls->HandleOf(contact.A).Slot;
+
+    cache[i].Key = contact.Key;
+    cache[i].NormalImpulse = contact.NormalImpulse;
+    cache[i].TangentImpulse = flipped ? -contact.TangentImpulse : contact.TangentImpulse;
+  }
+
+  std::sort(cache.begin(), cache.end(),
+    [](const CacheEntry &lhs, const CacheEntry &rhs) { return lhs.Key < rhs.Key; });
+}
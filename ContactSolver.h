@@ -0,0 +1,144 @@
+#ifndef CONTACTSOLVER_H
+#define CONTACTSOLVER_H
+
+#include <vector>
+#include "Vector2D.h"
+#include "BallStore.h"
+#include "Line.h"
+#include "ThreadPool.h"
+
+class SnapshotWriter;
+class SnapshotReader;
+
+// Used as the second ball of a contact against a line.
+const unsigned int NoBall = ~0u;
+
+/* A ball touching another ball or a line. The finder fills in the first
+ * block, the solver keeps its own state in the second. Start from
+ * Contact() so the solver state begins at zero. */
+struct Contact
+{
+  // Balls, B is NoBall for contacts against Line.
+  unsigned int A;
+  unsigned int B;
+  unsigned int Line;
+
+  // Unit vector from B or the line towards A.
+  Vector2D Normal;
+
+  // How far the two overlap.
+  double Penetration;
+
+  double Restitution;
+  double Friction;
+
+  // ---- Solver state ---- //
+  unsigned long long Key;
+  double NormalMass;
+  double TangentMass;
+  double NormalImpulse;
+  double TangentImpulse;
+  double VelocityBias;
+};
+
+/* Iterative sequential impulse solver for ball contacts.
+ * Every step all contacts are gathered into one array and solved
+ * together: a number of passes over the velocities, each of which pushes
+ * every contact towards not approaching any more, and then a few passes
+ * that move overlapping balls apart. The impulses a contact ended up with
+ * are kept for the next step and applied right away when the same two
+ * bodies touch again, so resting stacks start out almost solved.
+ *
+ * Contacts are split into batches in which no ball appears twice, and
+ * the contacts of a batch are solved at the same time. Batches are made
+ * the same way for any number of threads, so the result is too. */
+class ContactSolver
+{
+public:
+  // Constructor
+  ContactSolver();
+
+  // Destructor
+  ~ContactSolver();
+
+  // Removes the contacts of the last step, the cache is kept.
+  void Clear();
+
+  // Adds a contact, only the finder part needs to be filled in.
+  void Add(const Contact &contact);
+
+  /* Solves the contacts, changing the velocities and positions of the
+   * balls. Ball indices must not have changed since the contacts were
+   * found. */
+  void Solve(BallStore &balls, const std::vector<Line> &lines, ThreadPool *pool);
+
+  // Forgets the impulses of the last step, for instance when lines went away.
+  void ResetCache();
+
+  /* Writes the iteration counts and the impulses of the last step, or
+   * reads them back, so a loaded world goes on exactly where it left off. */
+  void Save(SnapshotWriter &writer) const;
+  bool Load(SnapshotReader &reader);
+
+  // Swaps what Save writes with another solver, to take over a loaded one.
+  void Exchange(ContactSolver &other);
+
+  void SetIterations(unsigned int velocity, unsigned int position);
+  unsigned int GetVelocityIterations() const;
+  unsigned int GetPositionIterations() const;
+
+  // Accessors
+  const std::vector<Contact>& GetContacts() const;
+
+private:
+  struct CacheEntry
+  {
+    unsigned long long Key;
+    double NormalImpulse;
+    double TangentImpulse;
+  };
+
+  // Works out masses and bounce, and looks up the cached impulses.
+  void Prepare(Contact &contact);
+
+  // Applies the impulses the contact starts out with.
+  void WarmStart(Contact &contact);
+
+  void SolveVelocity(Contact &contact);
+  void SolvePosition(Contact &contact);
+
+  // Runs one of the above over every contact, batch after batch.
+  typedef void (ContactSolver::*ContactFunc)(Contact &contact);
+  void ForEachBatch(ThreadPool *pool, ContactFunc func);
+
+  // Sorts the contacts into batches in which every ball appears only once.
+  void ColorContacts(unsigned int ballCount);
+
+  // Remembers the impulses of this step, sorted by key.
+  void StoreCache();
+
+  std::vector<Contact> contacts;
+  std::vector<CacheEntry> cache;
+
+  // Contact batches.
+  std::vector<unsigned long long> ballColors;
+  std::vector<unsigned int> contactColor;
+  std::vector<unsigned int> batchStart;
+  std::vector<unsigned int> batchNext;
+  std::vector<unsigned int> batchOrder;
+
+  // Only valid during Solve.
+  BallStore *balls;
+  const std::vector<Line> *lines;
+  ContactFunc batchFunc;
+
+  unsigned int velocityIterations;
+  unsigned int positionIterations;
+};
+
+// Inlined accessors
+inline const std::vector<Contact>& ContactSolver::GetContacts() const { return contacts; }
+inline unsigned int ContactSolver::GetVelocityIterations() const { return velocityIterations; }
+inline unsigned int ContactSolver::GetPositionIterations() const { return positionIterations; }
+
+#endif
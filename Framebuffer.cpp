@@ -0,0 +1,137 @@
+#include "Framebuffer.h"
+#include <algorithm>
+#include <cmath>
+
+Framebuffer::Framebuffer(unsigned int width, unsigned int height)
+{
+  this->width = 0;
+  this->height = 0;
+  Resize(width, height);
+}
+
+Framebuffer::~Framebuffer()
+{
+
+}
+
+void Framebuffer::Resize(unsigned int width, unsigned int height)
+{
+  this->width = width;
+  this->height = height;
+  pixels.assign(width * height, 0);
+}
+
+void Framebuffer::Clear(unsigned int color)
+{
+  std::fill(pixels.begin(), pixels.end(), color);
+}
+
+void Framebuffer::Fill(const PixelRect &rect, unsigned int color)
+{
+  PixelRect inside = rect.Intersect(GetRect());
+  if(inside.IsEmpty())
+  {
+    return;
+  }
+
+  for(int y = inside.Top; y < inside.Bottom; ++y)
+  {
+    std::fill(GetRow(y) + inside.Left, GetRow(y) + inside.Right, color);
+  }
+}
+
+void Framebuffer::Copy(const Framebuffer &source, const PixelRect &rect)
+{
+  PixelRect inside = rect.Intersect(GetRect()).Intersect(source.GetRect());
+  if(inside.IsEmpty())
+  {
+    return;
+  }
+
+  for(int y = inside.Top; y < inside.Bottom; ++y)
+  {
+    const unsigned int *row = source.GetPixels() + y * source.GetWidth();
+    std::copy(row + inside.Left, row + inside.Right, GetRow(y) + inside.Left);
+  }
+}
+
+Sprite::Sprite()
+{
+  width = 0;
+  height = 0;
+  version = 0;
+}
+
+Sprite::~Sprite()
+{
+
+}
+
+bool Sprite::Load(unsigned int width, unsigned int height, const unsigned int *pixels,
+                  unsigned int stride)
+{
+  if(width == 0 || height == 0 || pixels == nullptr)
+  {
+    return false;
+  }
+
+  this->width = width;
+  this->height = height;
+  version++;
+  texels.assign(GetPitch() * (height + 2 * SpriteBorder), 0);
+
+  for(unsigned int y = 0; y < height; ++y)
+  {
+    std::copy(pixels + y * stride, pixels + y * stride + width,
+      texels.begin() + (y + SpriteBorder) * GetPitch() + SpriteBorder);
+  }
+
+  return true;
+}
+
+// How much of a texel a disc covers, from the distance of its center to the edge.
+static double Coverage(double distance, double radius)
+{
+  double covered = radius - distance + 0.5;
+  return covered < 0.0 ? 0.0 : covered > 1.0 ? 1.0 : covered;
+}
+
+void Sprite::MakeBall(unsigned int size)
+{
+  const double Pi = 3.14159265358979323846;
+  const unsigned int Patches = 5;
+
+  std::vector<unsigned int> pixels(size * size);
+  double radius = size * 0.5;
+
+  for(unsigned int y = 0; y < size; ++y)
+  {
+    for(unsigned int x = 0; x < size; ++x)
+    {
+      double dx = x + 0.5 - radius;
+      double dy = y + 0.5 - radius;
+      double distance = std::sqrt(dx * dx + dy * dy);
+
+      // A patch in the middle and a ring of them around it.
+      double patch = Coverage(distance, radius * 0.28);
+      for(unsigned int k = 0; k < Patches; ++k)
+      {
+        double angle = 2.0 * Pi * k / Patches;
+        double px = dx - std::cos(angle) * radius * 0.8;
+        double py = dy - std::sin(angle) * radius * 0.8;
+        patch = std::max(patch, Coverage(std::sqrt(px * px + py * py), radius * 0.22));
+      }
+
+      // Darker towards the edge, so it looks round.
+      double shade = 1.0 - 0.35 * (distance / radius) * (distance / radius);
+      double value = (255.0 * (1.0 - patch) + 40.0 * patch) * shade;
+      double alpha = Coverage(distance, radius);
+
+      unsigned int a = static_cast<unsigned int>(alpha * 255.0 + 0.5);
+      unsigned int c = static_cast<unsigned int>(value * alpha + 0.5);
+      pixels[y * size + x] = MakeColor(c, c, c, a);
+    }
+  }
+
+  Load(size, size, size > 0 ? &pixels[0] : nullptr, size);
+}
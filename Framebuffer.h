@@ -0,0 +1,149 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <vector>
+
+/* Pixels are 32 bit 0xAARRGGBB values, which lie in memory as blue,
+ * green, red and alpha on little endian machines. That is the layout of
+ * 32 bit Windows bitmaps, so a buffer can be shown without converting.
+ * Colors with alpha are premultiplied. */
+
+// Returns a color from its channels, 0 to 255 each.
+unsigned int MakeColor(unsigned int r, unsigned int g, unsigned int b, unsigned int a = 255);
+
+// Pixels from Left up to but not including Right, and from Top to Bottom.
+struct PixelRect
+{
+  // Constructor
+  PixelRect(int left = 0, int top = 0, int right = 0, int bottom = 0);
+
+  // Returns the part both rectangles cover.
+  PixelRect Intersect(const PixelRect &other) const;
+  bool IsEmpty() const;
+  int GetWidth() const;
+  int GetHeight() const;
+
+  int Left;
+  int Top;
+  int Right;
+  int Bottom;
+};
+
+// Image in memory that the rasterizer draws into, row after row.
+class Framebuffer
+{
+public:
+  // Constructor, an empty buffer until it is resized.
+  Framebuffer(unsigned int width = 0, unsigned int height = 0);
+
+  // Destructor
+  ~Framebuffer();
+
+  // Changes the size, what was drawn is lost.
+  void Resize(unsigned int width, unsigned int height);
+
+  // Fills every pixel with a color.
+  void Clear(unsigned int color);
+
+  // Fills the pixels of a rectangle, the part outside is left out.
+  void Fill(const PixelRect &rect, unsigned int color);
+
+  // Copies a rectangle from a buffer of the same size.
+  void Copy(const Framebuffer &source, const PixelRect &rect);
+
+  // The rectangle covering the whole buffer.
+  PixelRect GetRect() const;
+
+  unsigned int GetWidth() const;
+  unsigned int GetHeight() const;
+
+  // The first pixel of the top row, rows follow each other without gaps.
+  unsigned int *GetPixels();
+  const unsigned int *GetPixels() const;
+  unsigned int *GetRow(unsigned int y);
+
+private:
+  unsigned int width;
+  unsigned int height;
+  std::vector<unsigned int> pixels;
+};
+
+// Transparent texels kept around a sprite, so sampling never leaves it.
+const unsigned int SpriteBorder = 2;
+
+/* Image drawn scaled and rotated by the rasterizer, such as the picture
+ * of a ball. The texels are kept premultiplied, with a transparent
+ * border of SpriteBorder texels on every side. */
+class Sprite
+{
+public:
+  // Constructor
+  Sprite();
+
+  // Destructor
+  ~Sprite();
+
+  /* Copies an image of premultiplied pixels, the start of each row
+   * stride pixels after the one before. Returns false if it is empty. */
+  bool Load(unsigned int width, unsigned int height, const unsigned int *pixels,
+            unsigned int stride);
+
+  /* Draws a ball size texels across, white with dark patches that show
+   * how it is turned. Used where there is no picture to load. */
+  void MakeBall(unsigned int size);
+
+  unsigned int GetWidth() const;
+  unsigned int GetHeight() const;
+
+  // Changes every time the image is replaced, so copies can tell when to update.
+  unsigned int GetVersion() const;
+
+  // The texels including the border, and the distance between two rows.
+  const unsigned int *GetTexels() const;
+  unsigned int GetPitch() const;
+
+private:
+  unsigned int width;
+  unsigned int height;
+  unsigned int version;
+  std::vector<unsigned int> texels;
+};
+
+// Inlined accessors
+inline unsigned int MakeColor(unsigned int r, unsigned int g, unsigned int b, unsigned int a)
+{
+  return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+inline PixelRect::PixelRect(int left, int top, int right, int bottom)
+{
+  Left = left;
+  Top = top;
+  Right = right;
+  Bottom = bottom;
+}
+
+inline PixelRect PixelRect::Intersect(const PixelRect &other) const
+{
+  return PixelRect(Left > other.Left ? Left : other.Left, Top > other.Top ? Top : other.Top,
+    Right < other.Right ? Right : other.Right, Bottom < other.Bottom ? Bottom : other.Bottom);
+}
+
+inline bool PixelRect::IsEmpty() const { return Left >= Right || Top >= Bottom; }
+inline int PixelRect::GetWidth() const { return Right - Left; }
+inline int PixelRect::GetHeight() const { return Bottom - Top; }
+
+inline unsigned int Framebuffer::GetWidth() const { return width; }
+inline unsigned int Framebuffer::GetHeight() const { return height; }
+inline unsigned int *Framebuffer::GetPixels() { return pixels.empty() ? nullptr : &pixels[0]; }
+inline const unsigned int *Framebuffer::GetPixels() const { return pixels.empty() ? nullptr : &pixels[0]; }
+inline unsigned int *Framebuffer::GetRow(unsigned int y) { return &pixels[y * width]; }
+inline PixelRect Framebuffer::GetRect() const { return PixelRect(0, 0, width, height); }
+
+inline unsigned int Sprite::GetWidth() const { return width; }
+inline unsigned int Sprite::GetHeight() const { return height; }
+inline unsigned int Sprite::GetVersion() const { return version; }
+inline const unsigned int *Sprite::GetTexels() const { return texels.empty() ? nullptr : &texels[0]; }
+inline unsigned int Sprite::GetPitch() const { return width + 2 * SpriteBorder; }
+
+#endif
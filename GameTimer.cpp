@@ -1,10 +1,159 @@
 #include "GameTimer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 
+#if !defined(GAMETIMER_NO_TSC) && \
+    (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#define GAMETIMER_TSC
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#endif
+
+/* Before Visual Studio 2015 steady_clock only ticks every millisecond or
+ * so, the performance counter is what it should have been built on. */
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define GAMETIMER_QPC
+#include <Windows.h>
+#endif
+
+// Where ticks come from and how long one lasts.
+struct ClockSource
+{
+  bool UseTsc;
+  double TickSeconds;
+};
+
+// Reads the clock the time stamp counter is calibrated against.
+static long long ReadClock()
+{
+#ifdef GAMETIMER_QPC
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return counter.QuadPart;
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+static double ClockTickSeconds()
+{
+#ifdef GAMETIMER_QPC
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  return 1.0 / frequency.QuadPart;
+#else
+  return static_cast<double>(std::chrono::steady_clock::period::num) /
+    std::chrono::steady_clock::period::den;
+#endif
+}
+
+#ifdef GAMETIMER_TSC
+
+static long long ReadTsc()
+{
+  return static_cast<long long>(__rdtsc());
+}
+
+/* Only an invariant counter runs at the same rate in every power state
+ * and on every core, older ones speed up and slow down with the CPU. */
+static bool CpuHasInvariantTsc()
+{
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0x80000000);
+  if(static_cast<unsigned int>(info[0]) < 0x80000007)
+  {
+    return false;
+  }
+
+  __cpuid(info, 0x80000007);
+  return (info[3] & (1 << 8)) != 0;
+#else
+  unsigned int eax, ebx, ecx, edx;
+  if(!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+  {
+    return false;
+  }
+
+  return (edx & (1 << 8)) != 0;
+#endif
+}
+
+#endif // GAMETIMER_TSC
+
+// How long the counter is timed against the clock, in seconds.
+const double CalibrationTime = 0.005;
+
+static ClockSource Calibrate()
+{
+  ClockSource source;
+  source.UseTsc = false;
+  source.TickSeconds = ClockTickSeconds();
+
+#ifdef GAMETIMER_TSC
+  if(!CpuHasInvariantTsc())
+  {
+    return source;
+  }
+
+  // Count the cycles that pass while the clock moves on a little.
+  long long clockStart = ReadClock();
+  long long tscStart = ReadTsc();
+  long long clockEnd, tscEnd;
+  do
+  {
+    clockEnd = ReadClock();
+    tscEnd = ReadTsc();
+  }
+  while((clockEnd - clockStart) * source.TickSeconds < CalibrationTime);
+
+  double seconds = (clockEnd - clockStart) * source.TickSeconds;
+  if(tscEnd > tscStart)
+  {
+    source.UseTsc = true;
+    source.TickSeconds = seconds / (tscEnd - tscStart);
+  }
+#endif
+
+  return source;
+}
+
+// Calibrated once at startup.
+static const ClockSource clockSource = Calibrate();
+
+long long GameTimer::Now()
+{
+#ifdef GAMETIMER_TSC
+  if(clockSource.UseTsc)
+  {
+    return ReadTsc();
+  }
+#endif
+
+  return ReadClock();
+}
+
+double GameTimer::TicksToSeconds(long long ticks)
+{
+  return ticks * clockSource.TickSeconds;
+}
+
+bool GameTimer::IsUsingTsc()
+{
+  return clockSource.UseTsc;
+}
 
 GameTimer::GameTimer()
 {
   running = false;
-  QueryPerformanceFrequency(&ticksPerSec);
+  startTick = 0;
+  lastDeltaTick = 0;
+  lastLapTick = 0;
 }
 
 GameTimer::~GameTimer()
@@ -15,16 +164,12 @@ GameTimer::~GameTimer()
 
 bool GameTimer::Start()
 {
-  if(!QueryPerformanceCounter(&startTick))
-  {
-    return false;
-  }
-  
+  startTick = Now();
   running = true;
 
-  lastTick = startTick;
   lastDeltaTick = startTick;
-  
+  lastLapTick = startTick;
+
   return true;
 }
 
@@ -41,9 +186,7 @@ double GameTimer::TimeSinceStart()
     return 0.0;
   }
 
-  QueryPerformanceCounter(&lastTick);
-
-  return DeltaSeconds(lastTick, startTick);
+  return TicksToSeconds(Now() - startTick);
 }
 
 double GameTimer::DeltaTime()
@@ -53,21 +196,116 @@ double GameTimer::DeltaTime()
     return 0.0;
   }
 
-  QueryPerformanceCounter(&thisDeltaTick);
+  long long now = Now();
+  double seconds = TicksToSeconds(now - lastDeltaTick);
+  lastDeltaTick = now;
 
-  double ms = DeltaSeconds(thisDeltaTick, lastDeltaTick);
+  return seconds;
+}
+
+double GameTimer::Lap()
+{
+  if(!running)
+  {
+    return 0.0;
+  }
+
+  long long now = Now();
+  double seconds = TicksToSeconds(now - lastLapTick);
+  lastLapTick = now;
+
+  return seconds;
+}
+
+TimingStats::TimingStats(unsigned int capacity)
+{
+  samples.resize(capacity > 0 ? capacity : 1);
+  sorted.reserve(samples.size());
+  next = 0;
+  count = 0;
+}
+
+TimingStats::~TimingStats()
+{
 
-  lastDeltaTick = thisDeltaTick;
+}
+
+void TimingStats::Add(double seconds)
+{
+  // The oldest sample makes room once all are taken.
+  samples[next] = seconds;
+  next = (next + 1) % samples.size();
+  if(count < samples.size())
+  {
+    count++;
+  }
+}
+
+void TimingStats::Clear()
+{
+  next = 0;
+  count = 0;
+}
+
+double TimingStats::GetLast() const
+{
+  if(count == 0)
+  {
+    return 0.0;
+  }
 
-  return ms;
+  return samples[(next + samples.size() - 1) % samples.size()];
 }
 
-double GameTimer::DeltaSeconds(const LARGE_INTEGER &later,
-                                  const LARGE_INTEGER &earlier)
+double TimingStats::GetMin() const
 {
-  __int64 elapsedTicks = later.QuadPart - earlier.QuadPart;
-  double elapsedSeconds = elapsedTicks / (double)ticksPerSec.QuadPart;
+  if(count == 0)
+  {
+    return 0.0;
+  }
+
+  return *std::min_element(samples.begin(), samples.begin() + count);
+}
+
+double TimingStats::GetMax() const
+{
+  if(count == 0)
+  {
+    return 0.0;
+  }
+
+  return *std::max_element(samples.begin(), samples.begin() + count);
+}
+
+double TimingStats::GetAverage() const
+{
+  if(count == 0)
+  {
+    return 0.0;
+  }
+
+  double sum = 0.0;
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    sum += samples[i];
+  }
+
+  return sum / count;
+}
+
+double TimingStats::GetPercentile(double percent) const
+{
+  if(count == 0)
+  {
+    return 0.0;
+  }
+
+  // Nearest rank, so the result is always one of the samples.
+  double rank = std::ceil(percent / 100.0 * count);
+  unsigned int index = rank <= 1.0 ? 0 :
+    rank >= count ? count - 1 : static_cast<unsigned int>(rank) - 1;
 
-  // Convert to millisceonds
-  return elapsedSeconds;
+  sorted.assign(samples.begin(), samples.begin() + count);
+  std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+  return sorted[index];
 }
@@ -1,11 +1,13 @@
 #ifndef GAMETIMER_H
 #define GAMETIMER_H
-#include <windows.h>
 
-/* Class used to measure time with greater precision through
- * Win32's QueryPerformanceCounter api. This requires the prescence
- * of a high performance counter on the CPU, which should be present on most
- * hardware more recent than 10 years. */
+#include <vector>
+
+/* Class used to measure time with high precision on any platform.
+ * Time is read in ticks from std::chrono::steady_clock, or straight from
+ * the time stamp counter of the CPU when it runs at a constant rate. The
+ * counter is calibrated against the clock once at startup and costs a
+ * few cycles to read instead of a call into the system. */
 
 class GameTimer
 {
@@ -25,28 +27,97 @@ public:
   // Returns the time since the timer was started.
   double TimeSinceStart();
 
-  /* Returns the elapsed time since 
+  /* Returns the elapsed time since
    * the last call to DeltaTime() */
   double DeltaTime();
-  
+
+  /* Returns the elapsed time since the last call to Lap(), kept apart
+   * from DeltaTime() so one timer can measure frames and their parts. */
+  double Lap();
+
   // Check if the timer is running
   inline int IsRunning() { return running; }
 
+  // Returns the current time in ticks, only differences mean anything.
+  static long long Now();
 
+  // Converts a number of ticks into seconds.
+  static double TicksToSeconds(long long ticks);
 
-private:
-  // Returns the elapsed milliseconds between two LARGE_INTEGERs
-  double DeltaSeconds(const LARGE_INTEGER &later,
-                          const LARGE_INTEGER &earlier);
+  // Returns true if ticks come from the time stamp counter.
+  static bool IsUsingTsc();
 
+private:
   // True if the timer is running.
   bool running;
 
-  LARGE_INTEGER startTick;
-  LARGE_INTEGER lastTick;
-  LARGE_INTEGER ticksPerSec;
-  LARGE_INTEGER lastDeltaTick;
-  LARGE_INTEGER thisDeltaTick;
+  long long startTick;
+  long long lastDeltaTick;
+  long long lastLapTick;
 };
 
-#endif
\ No newline at end of file
+/* Keeps the last samples of a recurring time, such as the length of a
+ * step, and sums them up as minimum, average and percentiles. Adding a
+ * sample never allocates; percentiles sort a copy of the samples. */
+class TimingStats
+{
+public:
+  // Constructor, keeps up to capacity samples.
+  TimingStats(unsigned int capacity = 256);
+
+  // Destructor
+  ~TimingStats();
+
+  void Add(double seconds);
+  void Clear();
+
+  // Over the samples kept, zero if there are none.
+  unsigned int GetCount() const;
+  double GetLast() const;
+  double GetMin() const;
+  double GetMax() const;
+  double GetAverage() const;
+
+  // The time that percent of the samples did not go over, 99 for p99.
+  double GetPercentile(double percent) const;
+
+private:
+  std::vector<double> samples;
+  unsigned int next;
+  unsigned int count;
+  mutable std::vector<double> sorted;
+};
+
+/* Adds the time from its construction to the end of the enclosing
+ * scope to a TimingStats. */
+class ScopedTimer
+{
+public:
+  // Constructor, starts timing.
+  ScopedTimer(TimingStats &stats);
+
+  // Destructor, adds the time.
+  ~ScopedTimer();
+
+private:
+  ScopedTimer& operator=(const ScopedTimer &);
+
+  TimingStats &stats;
+  long long start;
+};
+
+// Inlined accessors
+inline unsigned int TimingStats::GetCount() const { return count; }
+
+inline ScopedTimer::ScopedTimer(TimingStats &stats)
+  : stats(stats)
+{
+  start = GameTimer::Now();
+}
+
+inline ScopedTimer::~ScopedTimer()
+{
+  stats.Add(GameTimer::TicksToSeconds(GameTimer::Now() - start));
+}
+
+#endif
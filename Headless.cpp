@@ -0,0 +1,741 @@
+/* Runs the simulation without a window, as fast as the CPU allows.
+ * Builds a closed box, fills it with balls and steps it a fixed number
+ * of times, then prints how long that took. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include "World.h"
+#include "WorldBatch.h"
+#include "Line.h"
+#include "ThreadPool.h"
+#include "Trajectory.h"
+#include "OffscreenRenderer.h"
+#include "Random.h"
+#include "Profiler.h"
+#include "GameTimer.h"
+
+struct HeadlessOptions
+{
+  unsigned int Balls;
+  unsigned int Steps;
+  double Dt;
+  unsigned int Seed;
+  unsigned int Threads;
+  bool Scaling;
+  bool BallCollisions;
+  bool Sleeping;
+  bool ContinuousCollisions;
+
+  // Snapshot to start from instead of building the scene, and to save at the end.
+  const char *Load;
+  const char *Save;
+
+  // Trajectory file to record to, and how many steps go between frames.
+  const char *Record;
+  unsigned int RecordEvery;
+
+  // Files to write the state hash of every step to, or to check it against.
+  const char *HashLog;
+  const char *Verify;
+
+  // Chrome trace of the phases of every step.
+  const char *Trace;
+
+  // Independent worlds to run side by side, and the restitutions spread over them.
+  unsigned int Worlds;
+  bool SweepRestitution;
+  double RestitutionMin;
+  double RestitutionMax;
+
+  /* Frames to render, to numbered image files or raw into a program, of
+   * the running world or of a recorded trajectory. */
+  const char *Render;
+  const char *RenderPipe;
+  const char *RenderFrom;
+  unsigned int RenderEvery;
+  unsigned int RenderWidth;
+  unsigned int RenderHeight;
+  unsigned int FramesInFlight;
+};
+
+static void PrintUsage()
+{
+  printf("Usage: BallsHeadless [options]\n"
+         "  --balls N      number of balls (default 1000)\n"
+         "  --steps N      number of steps to run (default 1000)\n"
+         "  --dt SECONDS   length of each step (default 0.01)\n"
+         "  --seed N       seed for ball placement (default 1)\n"
+         "  --threads N    threads to step with, 0 for all cores (default 1)\n"
+         "  --scaling      run once for every thread count from 1 to --threads\n"
+         "  --no-ball-collisions\n"
+         "  --no-sleeping\n"
+         "  --no-ccd       let fast balls skip over lines between steps\n"
+         "  --load FILE    start from a snapshot instead of a new scene\n"
+         "  --save FILE    save a snapshot once all steps have run\n"
+         "  --record FILE  record the trajectories of all balls\n"
+         "  --record-every N  steps between recorded frames (default 1)\n"
+         "  --hash-log FILE  write the state hash after every step\n"
+         "  --verify FILE  check every step against a hash log of as many steps,\n"
+         "                 the first step that differs is reported\n"
+         "  --trace FILE   write a Chrome trace of every step\n"
+         "  --worlds N     run N worlds with seeds seed..seed+N-1 side by side,\n"
+         "                 one per thread, and sum up how they ended\n"
+         "  --sweep-restitution MIN MAX\n"
+         "                 spread the restitution of the worlds from MIN to MAX\n"
+         "  --render PATTERN  render frames to numbered files such as\n"
+         "                 frames/%%06u.png, PNG or else PPM by the extension\n"
+         "  --render-pipe COMMAND\n"
+         "                 render frames as raw 24 bit RGB into a program\n"
+         "  --render-from FILE  render a recorded trajectory instead of stepping;\n"
+         "                 build the scene it was recorded from to get the sizes\n"
+         "  --render-every N  steps or recorded frames between frames (default 1)\n"
+         "  --render-size W H  size of the frames (default 1280 720)\n"
+         "  --frames-in-flight N  frames rendered at once, 0 for two per thread\n");
+}
+
+static bool ParseOptions(int argc, char **argv, HeadlessOptions &options)
+{
+  for(int i = 1; i < argc; ++i)
+  {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if(strcmp(arg, "--balls") == 0 && hasValue)
+      options.Balls = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--steps") == 0 && hasValue)
+      options.Steps = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--dt") == 0 && hasValue)
+      options.Dt = atof(argv[++i]);
+    else if(strcmp(arg, "--seed") == 0 && hasValue)
+      options.Seed = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--threads") == 0 && hasValue)
+      options.Threads = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--scaling") == 0)
+      options.Scaling = true;
+    else if(strcmp(arg, "--no-ball-collisions") == 0)
+      options.BallCollisions = false;
+    else if(strcmp(arg, "--no-sleeping") == 0)
+      options.Sleeping = false;
+    else if(strcmp(arg, "--no-ccd") == 0)
+      options.ContinuousCollisions = false;
+    else if(strcmp(arg, "--load") == 0 && hasValue)
+      options.Load = argv[++i];
+    else if(strcmp(arg, "--save") == 0 && hasValue)
+      options.Save = argv[++i];
+    else if(strcmp(arg, "--record") == 0 && hasValue)
+      options.Record = argv[++i];
+    else if(strcmp(arg, "--record-every") == 0 && hasValue)
+      options.RecordEvery = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--hash-log") == 0 && hasValue)
+      options.HashLog = argv[++i];
+    else if(strcmp(arg, "--verify") == 0 && hasValue)
+      options.Verify = argv[++i];
+    else if(strcmp(arg, "--trace") == 0 && hasValue)
+      options.Trace = argv[++i];
+    else if(strcmp(arg, "--worlds") == 0 && hasValue)
+      options.Worlds = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--sweep-restitution") == 0 && i + 2 < argc)
+    {
+      options.SweepRestitution = true;
+      options.RestitutionMin = atof(argv[++i]);
+      options.RestitutionMax = atof(argv[++i]);
+    }
+    else if(strcmp(arg, "--render") == 0 && hasValue)
+      options.Render = argv[++i];
+    else if(strcmp(arg, "--render-pipe") == 0 && hasValue)
+      options.RenderPipe = argv[++i];
+    else if(strcmp(arg, "--render-from") == 0 && hasValue)
+      options.RenderFrom = argv[++i];
+    else if(strcmp(arg, "--render-every") == 0 && hasValue)
+      options.RenderEvery = static_cast<unsigned int>(atoi(argv[++i]));
+    else if(strcmp(arg, "--render-size") == 0 && i + 2 < argc)
+    {
+      options.RenderWidth = static_cast<unsigned int>(atoi(argv[++i]));
+      options.RenderHeight = static_cast<unsigned int>(atoi(argv[++i]));
+    }
+    else if(strcmp(arg, "--frames-in-flight") == 0 && hasValue)
+      options.FramesInFlight = static_cast<unsigned int>(atoi(argv[++i]));
+    else
+      return false;
+  }
+
+  return options.Dt > 0.0 && options.RecordEvery > 0 && options.Worlds > 0 &&
+    options.RenderEvery > 0 && options.RenderWidth > 0 && options.RenderHeight > 0;
+}
+
+/* Builds the walls of a box large enough to hold the balls with room to
+ * spare. */
+static std::vector<Line> BuildBox(const HeadlessOptions &options)
+{
+  const double spacing = 0.8;
+  unsigned int perRow = static_cast<unsigned int>(std::ceil(std::sqrt((double)options.Balls)));
+  if(perRow == 0) perRow = 1;
+  unsigned int numRows = (options.Balls + perRow - 1) / perRow;
+
+  double width = perRow * spacing + 1.0;
+  double height = numRows * spacing * 2.0 + 1.0;
+
+  std::vector<Line> lines;
+  lines.push_back(Line(Vector2D(0, height), Vector2D(width, height)));
+  lines.push_back(Line(Vector2D(width, height), Vector2D(width, 0)));
+  lines.push_back(Line(Vector2D(0, 0), Vector2D(width, 0)));
+  lines.push_back(Line(Vector2D(0, height), Vector2D(0, 0)));
+  return lines;
+}
+
+/* Places the balls on a jittered grid in the upper half of the box.
+ * Ball sizes follow the window's AddBall. */
+static void AddBalls(World &world, const HeadlessOptions &options, unsigned int seed)
+{
+  const double spacing = 0.8;
+  unsigned int perRow = static_cast<unsigned int>(std::ceil(std::sqrt((double)options.Balls)));
+  if(perRow == 0) perRow = 1;
+  unsigned int numRows = (options.Balls + perRow - 1) / perRow;
+
+  double height = numRows * spacing * 2.0 + 1.0;
+
+  Random random(seed);
+  for(unsigned int i = 0; i < options.Balls; ++i)
+  {
+    double x = 0.5 + (i % perRow + 0.5) * spacing;
+    double y = height - 0.5 - (i / perRow + 0.5) * spacing;
+    double jitter = (static_cast<int>(random.NextInt(100)) - 50) / 500.0;
+
+    float sz = random.NextInt(18) + 19;
+    world.AddBall(sz / 13.0f, sz / 100.0f, Vector2D(x + jitter, y));
+  }
+}
+
+static void BuildScene(World &world, const HeadlessOptions &options)
+{
+  std::vector<Line> box = BuildBox(options);
+  for(const Line &line : box)
+  {
+    world.AddLine(line);
+  }
+
+  AddBalls(world, options, options.Seed);
+}
+
+/* Opens the output the options ask for, if any, showing the whole box.
+ * Returns false if it could not be opened. */
+static bool OpenRender(const HeadlessOptions &options, const World &world,
+                       OffscreenRenderer &offscreen)
+{
+  offscreen.SetLines(world.GetLines());
+  offscreen.FitToLines(10);
+
+  if(options.RenderPipe)
+  {
+    if(!offscreen.OpenPipe(options.RenderPipe))
+    {
+      fprintf(stderr, "Could not start %s\n", options.RenderPipe);
+      return false;
+    }
+  }
+  else if(options.Render)
+  {
+    size_t length = strlen(options.Render);
+    bool png = length >= 4 && strcmp(options.Render + length - 4, ".png") == 0;
+    if(!offscreen.OpenSequence(options.Render, png ? FramePng : FramePpm))
+    {
+      fprintf(stderr, "Frame names need exactly one number such as %%06u: %s\n", options.Render);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Closes the output, returns false and reports it if a frame was lost.
+static bool CloseRender(const HeadlessOptions &options, OffscreenRenderer &offscreen)
+{
+  if(!offscreen.IsOpen())
+  {
+    return true;
+  }
+
+  if(!offscreen.Close())
+  {
+    fprintf(stderr, "Could not write every frame to %s\n",
+      options.RenderPipe ? options.RenderPipe : options.Render);
+    return false;
+  }
+
+  return true;
+}
+
+// Writes one line per step with the step and the state hash after it.
+static bool WriteHashLog(const char *path, const std::vector<unsigned long long> &hashes)
+{
+  FILE *file = fopen(path, "w");
+  if(file == nullptr)
+  {
+    return false;
+  }
+
+  for(unsigned int step = 0; step < hashes.size(); ++step)
+  {
+    fprintf(file, "%u %016llx\n", step, hashes[step]);
+  }
+
+  return fclose(file) == 0;
+}
+
+/* Compares the hashes of this run with a log written by another one.
+ * Returns false and reports the first step that differs, and also if the
+ * log cannot be read to the end, skips a step or has a different number
+ * of steps than this run. */
+static bool VerifyHashLog(const char *path, const std::vector<unsigned long long> &hashes)
+{
+  FILE *file = fopen(path, "r");
+  if(file == nullptr)
+  {
+    fprintf(stderr, "Could not open hash log %s\n", path);
+    return false;
+  }
+
+  unsigned int step;
+  unsigned long long expected;
+  unsigned int checked = 0;
+  bool same = true;
+  int read;
+
+  while(same && (read = fscanf(file, "%u %llx", &step, &expected)) == 2)
+  {
+    if(step != checked)
+    {
+      fprintf(stderr, "Hash log %s has step %u where step %u belongs\n", path, step, checked);
+      same = false;
+    }
+    else if(step >= hashes.size())
+    {
+      fprintf(stderr, "Hash log %s goes on past the %u steps of this run\n", path,
+        static_cast<unsigned int>(hashes.size()));
+      same = false;
+    }
+    else if(hashes[step] != expected)
+    {
+      fprintf(stderr, "Diverged at step %u: expected %016llx, got %016llx\n",
+        step, expected, hashes[step]);
+      same = false;
+    }
+    else
+    {
+      checked++;
+    }
+  }
+
+  // Anything but the end of the file means a line could not be read.
+  if(same && read != EOF)
+  {
+    fprintf(stderr, "Could not read step %u of hash log %s\n", checked, path);
+    same = false;
+  }
+
+  fclose(file);
+
+  if(same && checked != hashes.size())
+  {
+    fprintf(stderr, "Hash log %s ends after %u of %u steps\n", path, checked,
+      static_cast<unsigned int>(hashes.size()));
+    same = false;
+  }
+
+  if(same)
+  {
+    printf("verified:       %u steps\n", checked);
+  }
+  return same;
+}
+
+/* Builds a fresh scene or loads one and steps it, returns the wall time
+ * in seconds or a negative time if a snapshot could not be used. The time
+ * of every step goes into stepTimes. */
+static double RunScene(const HeadlessOptions &options, unsigned int threads,
+                       unsigned int &balls, unsigned long long &checksum,
+                       TimingStats &stepTimes)
+{
+  ThreadPool pool(threads);
+
+  World world;
+  world.SetThreadPool(&pool);
+
+  // A snapshot brings its own settings along.
+  if(options.Load)
+  {
+    if(!world.LoadSnapshot(options.Load))
+    {
+      fprintf(stderr, "Could not load snapshot %s\n", options.Load);
+      return -1.0;
+    }
+  }
+  else
+  {
+    world.SetBallCollisions(options.BallCollisions);
+    world.SetSleeping(options.Sleeping);
+    world.SetContinuousCollisions(options.ContinuousCollisions);
+    BuildScene(world, options);
+  }
+
+  TrajectoryRecorder recorder;
+  if(options.Record)
+  {
+    TrajectorySettings settings;
+    settings.Interval = options.RecordEvery;
+    if(!recorder.Open(options.Record, settings))
+    {
+      fprintf(stderr, "Could not record to %s\n", options.Record);
+      return -1.0;
+    }
+  }
+
+  OffscreenRenderer offscreen(options.RenderWidth, options.RenderHeight, &pool,
+    options.FramesInFlight);
+  if(!OpenRender(options, world, offscreen))
+  {
+    return -1.0;
+  }
+
+  Profiler profiler;
+  if(options.Trace)
+  {
+    profiler.SetCapture(true);
+    world.SetProfiler(&profiler);
+  }
+
+  std::vector<unsigned long long> hashes;
+  bool hashing = options.HashLog || options.Verify;
+  if(hashing)
+  {
+    hashes.reserve(options.Steps);
+  }
+
+  GameTimer timer;
+  timer.Start();
+
+  for(unsigned int step = 0; step < options.Steps; ++step)
+  {
+    profiler.BeginFrame();
+    {
+      ScopedTimer stepTimer(stepTimes);
+      world.Step(options.Dt);
+    }
+
+    {
+      ProfileScope zone(&profiler, "record");
+      recorder.Record(world.GetBalls());
+    }
+
+    if(hashing)
+    {
+      hashes.push_back(world.ComputeStateHash());
+    }
+
+    if(offscreen.IsOpen() && step % options.RenderEvery == 0)
+    {
+      ProfileScope zone(&profiler, "render");
+      offscreen.AddFrame(world.GetBalls());
+    }
+    profiler.EndFrame();
+  }
+
+  bool rendering = offscreen.IsOpen();
+  if(!CloseRender(options, offscreen))
+  {
+    return -1.0;
+  }
+
+  if(rendering)
+  {
+    printf("rendered:       %u frames\n", offscreen.GetFramesWritten());
+  }
+
+  double seconds = timer.TimeSinceStart();
+
+  recorder.Close();
+  if(recorder.GetFramesDropped() > 0)
+  {
+    fprintf(stderr, "Dropped %u of %u frames, the disk could not keep up\n",
+      recorder.GetFramesDropped(), recorder.GetFramesDropped() + recorder.GetFramesRecorded());
+  }
+
+  balls = world.GetBalls().Count();
+  checksum = world.ComputeStateHash();
+
+  if(options.HashLog && !WriteHashLog(options.HashLog, hashes))
+  {
+    fprintf(stderr, "Could not write hash log %s\n", options.HashLog);
+    return -1.0;
+  }
+
+  if(options.Trace && !profiler.WriteChromeTrace(options.Trace))
+  {
+    fprintf(stderr, "Could not write trace %s\n", options.Trace);
+    return -1.0;
+  }
+
+  if(options.Verify && !VerifyHashLog(options.Verify, hashes))
+  {
+    return -1.0;
+  }
+
+  if(options.Save && !world.SaveSnapshot(options.Save))
+  {
+    fprintf(stderr, "Could not save snapshot %s\n", options.Save);
+    return -1.0;
+  }
+
+  return seconds;
+}
+
+/* Renders every options.RenderEvery-th frame of a trajectory. The file
+ * only holds where the balls were, so the scene it was recorded from is
+ * built or loaded again for the lines and the size of every ball.
+ * Returns false if anything could not be read or written. */
+static bool RenderTrajectory(const HeadlessOptions &options, unsigned int threads)
+{
+  World world;
+  if(options.Load)
+  {
+    if(!world.LoadSnapshot(options.Load))
+    {
+      fprintf(stderr, "Could not load snapshot %s\n", options.Load);
+      return false;
+    }
+  }
+  else
+  {
+    BuildScene(world, options);
+  }
+
+  TrajectoryReader reader;
+  if(!reader.Open(options.RenderFrom))
+  {
+    fprintf(stderr, "Could not read trajectory %s\n", options.RenderFrom);
+    return false;
+  }
+
+  ThreadPool pool(threads);
+  OffscreenRenderer offscreen(options.RenderWidth, options.RenderHeight, &pool,
+    options.FramesInFlight);
+  if(!OpenRender(options, world, offscreen))
+  {
+    return false;
+  }
+
+  if(!offscreen.IsOpen())
+  {
+    fprintf(stderr, "Give --render or --render-pipe to say where the frames go\n");
+    return false;
+  }
+
+  GameTimer timer;
+  timer.Start();
+
+  // Balls are matched by handle, those the scene does not have are left out.
+  const BallStore &balls = world.GetBalls();
+  TrajectoryFrame frame;
+  for(unsigned int f = 0; f < reader.GetFrameCount(); f += options.RenderEvery)
+  {
+    if(!reader.ReadFrame(f, frame))
+    {
+      fprintf(stderr, "Frame %u of %s is damaged\n", f, options.RenderFrom);
+      break;
+    }
+
+    OffscreenFrame &out = offscreen.AddFrame();
+    out.Position = frame.Position;
+    out.Orientation = frame.Orientation;
+    out.Radius.resize(frame.Handles.size());
+    for(unsigned int i = 0; i < frame.Handles.size(); ++i)
+    {
+      BallHandle handle = frame.Handles[i];
+      out.Radius[i] = balls.IsValid(handle) ? balls.Radius[balls.IndexOf(handle)] : 0.0;
+    }
+  }
+
+  if(!CloseRender(options, offscreen))
+  {
+    return false;
+  }
+
+  double seconds = timer.TimeSinceStart();
+  unsigned int frames = offscreen.GetFramesWritten();
+  printf("frames:         %u of %u recorded\n", frames, reader.GetFrameCount());
+  printf("size:           %u x %u\n", offscreen.GetWidth(), offscreen.GetHeight());
+  printf("threads:        %u\n", threads);
+  printf("in flight:      %u\n", offscreen.GetFramesInFlight());
+  printf("wall time:      %.3f s\n", seconds);
+  if(seconds > 0.0)
+  {
+    printf("frames/sec:     %.1f\n", frames / seconds);
+  }
+
+  return true;
+}
+
+/* Steps options.Worlds worlds in one batch, all in the same box but each
+ * with its own seed and, when sweeping, its own restitution. Prints one
+ * line per world and a summary. */
+static void RunBatch(const HeadlessOptions &options, unsigned int threads)
+{
+  ThreadPool pool(threads);
+
+  WorldBatch batch;
+  batch.SetLines(BuildBox(options));
+
+  for(unsigned int w = 0; w < options.Worlds; ++w)
+  {
+    World &world = batch.GetWorld(batch.AddWorld());
+    world.SetBallCollisions(options.BallCollisions);
+    world.SetSleeping(options.Sleeping);
+    world.SetContinuousCollisions(options.ContinuousCollisions);
+
+    if(options.SweepRestitution)
+    {
+      double t = options.Worlds > 1 ? (double)w / (options.Worlds - 1) : 0.0;
+      world.SetRestitution(options.RestitutionMin + t * (options.RestitutionMax - options.RestitutionMin));
+    }
+
+    AddBalls(world, options, options.Seed + w);
+  }
+
+  batch.Run(options.Dt, options.Steps, &pool);
+
+  printf("world  restitution  awake  kinetic energy  mean height  wall time  checksum\n");
+  const std::vector<WorldResult> &results = batch.GetResults();
+  for(unsigned int w = 0; w < results.size(); ++w)
+  {
+    const WorldResult &result = results[w];
+    printf("%5u  %11.3f  %5u  %12.3f J  %9.3f m  %8.3fs  %016llx\n", w,
+      batch.GetWorld(w).GetRestitution(), result.Awake, result.KineticEnergy,
+      result.MeanHeight, result.Seconds, result.StateHash);
+  }
+
+  BatchSummary summary = batch.Summarize();
+  printf("\nworlds:         %u\n", summary.Worlds);
+  printf("threads:        %u\n", threads);
+  printf("steps:          %u\n", summary.Steps);
+  printf("wall time:      %.3f s\n", summary.Seconds);
+  if(summary.Seconds > 0.0)
+  {
+    printf("balls/sec:      %.0f\n", summary.BallSteps / summary.Seconds);
+  }
+  printf("kinetic energy: min %.3f  mean %.3f  max %.3f J\n", summary.KineticEnergy.Min,
+    summary.KineticEnergy.Mean, summary.KineticEnergy.Max);
+  printf("mean height:    min %.3f  mean %.3f  max %.3f m\n", summary.MeanHeight.Min,
+    summary.MeanHeight.Mean, summary.MeanHeight.Max);
+  printf("awake:          min %.0f  mean %.1f  max %.0f\n", summary.Awake.Min,
+    summary.Awake.Mean, summary.Awake.Max);
+}
+
+int main(int argc, char **argv)
+{
+  HeadlessOptions options;
+  options.Balls = 1000;
+  options.Steps = 1000;
+  options.Dt = 0.01;
+  options.Seed = 1;
+  options.Threads = 1;
+  options.Scaling = false;
+  options.BallCollisions = true;
+  options.Sleeping = true;
+  options.ContinuousCollisions = true;
+  options.Load = nullptr;
+  options.Save = nullptr;
+  options.Record = nullptr;
+  options.RecordEvery = 1;
+  options.HashLog = nullptr;
+  options.Verify = nullptr;
+  options.Trace = nullptr;
+  options.Worlds = 1;
+  options.SweepRestitution = false;
+  options.RestitutionMin = 0.0;
+  options.RestitutionMax = 0.0;
+  options.Render = nullptr;
+  options.RenderPipe = nullptr;
+  options.RenderFrom = nullptr;
+  options.RenderEvery = 1;
+  options.RenderWidth = 1280;
+  options.RenderHeight = 720;
+  options.FramesInFlight = 0;
+
+  if(!ParseOptions(argc, argv, options))
+  {
+    PrintUsage();
+    return 1;
+  }
+
+  unsigned int threads = options.Threads;
+  if(threads == 0)
+  {
+    threads = ThreadPool().GetThreadCount();
+  }
+
+  // Frames of an earlier run, nothing is stepped.
+  if(options.RenderFrom)
+  {
+    return RenderTrajectory(options, threads) ? 0 : 1;
+  }
+
+  // A sweep or a batch of seeds, rather than one world.
+  if(options.Worlds > 1 || options.SweepRestitution)
+  {
+    RunBatch(options, threads);
+    return 0;
+  }
+
+  if(options.Scaling)
+  {
+    // One line per thread count, the checksum should never change.
+    printf("threads  wall time  steps/sec  balls/sec    speedup  checksum\n");
+
+    double baseline = 0.0;
+    for(unsigned int t = 1; t <= threads; ++t)
+    {
+      unsigned int balls;
+      unsigned long long checksum;
+      TimingStats stepTimes(options.Steps);
+      double seconds = RunScene(options, t, balls, checksum, stepTimes);
+      if(seconds < 0.0) return 1;
+      if(t == 1) baseline = seconds;
+
+      printf("%7u  %8.3fs  %9.1f  %9.0f  %8.2fx  %016llx\n", t, seconds,
+        options.Steps / seconds, options.Steps * (double)balls / seconds,
+        baseline / seconds, checksum);
+    }
+
+    return 0;
+  }
+
+  unsigned int balls;
+  unsigned long long checksum;
+  TimingStats stepTimes(options.Steps);
+  double seconds = RunScene(options, threads, balls, checksum, stepTimes);
+  if(seconds < 0.0)
+  {
+    return 1;
+  }
+
+  printf("balls:          %u\n", balls);
+  printf("threads:        %u\n", threads);
+  printf("steps:          %u\n", options.Steps);
+  printf("simulated time: %.3f s\n", options.Steps * options.Dt);
+  printf("wall time:      %.3f s\n", seconds);
+  if(seconds > 0.0)
+  {
+    printf("steps/sec:      %.1f\n", options.Steps / seconds);
+    printf("balls/sec:      %.0f\n", options.Steps * (double)balls / seconds);
+  }
+  printf("step time:      min %.3f  avg %.3f  p99 %.3f  max %.3f ms (%s clock)\n",
+    stepTimes.GetMin() * 1000.0, stepTimes.GetAverage() * 1000.0,
+    stepTimes.GetPercentile(99) * 1000.0, stepTimes.GetMax() * 1000.0,
+    GameTimer::IsUsingTsc() ? "tsc" : "steady");
+  printf("checksum:       %016llx\n", checksum);
+
+  return 0;
+}
@@ -0,0 +1,334 @@
+#include "Integrator.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define INTEGRATOR_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// Functions using AVX2 need to be flagged as such on gcc and clang,
+// msvc allows the intrinsics anywhere.
+#if defined(INTEGRATOR_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+// Raw pointers into the ball store, vectors are stored as (X, Y) pairs.
+struct IntegratorArrays
+{
+  double *Position;
+  double *Velocity;
+  double *Acceleration;
+  double *ForceAccumulator;
+  const double *InverseMass;
+  double *AngularVelocity;
+  const double *AngularAcceleration;
+  double *Orientation;
+};
+
+// The arrays of vectors are walked as plain arrays of doubles.
+static_assert(sizeof(Vector2D) == sizeof(double) * 2, "Vector2D must be two packed doubles");
+
+typedef void (*IntegrateFunc)(const IntegratorArrays &, unsigned int, unsigned int,
+                              const Vector2D &, double);
+
+
+// ---------- SCALAR ------------ //
+
+static void IntegrateScalar(const IntegratorArrays &a, unsigned int begin,
+                            unsigned int end, const Vector2D &gravity, double dt)
+{
+  double dtSquared = dt * dt;
+
+  for(unsigned int i = begin; i < end; ++i)
+  {
+    double *pos = a.Position + i * 2;
+    double *vel = a.Velocity + i * 2;
+    double *acc = a.Acceleration + i * 2;
+    double *force = a.ForceAccumulator + i * 2;
+
+    // Resulting acceleration, gravity is the same for every ball.
+    acc[0] = force[0] * a.InverseMass[i] + gravity.X;
+    acc[1] = force[1] * a.InverseMass[i] + gravity.Y;
+    force[0] = 0.0;
+    force[1] = 0.0;
+
+    // Integrate the position over time based on velocity
+    pos[0] = (acc[0] * dtSquared) * 0.5 + vel[0] * dt + pos[0];
+    pos[1] = (acc[1] * dtSquared) * 0.5 + vel[1] * dt + pos[1];
+
+    // Integrate the balls velocity over time
+    vel[0] = acc[0] * dt + vel[0];
+    vel[1] = acc[1] * dt + vel[1];
+
+    a.AngularVelocity[i] = a.AngularAcceleration[i] * dt + a.AngularVelocity[i];
+
+    a.Orientation[i] = (a.AngularAcceleration[i] * dtSquared) * 0.5 +
+      a.AngularVelocity[i] * dt + a.Orientation[i];
+  }
+}
+
+#ifdef INTEGRATOR_X86
+
+// ---------- SSE2 ------------ //
+// One ball per register for the linear state, two for the angular state.
+
+static void IntegrateSSE2(const IntegratorArrays &a, unsigned int begin,
+                          unsigned int end, const Vector2D &gravity, double dt)
+{
+  const __m128d dtv = _mm_set1_pd(dt);
+  const __m128d dtSquared = _mm_set1_pd(dt * dt);
+  const __m128d half = _mm_set1_pd(0.5);
+  const __m128d zero = _mm_setzero_pd();
+  const __m128d grav = _mm_set_pd(gravity.Y, gravity.X);
+
+  unsigned int i = begin;
+  for(; i + 2 <= end; i += 2)
+  {
+    for(unsigned int k = i; k < i + 2; ++k)
+    {
+      __m128d force = _mm_loadu_pd(a.ForceAccumulator + k * 2);
+      __m128d acc = _mm_add_pd(_mm_mul_pd(force, _mm_set1_pd(a.InverseMass[k])), grav);
+      __m128d vel = _mm_loadu_pd(a.Velocity + k * 2);
+      __m128d pos = _mm_loadu_pd(a.Position + k * 2);
+
+      pos = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_mul_pd(acc, dtSquared), half),
+        _mm_mul_pd(vel, dtv)), pos);
+      vel = _mm_add_pd(_mm_mul_pd(acc, dtv), vel);
+
+      _mm_storeu_pd(a.Acceleration + k * 2, acc);
+      _mm_storeu_pd(a.ForceAccumulator + k * 2, zero);
+      _mm_storeu_pd(a.Velocity + k * 2, vel);
+      _mm_storeu_pd(a.Position + k * 2, pos);
+    }
+
+    __m128d angAcc = _mm_loadu_pd(a.AngularAcceleration + i);
+    __m128d angVel = _mm_add_pd(_mm_mul_pd(angAcc, dtv), _mm_loadu_pd(a.AngularVelocity + i));
+    __m128d orient = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_mul_pd(angAcc, dtSquared), half),
+      _mm_mul_pd(angVel, dtv)), _mm_loadu_pd(a.Orientation + i));
+
+    _mm_storeu_pd(a.AngularVelocity + i, angVel);
+    _mm_storeu_pd(a.Orientation + i, orient);
+  }
+
+  IntegrateScalar(a, i, end, gravity, dt);
+}
+
+// ---------- AVX2 ------------ //
+// Two balls per register for the linear state, four for the angular state.
+
+TARGET_AVX2
+static void IntegrateAVX2(const IntegratorArrays &a, unsigned int begin,
+                          unsigned int end, const Vector2D &gravity, double dt)
+{
+  const __m256d dtv = _mm256_set1_pd(dt);
+  const __m256d dtSquared = _mm256_set1_pd(dt * dt);
+  const __m256d half = _mm256_set1_pd(0.5);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d grav = _mm256_set_pd(gravity.Y, gravity.X, gravity.Y, gravity.X);
+
+  unsigned int i = begin;
+  for(; i + 4 <= end; i += 4)
+  {
+    // Spread the inverse masses of four balls over two (X, Y) pairs each.
+    __m256d invMass = _mm256_loadu_pd(a.InverseMass + i);
+    __m256d invMassLo = _mm256_permute4x64_pd(invMass, 0x50);
+    __m256d invMassHi = _mm256_permute4x64_pd(invMass, 0xFA);
+
+    for(unsigned int k = 0; k < 2; ++k)
+    {
+      unsigned int offset = (i + k * 2) * 2;
+      __m256d im = k == 0 ? invMassLo : invMassHi;
+
+      __m256d force = _mm256_loadu_pd(a.ForceAccumulator + offset);
+      __m256d acc = _mm256_add_pd(_mm256_mul_pd(force, im), grav);
+      __m256d vel = _mm256_loadu_pd(a.Velocity + offset);
+      __m256d pos = _mm256_loadu_pd(a.Position + offset);
+
+      pos = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(acc, dtSquared), half),
+        _mm256_mul_pd(vel, dtv)), pos);
+      vel = _mm256_add_pd(_mm256_mul_pd(acc, dtv), vel);
+
+      _mm256_storeu_pd(a.Acceleration + offset, acc);
+      _mm256_storeu_pd(a.ForceAccumulator + offset, zero);
+      _mm256_storeu_pd(a.Velocity + offset, vel);
+      _mm256_storeu_pd(a.Position + offset, pos);
+    }
+
+    __m256d angAcc = _mm256_loadu_pd(a.AngularAcceleration + i);
+    __m256d angVel = _mm256_add_pd(_mm256_mul_pd(angAcc, dtv),
+      _mm256_loadu_pd(a.AngularVelocity + i));
+    __m256d orient = _mm256_add_pd(_mm256_add_pd(
+      _mm256_mul_pd(_mm256_mul_pd(angAcc, dtSquared), half),
+      _mm256_mul_pd(angVel, dtv)), _mm256_loadu_pd(a.Orientation + i));
+
+    _mm256_storeu_pd(a.AngularVelocity + i, angVel);
+    _mm256_storeu_pd(a.Orientation + i, orient);
+  }
+
+  IntegrateScalar(a, i, end, gravity, dt);
+}
+
+// ---------- CPU DETECTION ------------ //
+
+#if defined(_MSC_VER)
+
+static bool CpuHasSSE2()
+{
+  int info[4];
+  __cpuid(info, 1);
+  return (info[3] & (1 << 26)) != 0;
+}
+
+static bool CpuHasAVX2()
+{
+  int info[4];
+  __cpuid(info, 0);
+  if(info[0] < 7)
+  {
+    return false;
+  }
+
+  // The OS must also save the upper halves of the ymm registers.
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  if(!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+  {
+    return false;
+  }
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+}
+
+#else
+
+// The feature flags may be asked for before gcc has run its own startup
+// code, so make sure they have been filled in first.
+static bool CpuHasSSE2()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse2") != 0;
+}
+
+static bool CpuHasAVX2()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+}
+
+#endif
+
+#endif // INTEGRATOR_X86
+
+
+static bool DetectIsa(IntegratorIsa isa)
+{
+  switch(isa)
+  {
+  case IsaScalar:
+    return true;
+#ifdef INTEGRATOR_X86
+  case IsaSSE2:
+    return CpuHasSSE2();
+  case IsaAVX2:
+    return CpuHasAVX2();
+#endif
+  default:
+    return false;
+  }
+}
+
+// Asking the CPU is slow, so it is only done once at startup.
+static const bool isaSupported[IsaCount] =
+{
+  DetectIsa(IsaScalar),
+  DetectIsa(IsaSSE2),
+  DetectIsa(IsaAVX2)
+};
+
+bool IsIntegratorIsaSupported(IntegratorIsa isa)
+{
+  return isa >= IsaScalar && isa < IsaCount && isaSupported[isa];
+}
+
+static IntegratorIsa BestSupportedIsa()
+{
+  if(IsIntegratorIsaSupported(IsaAVX2)) return IsaAVX2;
+  if(IsIntegratorIsaSupported(IsaSSE2)) return IsaSSE2;
+  return IsaScalar;
+}
+
+// Picked once at startup.
+static IntegratorIsa currentIsa = BestSupportedIsa();
+
+IntegratorIsa GetIntegratorIsa()
+{
+  return currentIsa;
+}
+
+bool SetIntegratorIsa(IntegratorIsa isa)
+{
+  if(!IsIntegratorIsaSupported(isa))
+  {
+    return false;
+  }
+
+  currentIsa = isa;
+  return true;
+}
+
+const char *GetIntegratorIsaName(IntegratorIsa isa)
+{
+  switch(isa)
+  {
+  case IsaScalar: return "scalar";
+  case IsaSSE2: return "sse2";
+  case IsaAVX2: return "avx2";
+  default: return "unknown";
+  }
+}
+
+void IntegrateBalls(BallStore &balls, unsigned int begin, unsigned int end,
+                    const Vector2D &gravity, double dt)
+{
+  IntegrateBalls(currentIsa, balls, begin, end, gravity, dt);
+}
+
+void IntegrateBalls(IntegratorIsa isa, BallStore &balls, unsigned int begin,
+                    unsigned int end, const Vector2D &gravity, double dt)
+{
+  if(begin >= end)
+  {
+    return;
+  }
+
+  IntegratorArrays arrays;
+  arrays.Position = &balls.Position[0].X;
+  arrays.Velocity = &balls.Velocity[0].X;
+  arrays.Acceleration = &balls.Acceleration[0].X;
+  arrays.ForceAccumulator = &balls.ForceAccumulator[0].X;
+  arrays.InverseMass = &balls.InverseMass[0];
+  arrays.AngularVelocity = &balls.AngularVelocity[0];
+  arrays.AngularAcceleration = &balls.AngularAcceleration[0];
+  arrays.Orientation = &balls.Orientation[0];
+
+  IntegrateFunc func = IntegrateScalar;
+#ifdef INTEGRATOR_X86
+  if(isa == IsaAVX2 && IsIntegratorIsaSupported(IsaAVX2))
+  {
+    func = IntegrateAVX2;
+  }
+  else if(isa == IsaSSE2 && IsIntegratorIsaSupported(IsaSSE2))
+  {
+    func = IntegrateSSE2;
+  }
+#endif
+
+  func(arrays, begin, end, gravity, dt);
+}
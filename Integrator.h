@@ -0,0 +1,50 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "Vector2D.h"
+#include "BallStore.h"
+
+/* Batch integrator advancing many balls at once.
+ * There is one implementation per instruction set and the best one the
+ * CPU supports is picked the first time the integrator is used.
+ *
+ * Every implementation performs the same operations in the same order
+ * without fused multiply-adds, so they all agree with the scalar path.
+ * The documented tolerance is a relative error of 1e-12 per step on every
+ * integrated value, to leave room for compilers that contract the scalar
+ * path; with the default settings the results are bit for bit identical. */
+
+// Instruction sets the integrator has been written for.
+enum IntegratorIsa
+{
+  IsaScalar,
+  IsaSSE2,
+  IsaAVX2,
+  IsaCount
+};
+
+// Returns true if the CPU we are running on supports the instruction set.
+bool IsIntegratorIsaSupported(IntegratorIsa isa);
+
+// Returns the instruction set currently used by IntegrateBalls.
+IntegratorIsa GetIntegratorIsa();
+
+/* Forces IntegrateBalls to use a particular instruction set.
+ * Returns false and leaves the current one in place if it is unsupported. */
+bool SetIntegratorIsa(IntegratorIsa isa);
+
+// Returns a printable name of an instruction set.
+const char *GetIntegratorIsaName(IntegratorIsa isa);
+
+/* Integrates the balls in [begin, end) over dt.
+ * The accumulated force of each ball is turned into acceleration, the
+ * constant gravity acceleration is added on top of it, and the
+ * accumulator is cleared. */
+void IntegrateBalls(BallStore &balls, unsigned int begin, unsigned int end,
+                    const Vector2D &gravity, double dt);
+
+// Same as above, but with an explicitly chosen instruction set.
+void IntegrateBalls(IntegratorIsa isa, BallStore &balls, unsigned int begin,
+                    unsigned int end, const Vector2D &gravity, double dt);
+
+#endif
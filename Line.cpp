@@ -0,0 +1,57 @@
+#include "Line.h"
+#include "Snapshot.h"
+
+Line::Line(unsigned int color)
+{
+  this->color = color;
+  version = 0;
+  restitution = 1.0;
+  frictionCoeff = 1.0;
+}
+
+Line::Line(const Vector2D &from, const Vector2D &to, unsigned int color)
+{
+  this->color = color;
+  version = 0;
+  start = from;
+  end = to;
+  frictionCoeff = 1.0;
+  restitution = 1.0;
+}
+
+Line::Line(const Vector2D &from, const Vector2D &to, double res, double fri, unsigned int color)
+{
+  this->color = color;
+  version = 0;
+  start = from;
+  end = to;
+  restitution = res;
+  frictionCoeff = fri;
+}
+
+Line::~Line()
+{
+
+}
+
+void Line::Save(SnapshotWriter &writer) const
+{
+  writer.Write(start);
+  writer.Write(end);
+  writer.Write(restitution);
+  writer.Write(frictionCoeff);
+  writer.Write(color);
+}
+
+bool Line::Load(SnapshotReader &reader)
+{
+  reader.Read(start);
+  reader.Read(end);
+  reader.Read(restitution);
+  reader.Read(frictionCoeff);
+  reader.Read(color);
+
+  // Whoever holds on to the old geometry has to notice the new one.
+  version++;
+  return reader.IsValid();
+}
@@ -1,95 +1,71 @@
 #ifndef LINE_H
 #define LINE_H
 
-#include <gdiplus.h>
+#include <cstddef>
 #include "Vector2D.h"
-#include "Window.h"
 
-using namespace Gdiplus;
+class SnapshotWriter;
+class SnapshotReader;
 
-extern Gdiplus::Point TransformToWindow(const Vector2D&);
+// Colors are stored as 0xAARRGGBB, the same layout GDI+ uses.
+const unsigned int DefaultLineColor = 0xFFFFFFFF;
 
 class Line
 {
 public:
   // Constructor
-  Line(Window *window, Color &color = Color(255, 255, 255));
-  Line(Window *window, const Vector2D &from, const Vector2D &to, Color &color = Color(255, 255, 255));
-  Line(Window *window, const Vector2D &from, const Vector2D &to,
+  Line(unsigned int color = DefaultLineColor);
+  Line(const Vector2D &from, const Vector2D &to, unsigned int color = DefaultLineColor);
+  Line(const Vector2D &from, const Vector2D &to,
     double restitution, double frictionCoeff,
-    Color &color = Color(255, 255, 255));
+    unsigned int color = DefaultLineColor);
 
   // Destructor
   ~Line();
 
-  void Draw(Graphics *g) const;
-
   // Accessors
   const Vector2D& GetStart() const;
   const Vector2D& GetEnd() const;
   const float GetFrictionCoeff() const;
   const float GetRestitution() const;
-  const Pen& GetPen() const;
+  unsigned int GetColor() const;
+
+  // Changes every time the line is moved or its material is changed,
+  // so owners can tell when to update.
+  unsigned int GetVersion() const;
 
   void SetStart(const Vector2D &start);
   void SetEnd(const Vector2D &end);
   void SetFrictionCoeff(float f);
   void SetRestitution(float r);
-  void SetColor(const Color &color);
+  void SetColor(unsigned int color);
+
+  // Writes the geometry, material and color of the line, or reads them back.
+  void Save(SnapshotWriter &writer) const;
+  bool Load(SnapshotReader &reader);
+
+  // Bytes a line takes up in a snapshot.
+  static const size_t SnapshotSize = 2 * sizeof(Vector2D) + 2 * sizeof(double) + sizeof(unsigned int);
 
 private:
   Vector2D start, end;
   double frictionCoeff, restitution;
-  Pen pen;
-  Window *window;
+  unsigned int color;
+  unsigned int version;
 };
 
-Line::Line(Window *window, Color &color)
-  :pen(color)
-{
-  this->window = window;
-  restitution = 1.0;
-  frictionCoeff = 1.0;
-}
-
-Line::Line(Window *window, const Vector2D &from, const Vector2D &to, Color &color)
-  :pen(color)
-{
-  this->window = window;
-  start = from;
-  end = to;
-  frictionCoeff = 1.0;
-  restitution = 1.0;
-}
-
-Line::Line(Window *window, const Vector2D &from, const Vector2D &to, double res, double fri, Color &color)
-  :pen(color)
-{
-  this->window = window;
-  start = from;
-  end = to;
-  restitution = res;
-  frictionCoeff = fri;
-}
-
-void Line::Draw(Graphics *g) const
-{
-  g->DrawLine(&pen,
-    window->TransformToWindow(start),
-    window->TransformToWindow(end));
-}
-
 // Inlined accessors
 inline const Vector2D& Line::GetStart() const { return start; }
 inline const Vector2D& Line::GetEnd() const { return end; }
 inline const float Line::GetFrictionCoeff() const { return frictionCoeff; }
 inline const float Line::GetRestitution() const { return restitution; }
-inline const Pen& Line::GetPen() const { return pen; }
+inline unsigned int Line::GetColor() const { return color; }
+inline unsigned int Line::GetVersion() const { return version; }
 
-inline void Line::SetStart(const Vector2D &start) { this->start = start; }
-inline void Line::SetEnd(const Vector2D &end) { this->end = end; }
-inline void Line::SetFrictionCoeff(float f) { frictionCoeff = f; }
-inline void Line::SetRestitution(float r) { restitution = r; }
-inline void Line::SetColor(const Color &color) { pen.SetColor(color); }
+inline void Line::SetStart(const Vector2D &start) { this->start = start; version++; }
+inline void Line::SetEnd(const Vector2D &end) { this->end = end; version++; }
+inline void Line::SetFrictionCoeff(float f) { frictionCoeff = f; version++; }
+inline void Line::SetRestitution(float r) { restitution = r; version++; }
+inline void Line::SetColor(unsigned int color) { this->color = color; }
 
-#endif
\ No newline at end of file
+#endif
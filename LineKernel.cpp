@@ -0,0 +1,162 @@
+#include "LineKernel.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define LINEKERNEL_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// Same as in the integrator, AVX2 functions need flagging on gcc and clang.
+#if defined(LINEKERNEL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+// Empty lanes start here, their squared distance to any ball is huge but finite.
+const double FarAway = 1e100;
+
+void PackedLines::Resize(unsigned int blocks)
+{
+  unsigned int lanes = blocks * LineLanes;
+
+  StartX.assign(lanes, FarAway);
+  StartY.assign(lanes, FarAway);
+  DirectionX.assign(lanes, 0.0);
+  DirectionY.assign(lanes, 0.0);
+  InverseLengthSq.assign(lanes, 0.0);
+  NormalX.assign(lanes, 0.0);
+  NormalY.assign(lanes, 0.0);
+  Restitution.assign(lanes, 0.0);
+  Friction.assign(lanes, 0.0);
+  Index.assign(lanes, NoLine);
+}
+
+void PackedLines::Pack(unsigned int lane, const Line &line, unsigned int index)
+{
+  Vector2D direction = line.GetEnd() - line.GetStart();
+  double lengthSq = direction.LengthSquared();
+
+  // A point has no direction to be perpendicular to, it pushes straight up.
+  Vector2D normal = lengthSq > 0.0 ? direction.Perpendicular().Unit() : Vector2D(0, 1);
+
+  StartX[lane] = line.GetStart().X;
+  StartY[lane] = line.GetStart().Y;
+  DirectionX[lane] = direction.X;
+  DirectionY[lane] = direction.Y;
+  InverseLengthSq[lane] = lengthSq > 0.0 ? 1.0 / lengthSq : 0.0;
+  NormalX[lane] = normal.X;
+  NormalY[lane] = normal.Y;
+  Restitution[lane] = line.GetRestitution();
+  Friction[lane] = line.GetFrictionCoeff();
+  Index[lane] = index;
+}
+
+
+// ---------- SCALAR ------------ //
+
+static unsigned int TouchBlockScalar(const PackedLines &lines, unsigned int block,
+                                     const Vector2D &center, double radiusSq)
+{
+  unsigned int mask = 0;
+
+  for(unsigned int k = 0; k < LineLanes; ++k)
+  {
+    Vector2D offset = OffsetFromLine(lines, block * LineLanes + k, center);
+    if(offset.X * offset.X + offset.Y * offset.Y < radiusSq)
+    {
+      mask |= 1u << k;
+    }
+  }
+
+  return mask;
+}
+
+#ifdef LINEKERNEL_X86
+
+// ---------- SSE2 ------------ //
+// Two lines per register, the block in two halves.
+
+static unsigned int TouchBlockSSE2(const PackedLines &lines, unsigned int block,
+                                   const Vector2D &center, double radiusSq)
+{
+  const __m128d x = _mm_set1_pd(center.X);
+  const __m128d y = _mm_set1_pd(center.Y);
+  const __m128d rsq = _mm_set1_pd(radiusSq);
+  const __m128d zero = _mm_setzero_pd();
+  const __m128d one = _mm_set1_pd(1.0);
+
+  unsigned int mask = 0;
+
+  for(unsigned int k = 0; k < LineLanes; k += 2)
+  {
+    unsigned int lane = block * LineLanes + k;
+    __m128d dirX = _mm_loadu_pd(&lines.DirectionX[lane]);
+    __m128d dirY = _mm_loadu_pd(&lines.DirectionY[lane]);
+    __m128d dx = _mm_sub_pd(x, _mm_loadu_pd(&lines.StartX[lane]));
+    __m128d dy = _mm_sub_pd(y, _mm_loadu_pd(&lines.StartY[lane]));
+
+    __m128d t = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(dx, dirX), _mm_mul_pd(dy, dirY)),
+      _mm_loadu_pd(&lines.InverseLengthSq[lane]));
+    t = _mm_min_pd(_mm_max_pd(t, zero), one);
+
+    __m128d ox = _mm_sub_pd(dx, _mm_mul_pd(dirX, t));
+    __m128d oy = _mm_sub_pd(dy, _mm_mul_pd(dirY, t));
+    __m128d distanceSq = _mm_add_pd(_mm_mul_pd(ox, ox), _mm_mul_pd(oy, oy));
+
+    mask |= static_cast<unsigned int>(_mm_movemask_pd(_mm_cmplt_pd(distanceSq, rsq))) << k;
+  }
+
+  return mask;
+}
+
+// ---------- AVX2 ------------ //
+// The whole block in one register.
+
+TARGET_AVX2
+static unsigned int TouchBlockAVX2(const PackedLines &lines, unsigned int block,
+                                   const Vector2D &center, double radiusSq)
+{
+  unsigned int lane = block * LineLanes;
+  __m256d dirX = _mm256_loadu_pd(&lines.DirectionX[lane]);
+  __m256d dirY = _mm256_loadu_pd(&lines.DirectionY[lane]);
+  __m256d dx = _mm256_sub_pd(_mm256_set1_pd(center.X), _mm256_loadu_pd(&lines.StartX[lane]));
+  __m256d dy = _mm256_sub_pd(_mm256_set1_pd(center.Y), _mm256_loadu_pd(&lines.StartY[lane]));
+
+  __m256d t = _mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(dx, dirX), _mm256_mul_pd(dy, dirY)),
+    _mm256_loadu_pd(&lines.InverseLengthSq[lane]));
+  t = _mm256_min_pd(_mm256_max_pd(t, _mm256_setzero_pd()), _mm256_set1_pd(1.0));
+
+  __m256d ox = _mm256_sub_pd(dx, _mm256_mul_pd(dirX, t));
+  __m256d oy = _mm256_sub_pd(dy, _mm256_mul_pd(dirY, t));
+  __m256d distanceSq = _mm256_add_pd(_mm256_mul_pd(ox, ox), _mm256_mul_pd(oy, oy));
+
+  return static_cast<unsigned int>(_mm256_movemask_pd(
+    _mm256_cmp_pd(distanceSq, _mm256_set1_pd(radiusSq), _CMP_LT_OQ)));
+}
+
+#endif // LINEKERNEL_X86
+
+// The blocks are laid out for these.
+static_assert(LineLanes == 4, "The kernels test four lines at a time");
+
+LineKernel GetLineKernel()
+{
+  return GetLineKernel(GetIntegratorIsa());
+}
+
+LineKernel GetLineKernel(IntegratorIsa isa)
+{
+#ifdef LINEKERNEL_X86
+  if(isa == IsaAVX2 && IsIntegratorIsaSupported(IsaAVX2))
+  {
+    return TouchBlockAVX2;
+  }
+  else if(isa == IsaSSE2 && IsIntegratorIsaSupported(IsaSSE2))
+  {
+    return TouchBlockSSE2;
+  }
+#endif
+
+  return TouchBlockScalar;
+}
@@ -0,0 +1,78 @@
+#ifndef LINEKERNEL_H
+#define LINEKERNEL_H
+
+#include <vector>
+#include "Vector2D.h"
+#include "Line.h"
+#include "Integrator.h"
+
+// Lines are tested against a ball in blocks of this many.
+const unsigned int LineLanes = 4;
+
+// Index of a lane that holds no line.
+const unsigned int NoLine = ~0u;
+
+/* The line data collision tests need, worked out once when a line is
+ * added or moved and stored one array per value. Lines come in blocks of
+ * LineLanes; lanes without a line sit far away from anything and never
+ * touch a ball. Colors and other drawing data stay in Line. */
+struct PackedLines
+{
+  // Makes room for a number of blocks, with every lane empty.
+  void Resize(unsigned int blocks);
+
+  // Fills a lane from a line.
+  void Pack(unsigned int lane, const Line &line, unsigned int index);
+
+  unsigned int GetBlockCount() const;
+
+  std::vector<double> StartX, StartY;
+
+  // From start to end, and one over its length squared (zero for points).
+  std::vector<double> DirectionX, DirectionY;
+  std::vector<double> InverseLengthSq;
+
+  // Unit normal, balls right on the line are pushed out along it.
+  std::vector<double> NormalX, NormalY;
+
+  std::vector<double> Restitution;
+  std::vector<double> Friction;
+
+  // Index of the line in each lane, NoLine for empty lanes.
+  std::vector<unsigned int> Index;
+};
+
+/* Tests one ball against the lines of one block. Returns a mask with bit
+ * k set if the ball overlaps the line in lane k of the block. */
+typedef unsigned int (*LineKernel)(const PackedLines &lines, unsigned int block,
+                                   const Vector2D &center, double radiusSq);
+
+/* Returns the kernel for an instruction set, or for the one the integrator
+ * uses. They all do the same math in the same order and agree bit for bit. */
+LineKernel GetLineKernel();
+LineKernel GetLineKernel(IntegratorIsa isa);
+
+/* Returns the offset from the closest point of the line in a lane to
+ * center, the way the kernels work it out. */
+Vector2D OffsetFromLine(const PackedLines &lines, unsigned int lane, const Vector2D &center);
+
+// Inlined accessors
+inline unsigned int PackedLines::GetBlockCount() const
+{
+  return static_cast<unsigned int>(Index.size() / LineLanes);
+}
+
+inline Vector2D OffsetFromLine(const PackedLines &lines, unsigned int lane, const Vector2D &center)
+{
+  double dx = center.X - lines.StartX[lane];
+  double dy = center.Y - lines.StartY[lane];
+
+  // How far along the line the point lands, clamped to the segment.
+  double t = (dx * lines.DirectionX[lane] + dy * lines.DirectionY[lane]) * lines.InverseLengthSq[lane];
+  t = t > 0.0 ? t : 0.0;
+  t = t < 1.0 ? t : 1.0;
+
+  return Vector2D(dx - lines.DirectionX[lane] * t, dy - lines.DirectionY[lane] * t);
+}
+
+#endif
@@ -0,0 +1,165 @@
+#include "LineTree.h"
+#include <algorithm>
+
+// Most lines a leaf will hold, a leaf is packed into one block.
+const unsigned int MaxLinesPerLeaf = LineLanes;
+
+// Orders lines by the center of their box along one axis.
+struct LineCenterLess
+{
+  const std::vector<Line> *Lines;
+  bool AlongX;
+
+  double Center(unsigned int index) const
+  {
+    const Line &line = (*Lines)[index];
+    return AlongX ? line.GetStart().X + line.GetEnd().X :
+      line.GetStart().Y + line.GetEnd().Y;
+  }
+
+  bool operator()(unsigned int a, unsigned int b) const
+  {
+    return Center(a) < Center(b);
+  }
+};
+
+LineTree::LineTree()
+{
+
+}
+
+LineTree::~LineTree()
+{
+
+}
+
+void LineTree::Build(const std::vector<Line> &lines)
+{
+  nodes.clear();
+  lineOrder.resize(lines.size());
+  leafOfLine.resize(lines.size());
+
+  for(unsigned int i = 0; i < lines.size(); ++i)
+  {
+    lineOrder[i] = i;
+  }
+
+  if(!lines.empty())
+  {
+    // A tree with n leaves has 2n - 1 nodes.
+    nodes.reserve(2 * (lines.size() / MaxLinesPerLeaf + 1));
+    BuildNode(lines, 0, static_cast<unsigned int>(lines.size()), -1);
+  }
+
+  // Pack the leaves in the order they were built, one block each.
+  unsigned int blocks = 0;
+  for(Node &node : nodes)
+  {
+    if(node.Count > 0)
+    {
+      node.Block = blocks++;
+    }
+  }
+
+  packed.Resize(blocks);
+  laneOfLine.resize(lines.size());
+
+  for(const Node &node : nodes)
+  {
+    for(unsigned int k = 0; k < node.Count; ++k)
+    {
+      unsigned int lineIndex = lineOrder[node.First + k];
+      laneOfLine[lineIndex] = node.Block * LineLanes + k;
+      packed.Pack(laneOfLine[lineIndex], lines[lineIndex], lineIndex);
+    }
+  }
+}
+
+int LineTree::BuildNode(const std::vector<Line> &lines, unsigned int first,
+                        unsigned int count, int parent)
+{
+  int index = static_cast<int>(nodes.size());
+  nodes.push_back(Node());
+
+  Node node;
+  node.Parent = parent;
+  node.Left = -1;
+  node.Right = -1;
+  node.First = first;
+  node.Count = count;
+  node.Block = 0;
+  FitLeaf(lines, node);
+
+  if(count <= MaxLinesPerLeaf)
+  {
+    for(unsigned int i = first; i < first + count; ++i)
+    {
+      leafOfLine[lineOrder[i]] = index;
+    }
+
+    nodes[index] = node;
+    return index;
+  }
+
+  // Split at the median along the longest side of the box.
+  LineCenterLess less;
+  less.Lines = &lines;
+  less.AlongX = node.Max.X - node.Min.X >= node.Max.Y - node.Min.Y;
+
+  unsigned int half = count / 2;
+  std::nth_element(lineOrder.begin() + first, lineOrder.begin() + first + half,
+    lineOrder.begin() + first + count, less);
+
+  node.Count = 0;
+  node.Left = BuildNode(lines, first, half, index);
+  node.Right = BuildNode(lines, first + half, count - half, index);
+
+  nodes[index] = node;
+  return index;
+}
+
+void LineTree::FitLeaf(const std::vector<Line> &lines, Node &node)
+{
+  for(unsigned int i = node.First; i < node.First + node.Count; ++i)
+  {
+    const Line &line = lines[lineOrder[i]];
+    Vector2D lineMin(std::min(line.GetStart().X, line.GetEnd().X),
+                     std::min(line.GetStart().Y, line.GetEnd().Y));
+    Vector2D lineMax(std::max(line.GetStart().X, line.GetEnd().X),
+                     std::max(line.GetStart().Y, line.GetEnd().Y));
+
+    if(i == node.First)
+    {
+      node.Min = lineMin;
+      node.Max = lineMax;
+    }
+    else
+    {
+      node.Min = Vector2D(std::min(node.Min.X, lineMin.X), std::min(node.Min.Y, lineMin.Y));
+      node.Max = Vector2D(std::max(node.Max.X, lineMax.X), std::max(node.Max.Y, lineMax.Y));
+    }
+  }
+}
+
+void LineTree::Refit(const std::vector<Line> &lines, unsigned int lineIndex)
+{
+  if(lineIndex >= leafOfLine.size())
+  {
+    return;
+  }
+
+  int index = leafOfLine[lineIndex];
+  FitLeaf(lines, nodes[index]);
+  packed.Pack(laneOfLine[lineIndex], lines[lineIndex], lineIndex);
+
+  // Grow or shrink every box on the way up to the root.
+  for(index = nodes[index].Parent; index >= 0; index = nodes[index].Parent)
+  {
+    Node &node = nodes[index];
+    const Node &left = nodes[node.Left];
+    const Node &right = nodes[node.Right];
+
+    node.Min = Vector2D(std::min(left.Min.X, right.Min.X), std::min(left.Min.Y, right.Min.Y));
+    node.Max = Vector2D(std::max(left.Max.X, right.Max.X), std::max(left.Max.Y, right.Max.Y));
+  }
+}
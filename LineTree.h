@@ -0,0 +1,172 @@
+#ifndef LINETREE_H
+#define LINETREE_H
+
+#include <vector>
+#include "Vector2D.h"
+#include "Line.h"
+#include "LineKernel.h"
+
+/* Bounding box tree over static line segments.
+ * Built once for a set of lines, after which finding the lines near a
+ * ball only visits the branches whose boxes it overlaps. When a line is
+ * moved only its leaf and the boxes above it are refit; the shape of the
+ * tree is left as it is.
+ *
+ * Every leaf holds at most LineLanes lines, which the tree keeps packed
+ * as one block of PackedLines, so the lines of a leaf are tested against
+ * a ball in one go. */
+class LineTree
+{
+public:
+  // Constructor
+  LineTree();
+
+  // Destructor
+  ~LineTree();
+
+  // Builds the tree from scratch.
+  void Build(const std::vector<Line> &lines);
+
+  // Updates the boxes and the packed data after a line has been changed.
+  void Refit(const std::vector<Line> &lines, unsigned int lineIndex);
+
+  /* Calls func with the index of every line whose box overlaps [min, max].
+   * Lines share a leaf, so a few lines close to the box may come out too. */
+  template<typename Func>
+  void Query(const Vector2D &min, const Vector2D &max, Func func) const;
+
+  /* Calls func with the block of every leaf whose box overlaps [min, max],
+   * for testing with a LineKernel. */
+  template<typename Func>
+  void QueryBlocks(const Vector2D &min, const Vector2D &max, Func func) const;
+
+  // Returns the box of the leaf holding a line, it contains the line.
+  void GetLeafBounds(unsigned int lineIndex, Vector2D &min, Vector2D &max) const;
+
+  // Returns the number of lines in the tree.
+  unsigned int GetLineCount() const;
+
+  // Returns the lines of every leaf, packed by block.
+  const PackedLines& GetPackedLines() const;
+
+private:
+  struct Node
+  {
+    Vector2D Min, Max;
+
+    // Children of an inner node.
+    int Left, Right;
+    int Parent;
+
+    // Lines of a leaf, Count is zero for inner nodes.
+    unsigned int First, Count;
+
+    // Where the lines of a leaf are packed.
+    unsigned int Block;
+  };
+
+  // Builds the subtree for lineOrder[first, first + count).
+  int BuildNode(const std::vector<Line> &lines, unsigned int first,
+                unsigned int count, int parent);
+
+  // Recalculates the box of a leaf from its lines.
+  void FitLeaf(const std::vector<Line> &lines, Node &node);
+
+  std::vector<Node> nodes;
+  std::vector<unsigned int> lineOrder;
+  std::vector<int> leafOfLine;
+
+  PackedLines packed;
+  std::vector<unsigned int> laneOfLine;
+};
+
+inline unsigned int LineTree::GetLineCount() const
+{
+  return static_cast<unsigned int>(lineOrder.size());
+}
+
+inline const PackedLines& LineTree::GetPackedLines() const
+{
+  return packed;
+}
+
+inline void LineTree::GetLeafBounds(unsigned int lineIndex, Vector2D &min, Vector2D &max) const
+{
+  const Node &node = nodes[leafOfLine[lineIndex]];
+  min = node.Min;
+  max = node.Max;
+}
+
+template<typename Func>
+void LineTree::Query(const Vector2D &min, const Vector2D &max, Func func) const
+{
+  if(nodes.empty())
+  {
+    return;
+  }
+
+  // The tree is split by count, so it is never deeper than this.
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+
+  while(top > 0)
+  {
+    const Node &node = nodes[stack[--top]];
+
+    if(node.Max.X < min.X || node.Min.X > max.X ||
+       node.Max.Y < min.Y || node.Min.Y > max.Y)
+    {
+      continue;
+    }
+
+    if(node.Count > 0)
+    {
+      for(unsigned int i = node.First; i < node.First + node.Count; ++i)
+      {
+        func(lineOrder[i]);
+      }
+    }
+    else
+    {
+      stack[top++] = node.Right;
+      stack[top++] = node.Left;
+    }
+  }
+}
+
+template<typename Func>
+void LineTree::QueryBlocks(const Vector2D &min, const Vector2D &max, Func func) const
+{
+  if(nodes.empty())
+  {
+    return;
+  }
+
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+
+  while(top > 0)
+  {
+    const Node &node = nodes[stack[--top]];
+
+    if(node.Max.X < min.X || node.Min.X > max.X ||
+       node.Max.Y < min.Y || node.Min.Y > max.Y)
+    {
+      continue;
+    }
+
+    if(node.Count > 0)
+    {
+      func(node.Block);
+    }
+    else
+    {
+      stack[top++] = node.Right;
+      stack[top++] = node.Left;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,448 @@
+#include "OffscreenRenderer.h"
+#include <algorithm>
+#include <cstring>
+
+// Before Visual Studio 2015 snprintf goes by another name.
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+
+// Background of every frame.
+static const unsigned int ClearColor = 0xff000000;
+
+/* PNG checks every chunk with a CRC-32, worked out a byte at a time from
+ * this table. */
+struct CrcTable
+{
+  unsigned int Values[256];
+};
+
+static CrcTable MakeCrcTable()
+{
+  CrcTable table;
+  for(unsigned int n = 0; n < 256; ++n)
+  {
+    unsigned int c = n;
+    for(unsigned int bit = 0; bit < 8; ++bit)
+    {
+      c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    }
+    table.Values[n] = c;
+  }
+  return table;
+}
+
+// Made once at startup, so frames can be encoded on any thread.
+static const CrcTable crcTable = MakeCrcTable();
+
+static unsigned int Crc(const unsigned char *data, size_t size)
+{
+  unsigned int c = 0xffffffffu;
+  for(size_t i = 0; i < size; ++i)
+  {
+    c = crcTable.Values[(c ^ data[i]) & 255] ^ (c >> 8);
+  }
+  return c ^ 0xffffffffu;
+}
+
+static void PutBigEndian(std::vector<unsigned char> &out, unsigned int value)
+{
+  out.push_back(static_cast<unsigned char>(value >> 24));
+  out.push_back(static_cast<unsigned char>(value >> 16));
+  out.push_back(static_cast<unsigned char>(value >> 8));
+  out.push_back(static_cast<unsigned char>(value));
+}
+
+// Appends the red, green and blue of every pixel of a row, dropping alpha.
+static void PutRow(std::vector<unsigned char> &out, const unsigned int *row, unsigned int width)
+{
+  for(unsigned int x = 0; x < width; ++x)
+  {
+    out.push_back(static_cast<unsigned char>(row[x] >> 16));
+    out.push_back(static_cast<unsigned char>(row[x] >> 8));
+    out.push_back(static_cast<unsigned char>(row[x]));
+  }
+}
+
+static void EncodeRaw(Framebuffer &image, std::vector<unsigned char> &out)
+{
+  out.clear();
+  for(unsigned int y = 0; y < image.GetHeight(); ++y)
+  {
+    PutRow(out, image.GetRow(y), image.GetWidth());
+  }
+}
+
+static void EncodePpm(Framebuffer &image, std::vector<unsigned char> &out)
+{
+  char header[32];
+  int length = sprintf(header, "P6\n%u %u\n255\n", image.GetWidth(), image.GetHeight());
+
+  out.assign(header, header + length);
+  for(unsigned int y = 0; y < image.GetHeight(); ++y)
+  {
+    PutRow(out, image.GetRow(y), image.GetWidth());
+  }
+}
+
+// Writes a chunk whose type and data were appended from start onwards.
+static void EndChunk(std::vector<unsigned char> &out, size_t start)
+{
+  unsigned int length = static_cast<unsigned int>(out.size() - start - 4);
+  unsigned char size[4] = { static_cast<unsigned char>(length >> 24),
+    static_cast<unsigned char>(length >> 16), static_cast<unsigned char>(length >> 8),
+    static_cast<unsigned char>(length) };
+
+  out.insert(out.begin() + start, size, size + 4);
+  PutBigEndian(out, Crc(&out[start + 4], out.size() - start - 4));
+}
+
+/* The image data goes into stored deflate blocks, which any reader
+ * takes. Files are about as big as a PPM but need no compression
+ * library; pipe frames to an encoder for small files. */
+static void EncodePng(Framebuffer &image, std::vector<unsigned char> &out)
+{
+  static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+  const unsigned int MaxBlock = 65535;
+
+  unsigned int width = image.GetWidth();
+  unsigned int height = image.GetHeight();
+  out.assign(signature, signature + 8);
+
+  // 8 bits per channel, RGB, no interlacing.
+  size_t start = out.size();
+  out.insert(out.end(), "IHDR", "IHDR" + 4);
+  PutBigEndian(out, width);
+  PutBigEndian(out, height);
+  const unsigned char format[5] = { 8, 2, 0, 0, 0 };
+  out.insert(out.end(), format, format + 5);
+  EndChunk(out, start);
+
+  // Every row starts with its filter, none.
+  std::vector<unsigned char> rows;
+  rows.reserve((width * 3 + 1) * height);
+  for(unsigned int y = 0; y < height; ++y)
+  {
+    rows.push_back(0);
+    PutRow(rows, image.GetRow(y), width);
+  }
+
+  start = out.size();
+  out.insert(out.end(), "IDAT", "IDAT" + 4);
+  out.push_back(0x78);
+  out.push_back(0x01);
+
+  unsigned int a = 1, b = 0;
+  for(size_t offset = 0; ; offset += MaxBlock)
+  {
+    unsigned int size = static_cast<unsigned int>(std::min<size_t>(MaxBlock, rows.size() - offset));
+    bool last = offset + size >= rows.size();
+
+    out.push_back(last ? 1 : 0);
+    out.push_back(static_cast<unsigned char>(size));
+    out.push_back(static_cast<unsigned char>(size >> 8));
+    out.push_back(static_cast<unsigned char>(~size));
+    out.push_back(static_cast<unsigned char>(~size >> 8));
+    out.insert(out.end(), rows.begin() + offset, rows.begin() + offset + size);
+
+    for(unsigned int i = 0; i < size; ++i)
+    {
+      a = (a + rows[offset + i]) % 65521;
+      b = (b + a) % 65521;
+    }
+
+    if(last)
+    {
+      break;
+    }
+  }
+
+  PutBigEndian(out, (b << 16) | a);
+  EndChunk(out, start);
+
+  start = out.size();
+  out.insert(out.end(), "IEND", "IEND" + 4);
+  EndChunk(out, start);
+}
+
+/* The frame number is put into the pattern with snprintf, so the pattern
+ * may hold exactly one unsigned or int conversion such as %06u, with
+ * flags and a width but nothing else, and %% for a percent sign. */
+static bool IsFramePattern(const char *pattern)
+{
+  unsigned int numbers = 0;
+  for(const char *c = pattern; *c != '\0'; ++c)
+  {
+    if(*c != '%')
+    {
+      continue;
+    }
+
+    ++c;
+    if(*c == '%')
+    {
+      continue;
+    }
+
+    while(*c != '\0' && strchr("-+ #0", *c) != nullptr)
+    {
+      ++c;
+    }
+    while(*c >= '0' && *c <= '9')
+    {
+      ++c;
+    }
+
+    if(*c != 'u' && *c != 'd' && *c != 'i')
+    {
+      return false;
+    }
+    numbers++;
+  }
+
+  return numbers == 1;
+}
+
+OffscreenRenderer::OffscreenRenderer(unsigned int width, unsigned int height, ThreadPool *pool,
+                                     unsigned int framesInFlight)
+{
+  this->width = width;
+  this->height = height;
+  this->pool = pool;
+
+  unsigned int threads = pool ? pool->GetThreadCount() : 1;
+  this->framesInFlight = framesInFlight > 0 ? framesInFlight : 2 * threads;
+
+  transform = Matrix3x3::Identity();
+  pending = 0;
+  format = FramePpm;
+  pipe = nullptr;
+  open = false;
+  failed = false;
+  framesWritten = 0;
+}
+
+OffscreenRenderer::~OffscreenRenderer()
+{
+  Close();
+
+  for(Slot *slot : slots)
+  {
+    delete slot;
+  }
+}
+
+void OffscreenRenderer::SetLines(const std::vector<Line> &lines)
+{
+  this->lines = lines;
+}
+
+void OffscreenRenderer::SetTransform(const Matrix3x3 &transform)
+{
+  this->transform = transform;
+}
+
+void OffscreenRenderer::FitToLines(unsigned int margin)
+{
+  if(lines.empty())
+  {
+    return;
+  }
+
+  double minX = lines[0].GetStart().X, maxX = minX;
+  double minY = lines[0].GetStart().Y, maxY = minY;
+  for(const Line &line : lines)
+  {
+    const Vector2D ends[2] = { line.GetStart(), line.GetEnd() };
+    for(const Vector2D &end : ends)
+    {
+      minX = std::min(minX, end.X);
+      maxX = std::max(maxX, end.X);
+      minY = std::min(minY, end.Y);
+      maxY = std::max(maxY, end.Y);
+    }
+  }
+
+  double scale = std::min(std::max(1.0, width - 2.0 * margin) / std::max(maxX - minX, 1e-6),
+    std::max(1.0, height - 2.0 * margin) / std::max(maxY - minY, 1e-6));
+
+  // Centered, with the y axis pointing up as in the window.
+  double left = (width - (maxX - minX) * scale) * 0.5;
+  double bottom = (height - (maxY - minY) * scale) * 0.5;
+  transform =
+    Matrix3x3::Translation(-minX, -minY) *
+    Matrix3x3::ScaleUniform(scale) *
+    Matrix3x3::Translation(left, bottom - height) *
+    Matrix3x3::Scale(1, -1);
+}
+
+bool OffscreenRenderer::OpenSequence(const char *pattern, FrameFormat format)
+{
+  Close();
+
+  if(!IsFramePattern(pattern))
+  {
+    return false;
+  }
+
+  this->pattern = pattern;
+  this->format = format;
+  open = true;
+  failed = false;
+  framesWritten = 0;
+  return true;
+}
+
+bool OffscreenRenderer::OpenPipe(const char *command)
+{
+  Close();
+
+#ifdef _WIN32
+  pipe = _popen(command, "wb");
+#else
+  pipe = popen(command, "w");
+#endif
+  if(pipe == nullptr)
+  {
+    return false;
+  }
+
+  format = FrameRaw;
+  open = true;
+  failed = false;
+  framesWritten = 0;
+  return true;
+}
+
+bool OffscreenRenderer::Close()
+{
+  if(!open)
+  {
+    return !failed;
+  }
+
+  Flush();
+
+  if(pipe != nullptr)
+  {
+#ifdef _WIN32
+    bool closed = _pclose(pipe) == 0;
+#else
+    bool closed = pclose(pipe) == 0;
+#endif
+    failed = failed || !closed;
+    pipe = nullptr;
+  }
+
+  open = false;
+  return !failed;
+}
+
+OffscreenFrame& OffscreenRenderer::AddFrame()
+{
+  if(pending == framesInFlight)
+  {
+    Flush();
+  }
+
+  // Slots keep their memory, so after the first few frames nothing is allocated.
+  if(pending == slots.size())
+  {
+    Slot *slot = new Slot();
+    slot->Image.Resize(width, height);
+    slot->FrameRenderer.GetSpriteCache().SetBudget(DefaultSpriteBudget / framesInFlight);
+    slots.push_back(slot);
+  }
+
+  OffscreenFrame &frame = slots[pending++]->Frame;
+  frame.Position.clear();
+  frame.Radius.clear();
+  frame.Orientation.clear();
+  return frame;
+}
+
+void OffscreenRenderer::AddFrame(const BallStore &balls)
+{
+  OffscreenFrame &frame = AddFrame();
+  unsigned int count = balls.Count();
+  frame.Position.assign(balls.Position.begin(), balls.Position.begin() + count);
+  frame.Radius.assign(balls.Radius.begin(), balls.Radius.begin() + count);
+  frame.Orientation.assign(balls.Orientation.begin(), balls.Orientation.begin() + count);
+}
+
+void OffscreenRenderer::Flush()
+{
+  if(pending == 0)
+  {
+    return;
+  }
+
+  // Every frame draws into its own slot, only writing to a pipe has to wait its turn.
+  unsigned int first = framesWritten;
+  ParallelFor(pool, pending, 1, [&](unsigned int begin, unsigned int end)
+  {
+    for(unsigned int i = begin; i < end; ++i)
+    {
+      RenderSlot(*slots[i], first + i);
+    }
+  });
+
+  for(unsigned int i = 0; i < pending; ++i)
+  {
+    Slot &slot = *slots[i];
+    if(pipe != nullptr && !failed && !slot.Encoded.empty())
+    {
+      slot.Failed = fwrite(&slot.Encoded[0], 1, slot.Encoded.size(), pipe) != slot.Encoded.size();
+    }
+    failed = failed || slot.Failed;
+  }
+
+  framesWritten += pending;
+  pending = 0;
+}
+
+void OffscreenRenderer::RenderSlot(Slot &slot, unsigned int number)
+{
+  Renderer &renderer = slot.FrameRenderer;
+  renderer.SetTransform(transform);
+  renderer.Begin(slot.Image, ClearColor);
+
+  for(const Line &line : lines)
+  {
+    renderer.AddLine(line);
+  }
+
+  const OffscreenFrame &frame = slot.Frame;
+  for(unsigned int i = 0; i < frame.Position.size(); ++i)
+  {
+    renderer.AddBall(frame.Position[i], frame.Radius[i], frame.Orientation[i]);
+  }
+
+  renderer.End();
+
+  slot.Failed = false;
+  switch(format)
+  {
+  case FramePng: EncodePng(slot.Image, slot.Encoded); break;
+  case FrameRaw: EncodeRaw(slot.Image, slot.Encoded); break;
+  default: EncodePpm(slot.Image, slot.Encoded); break;
+  }
+
+  // Files of their own are written right away, in any order.
+  if(pipe == nullptr)
+  {
+    char path[1024];
+    snprintf(path, sizeof(path), pattern.c_str(), number);
+    path[sizeof(path) - 1] = '\0';
+
+    FILE *file = fopen(path, "wb");
+    if(file == nullptr)
+    {
+      slot.Failed = true;
+      return;
+    }
+
+    bool written = fwrite(&slot.Encoded[0], 1, slot.Encoded.size(), file) == slot.Encoded.size();
+    slot.Failed = fclose(file) != 0 || !written;
+  }
+}
@@ -0,0 +1,141 @@
+#ifndef OFFSCREENRENDERER_H
+#define OFFSCREENRENDERER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "BallStore.h"
+#include "Framebuffer.h"
+#include "Renderer.h"
+#include "Line.h"
+#include "Matrix3x3.h"
+#include "ThreadPool.h"
+#include "Vector2D.h"
+
+// How rendered frames are stored.
+enum FrameFormat
+{
+  // Binary PPM files, next to no work to write.
+  FramePpm,
+
+  // PNG files, stored without compression so no zlib is needed.
+  FramePng,
+
+  // 24 bit RGB frames one after the other, as a video encoder reads them.
+  FrameRaw
+};
+
+// The balls of one frame, with orientations in degrees as in a BallStore.
+struct OffscreenFrame
+{
+  std::vector<Vector2D> Position;
+  std::vector<double> Radius;
+  std::vector<double> Orientation;
+};
+
+/* Renders the frames of a simulation without a window, as fast as the
+ * CPU allows rather than as time passes, for turning long runs into
+ * videos.
+ *
+ * Frames are filled in one by one, from a live world or a recorded
+ * trajectory. Once all frames in flight are filled in they are drawn and
+ * encoded side by side on the thread pool, each with a renderer of its
+ * own, and written out in order. Frames go to a numbered sequence of
+ * image files, or raw into the standard input of another program such
+ * as a video encoder. */
+class OffscreenRenderer
+{
+public:
+  /* Constructor, framesInFlight frames are drawn at once. Zero uses two
+   * per thread of the pool. */
+  OffscreenRenderer(unsigned int width, unsigned int height, ThreadPool *pool,
+                    unsigned int framesInFlight = 0);
+
+  // Destructor, writes the frames still waiting.
+  ~OffscreenRenderer();
+
+  // The lines drawn in every frame, they are copied.
+  void SetLines(const std::vector<Line> &lines);
+
+  // Turns meters into pixels, see Renderer.
+  void SetTransform(const Matrix3x3 &transform);
+  const Matrix3x3& GetTransform() const;
+
+  // Shows all of the lines as large as fits, with margin pixels to spare, y up.
+  void FitToLines(unsigned int margin);
+
+  /* Writes frame n to the file named by pattern with n filled in, such
+   * as "frames/%06u.png". Returns false unless the pattern holds exactly
+   * one integer conversion; %% stands for a percent sign. */
+  bool OpenSequence(const char *pattern, FrameFormat format);
+
+  // Starts command and writes raw frames to its standard input.
+  bool OpenPipe(const char *command);
+
+  // Writes the frames still waiting and closes the output.
+  // Returns false if any frame could not be written.
+  bool Close();
+
+  bool IsOpen() const;
+
+  /* Returns the next frame to fill in. Once every frame in flight is
+   * taken they are all drawn and written before a new one is handed out. */
+  OffscreenFrame& AddFrame();
+
+  // Adds a frame with the balls of a store.
+  void AddFrame(const BallStore &balls);
+
+  unsigned int GetWidth() const;
+  unsigned int GetHeight() const;
+  unsigned int GetFramesInFlight() const;
+  unsigned int GetFramesWritten() const;
+
+private:
+  // Not copyable, it owns the renderers and the output.
+  OffscreenRenderer(const OffscreenRenderer &);
+  OffscreenRenderer& operator=(const OffscreenRenderer &);
+
+  // A frame in flight and everything needed to draw it on its own.
+  struct Slot
+  {
+    OffscreenFrame Frame;
+    Framebuffer Image;
+    Renderer FrameRenderer;
+    std::vector<unsigned char> Encoded;
+    bool Failed;
+  };
+
+  // Draws, encodes and writes every frame filled in so far.
+  void Flush();
+
+  // Draws and encodes a frame, and writes it if it is a file of its own.
+  void RenderSlot(Slot &slot, unsigned int number);
+
+  unsigned int width;
+  unsigned int height;
+  ThreadPool *pool;
+  unsigned int framesInFlight;
+
+  std::vector<Line> lines;
+  Matrix3x3 transform;
+
+  std::vector<Slot *> slots;
+  unsigned int pending;
+
+  std::string pattern;
+  FrameFormat format;
+  FILE *pipe;
+  bool open;
+  bool failed;
+  unsigned int framesWritten;
+};
+
+// Inlined accessors
+inline const Matrix3x3& OffscreenRenderer::GetTransform() const { return transform; }
+inline bool OffscreenRenderer::IsOpen() const { return open; }
+inline unsigned int OffscreenRenderer::GetWidth() const { return width; }
+inline unsigned int OffscreenRenderer::GetHeight() const { return height; }
+inline unsigned int OffscreenRenderer::GetFramesInFlight() const { return framesInFlight; }
+inline unsigned int OffscreenRenderer::GetFramesWritten() const { return framesWritten; }
+
+#endif
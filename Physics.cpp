@@ -0,0 +1,132 @@
+#include "Physics.h"
+#include "Force.h"
+#include "Integrator.h"
+
+unsigned int UpdateForces(BallStore &balls, unsigned int begin, unsigned int end, double dt)
+{
+  unsigned int applied = 0;
+
+  for(unsigned int i = begin; i < end; ++i)
+  {
+    unsigned int first = i * MaxForcesPerBall;
+
+    for(unsigned int f = 0; f < balls.ForceCount[i];)
+    {
+      Force &force = balls.Forces[first + f];
+
+      if(force.Permanent == false)
+      {
+        force.TimeLeft -= dt;
+
+        // Remove expired forces, the last force moves into this spot
+        // so we look at the same spot again.
+        if(force.TimeLeft - dt <= 0.0)
+        {
+          balls.RemoveForce(i, f);
+          continue;
+        }
+      }
+
+      balls.ForceAccumulator[i] += force.Direction * force.Magnitude * dt;
+      ++f;
+    }
+
+    applied += balls.ForceCount[i];
+  }
+
+  return applied;
+}
+
+void Integrate(BallStore &balls, unsigned int begin, unsigned int end,
+               const Vector2D &acceleration, double dt)
+{
+  IntegrateBalls(balls, begin, end, acceleration, dt);
+}
+
+Vector2D ClosestPointOnSegment(const Vector2D &point, const Line &line)
+{
+  Vector2D lineVec = line.GetEnd() - line.GetStart();
+  double lengthSq = lineVec.LengthSquared();
+
+  if(lengthSq <= 0.0)
+  {
+    return line.GetStart();
+  }
+
+  // How far along the line the projection of the point lands, 0 to 1.
+  double t = Vector2D::Dot(point - line.GetStart(), lineVec) / lengthSq;
+  if(t < 0.0) t = 0.0;
+  if(t > 1.0) t = 1.0;
+
+  return line.GetStart() + lineVec * t;
+}
+
+bool SweepCircleSegment(const Vector2D &start, const Vector2D &motion, double radius,
+                        const Line &line, double &toi, Vector2D &normal)
+{
+  // Touching already, that is a regular contact.
+  Vector2D offset = start - ClosestPointOnSegment(start, line);
+  if(offset.LengthSquared() < radius * radius)
+  {
+    return false;
+  }
+
+  Vector2D edge = line.GetEnd() - line.GetStart();
+  double lengthSq = edge.LengthSquared();
+  double best = 2.0;
+
+  /* The side of the segment: the circle touches it once its center
+   * reaches the line moved out by the radius towards the start. */
+  if(lengthSq > 0.0)
+  {
+    Vector2D lineNormal = edge.Perpendicular() * (1.0 / sqrt(lengthSq));
+    double distance = Vector2D::Dot(start - line.GetStart(), lineNormal);
+    double side = distance >= 0.0 ? 1.0 : -1.0;
+    double approach = Vector2D::Dot(motion, lineNormal) * side;
+
+    if(approach < 0.0)
+    {
+      double t = (radius - distance * side) / approach;
+      Vector2D center = start + motion * t;
+      double along = Vector2D::Dot(center - line.GetStart(), edge);
+
+      if(t >= 0.0 && t <= 1.0 && along >= 0.0 && along <= lengthSq)
+      {
+        best = t;
+        normal = lineNormal * side;
+      }
+    }
+  }
+
+  // The end points: where the center gets within the radius of them.
+  double motionSq = motion.LengthSquared();
+  const Vector2D *ends[2] = { &line.GetStart(), &line.GetEnd() };
+
+  for(unsigned int e = 0; e < 2 && motionSq > 0.0; ++e)
+  {
+    Vector2D toStart = start - *ends[e];
+    double b = Vector2D::Dot(toStart, motion);
+    double c = toStart.LengthSquared() - radius * radius;
+    double discriminant = b * b - motionSq * c;
+
+    if(b >= 0.0 || discriminant < 0.0)
+    {
+      continue;
+    }
+
+    double t = (-b - sqrt(discriminant)) / motionSq;
+    if(t >= 0.0 && t < best)
+    {
+      best = t;
+      normal = (toStart + motion * t) * (1.0 / radius);
+    }
+  }
+
+  if(best > 1.0)
+  {
+    return false;
+  }
+
+  toi = best;
+  return true;
+}
@@ -0,0 +1,161 @@
+#include "Profiler.h"
+#include <cstdio>
+
+// Set by AllocationHook.cpp if it is linked into the program.
+static const std::atomic<unsigned long long> *allocationCounter = nullptr;
+
+Profiler::Profiler()
+{
+  enabled = true;
+  capture = false;
+  origin = GameTimer::Now();
+  depth = 0;
+  frameZone = -1;
+  frameAllocations = 0;
+
+  for(unsigned int i = 0; i < CounterCount; ++i)
+  {
+    counters[i].store(0);
+    lastCounts[i] = 0;
+  }
+}
+
+Profiler::~Profiler()
+{
+
+}
+
+void Profiler::SetEnabled(bool enabled)
+{
+  this->enabled = enabled;
+
+  // A frame that is half done when turned off never ends.
+  if(!enabled)
+  {
+    frame.clear();
+    depth = 0;
+    frameZone = -1;
+  }
+}
+
+void Profiler::SetCapture(bool enabled)
+{
+  capture = enabled;
+}
+
+void Profiler::BeginFrame(const char *name)
+{
+  if(!enabled)
+  {
+    return;
+  }
+
+  frame.clear();
+  depth = 0;
+
+  for(unsigned int i = 0; i < CounterCount; ++i)
+  {
+    counters[i].store(0, std::memory_order_relaxed);
+  }
+  frameAllocations = GetAllocationCount();
+
+  // Zones are only taken while a frame is open, so open it first.
+  frameZone = 0;
+  frameZone = BeginZone(name);
+}
+
+void Profiler::EndFrame()
+{
+  if(!enabled || frameZone < 0)
+  {
+    return;
+  }
+
+  EndZone(frameZone);
+  frameZone = -1;
+
+  for(unsigned int i = 0; i < CounterCount; ++i)
+  {
+    lastCounts[i] = counters[i].load(std::memory_order_relaxed);
+  }
+  lastCounts[CounterAllocations] = GetAllocationCount() - frameAllocations;
+
+  if(capture)
+  {
+    FrameCounters counts;
+    counts.Time = frame[0].Start;
+    for(unsigned int i = 0; i < CounterCount; ++i)
+    {
+      counts.Values[i] = lastCounts[i];
+    }
+
+    captured.insert(captured.end(), frame.begin(), frame.end());
+    capturedCounters.push_back(counts);
+  }
+
+  // Both buffers keep their memory, the next frame reuses the old one.
+  lastFrame.swap(frame);
+}
+
+void Profiler::ClearCapture()
+{
+  captured.clear();
+  capturedCounters.clear();
+}
+
+const char *Profiler::GetCounterName(ProfileCounter counter)
+{
+  switch(counter)
+  {
+  case CounterPairTests: return "pair tests";
+  case CounterLineTests: return "line tests";
+  case CounterContacts: return "contacts";
+  case CounterForces: return "forces";
+  case CounterAllocations: return "allocations";
+  default: return "unknown";
+  }
+}
+
+void Profiler::SetAllocationCounter(const std::atomic<unsigned long long> *counter)
+{
+  allocationCounter = counter;
+}
+
+unsigned long long Profiler::GetAllocationCount()
+{
+  return allocationCounter ? allocationCounter->load(std::memory_order_relaxed) : 0;
+}
+
+/* Zones become complete ("X") events on a single thread, and every
+ * counter its own counter ("C") track, sampled once per frame. */
+bool Profiler::WriteChromeTrace(const char *path) const
+{
+  FILE *file = fopen(path, "w");
+  if(file == nullptr)
+  {
+    return false;
+  }
+
+  fprintf(file, "{\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+    "\"args\":{\"name\":\"step\"}}");
+
+  for(const ProfileZone &zone : captured)
+  {
+    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+      "\"ts\":%.3f,\"dur\":%.3f}", zone.Name, zone.Start, zone.Duration);
+  }
+
+  for(const FrameCounters &counts : capturedCounters)
+  {
+    for(unsigned int i = 0; i < CounterCount; ++i)
+    {
+      fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,"
+        "\"args\":{\"value\":%llu}}", GetCounterName(static_cast<ProfileCounter>(i)),
+        counts.Time, counts.Values[i]);
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
@@ -0,0 +1,203 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <vector>
+#include "GameTimer.h"
+
+// What the profiler counts, summed over a frame.
+enum ProfileCounter
+{
+  // Ball pairs the broad phase compared.
+  CounterPairTests,
+
+  // Blocks of lines tested against a ball by the line kernel.
+  CounterLineTests,
+
+  // Contacts handed to the solver.
+  CounterContacts,
+
+  // Forces applied to balls.
+  CounterForces,
+
+  // Heap allocations anywhere in the program.
+  CounterAllocations,
+
+  CounterCount
+};
+
+/* A timed part of a frame. Times are in microseconds since the profiler
+ * was created, Depth is the number of zones it is nested in. */
+struct ProfileZone
+{
+  const char *Name;
+  unsigned int Depth;
+  double Start;
+  double Duration;
+};
+
+/* Times the parts of every frame and counts the work done in them.
+ *
+ * Zones are timed on the thread running the frame and must be closed in
+ * the reverse order they were opened; their names are not copied, so use
+ * string literals. Counters may be bumped from any thread.
+ *
+ * It is meant to stay on: a zone is two clock reads and a store into a
+ * buffer that keeps its memory, a counter one atomic add. When disabled
+ * both are a single branch. The last finished frame can be read back at
+ * any time, and with capturing on every frame is kept for a Chrome trace
+ * (chrome://tracing or ui.perfetto.dev). */
+class Profiler
+{
+public:
+  // Constructor
+  Profiler();
+
+  // Destructor
+  ~Profiler();
+
+  void SetEnabled(bool enabled);
+  bool IsEnabled() const;
+
+  // Keeps every frame for WriteChromeTrace, not only the last one.
+  void SetCapture(bool enabled);
+  bool IsCapturing() const;
+
+  // A frame is the outermost zone, counters are reset when one begins.
+  void BeginFrame(const char *name = "frame");
+  void EndFrame();
+
+  // Opens a zone and returns what to close it with.
+  int BeginZone(const char *name);
+  void EndZone(int zone);
+
+  void Count(ProfileCounter counter, unsigned long long amount);
+
+  // The zones and counters of the last finished frame.
+  const std::vector<ProfileZone>& GetLastFrame() const;
+  unsigned long long GetLastCount(ProfileCounter counter) const;
+
+  // Writes the captured frames as a Chrome trace.
+  bool WriteChromeTrace(const char *path) const;
+
+  // Drops the captured frames.
+  void ClearCapture();
+
+  static const char *GetCounterName(ProfileCounter counter);
+
+  /* Returns how many heap allocations the program has made so far, or
+   * zero unless AllocationHook.cpp is linked into the program. */
+  static unsigned long long GetAllocationCount();
+
+  // Called by AllocationHook.cpp with the counter it bumps.
+  static void SetAllocationCounter(const std::atomic<unsigned long long> *counter);
+
+private:
+  // Not copyable, the counters are atomic.
+  Profiler(const Profiler &);
+  Profiler& operator=(const Profiler &);
+
+  // Microseconds since the profiler was created.
+  double Now() const;
+
+  struct FrameCounters
+  {
+    double Time;
+    unsigned long long Values[CounterCount];
+  };
+
+  bool enabled;
+  bool capture;
+  long long origin;
+
+  std::vector<ProfileZone> frame;
+  std::vector<ProfileZone> lastFrame;
+  unsigned int depth;
+  int frameZone;
+
+  std::atomic<unsigned long long> counters[CounterCount];
+  unsigned long long lastCounts[CounterCount];
+  unsigned long long frameAllocations;
+
+  std::vector<ProfileZone> captured;
+  std::vector<FrameCounters> capturedCounters;
+};
+
+/* Times the rest of the enclosing scope as a zone. Does nothing when the
+ * profiler is null, so code can be profiled without knowing if it is. */
+class ProfileScope
+{
+public:
+  // Constructor, opens the zone.
+  ProfileScope(Profiler *profiler, const char *name);
+
+  // Destructor, closes it.
+  ~ProfileScope();
+
+private:
+  Profiler *profiler;
+  int zone;
+};
+
+// Inlined accessors
+inline bool Profiler::IsEnabled() const { return enabled; }
+inline bool Profiler::IsCapturing() const { return capture; }
+inline const std::vector<ProfileZone>& Profiler::GetLastFrame() const { return lastFrame; }
+inline unsigned long long Profiler::GetLastCount(ProfileCounter counter) const { return lastCounts[counter]; }
+
+inline int Profiler::BeginZone(const char *name)
+{
+  // Zones outside of a frame would pile up with nothing to clear them.
+  if(!enabled || frameZone < 0)
+  {
+    return -1;
+  }
+
+  ProfileZone zone;
+  zone.Name = name;
+  zone.Depth = depth++;
+  zone.Start = Now();
+  zone.Duration = 0.0;
+  frame.push_back(zone);
+  return static_cast<int>(frame.size()) - 1;
+}
+
+inline void Profiler::EndZone(int zone)
+{
+  if(zone < 0 || zone >= static_cast<int>(frame.size()))
+  {
+    return;
+  }
+
+  frame[zone].Duration = Now() - frame[zone].Start;
+  depth--;
+}
+
+inline void Profiler::Count(ProfileCounter counter, unsigned long long amount)
+{
+  if(enabled)
+  {
+    counters[counter].fetch_add(amount, std::memory_order_relaxed);
+  }
+}
+
+inline double Profiler::Now() const
+{
+  return GameTimer::TicksToSeconds(GameTimer::Now() - origin) * 1e6;
+}
+
+inline ProfileScope::ProfileScope(Profiler *profiler, const char *name)
+{
+  this->profiler = profiler;
+  zone = profiler ? profiler->BeginZone(name) : -1;
+}
+
+inline ProfileScope::~ProfileScope()
+{
+  if(profiler)
+  {
+    profiler->EndZone(zone);
+  }
+}
+
+#endif
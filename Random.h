@@ -0,0 +1,65 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+/* Small seeded random number generator (xorshift64*).
+ * Unlike rand() it gives the same numbers for the same seed on every
+ * platform and standard library, so scenes built from a seed come out
+ * the same on every machine. */
+class Random
+{
+public:
+  // Constructor
+  Random(unsigned long long seed = 1);
+
+  void Seed(unsigned long long seed);
+
+  // Returns 32 random bits.
+  unsigned int Next();
+
+  // Returns a number in [0, bound).
+  unsigned int NextInt(unsigned int bound);
+
+  // Returns a number in [min, max).
+  double NextDouble(double min = 0.0, double max = 1.0);
+
+private:
+  unsigned long long state;
+};
+
+inline Random::Random(unsigned long long seed)
+{
+  Seed(seed);
+}
+
+inline void Random::Seed(unsigned long long seed)
+{
+  // Spread the seed over all bits, a state of zero would only give zeros.
+  unsigned long long z = seed + 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  state = z ^ (z >> 31);
+  if(state == 0)
+  {
+    state = 0x9E3779B97F4A7C15ULL;
+  }
+}
+
+inline unsigned int Random::Next()
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return static_cast<unsigned int>((state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+inline unsigned int Random::NextInt(unsigned int bound)
+{
+  return static_cast<unsigned int>((static_cast<unsigned long long>(Next()) * bound) >> 32);
+}
+
+inline double Random::NextDouble(double min, double max)
+{
+  return min + (max - min) * (Next() * (1.0 / 4294967296.0));
+}
+
+#endif
@@ -0,0 +1,452 @@
+#include "Rasterizer.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define RASTERIZER_X86
+#include <emmintrin.h>
+#endif
+
+const double Pi = 3.14159265358979323846;
+
+// One in the fixed point numbers the kernels step with.
+const double FixedOne = 65536.0;
+
+// ---------- Scalar ------------ //
+
+// Bilinear sample with 8 bit weights, shared with the SSE2 kernel.
+static inline unsigned int SampleTexel(const unsigned int *texels, unsigned int pitch, int u, int v)
+{
+  const unsigned int *t = texels + (v >> 16) * pitch + (u >> 16);
+  unsigned int fx = (u >> 8) & 255;
+  unsigned int fy = (v >> 8) & 255;
+  unsigned int result = 0;
+
+  for(unsigned int shift = 0; shift < 32; shift += 8)
+  {
+    unsigned int top = (((t[0] >> shift) & 255) * (256 - fx) + ((t[1] >> shift) & 255) * fx) >> 8;
+    unsigned int bottom = (((t[pitch] >> shift) & 255) * (256 - fx) +
+      ((t[pitch + 1] >> shift) & 255) * fx) >> 8;
+    result |= ((top * (256 - fy) + bottom * fy) >> 8) << shift;
+  }
+
+  return result;
+}
+
+static void SpanScalar(const unsigned int *texels, unsigned int pitch,
+                       unsigned int *target, unsigned int count,
+                       int u, int v, int du, int dv)
+{
+  for(unsigned int i = 0; i < count; ++i, u += du, v += dv)
+  {
+    target[i] = BlendColor(SampleTexel(texels, pitch, u, v), target[i]);
+  }
+}
+
+static void BlendScalar(const unsigned int *source, unsigned int *target, unsigned int count)
+{
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    target[i] = BlendColor(source[i], target[i]);
+  }
+}
+
+// ---------- SSE2 ------------ //
+#ifdef RASTERIZER_X86
+
+// Premultiplied source over target, two pixels in 16 bit lanes.
+static inline __m128i BlendWide(__m128i source, __m128i target)
+{
+  // Alpha is the last channel of each pixel.
+  __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(source, _MM_SHUFFLE(3, 3, 3, 3)),
+    _MM_SHUFFLE(3, 3, 3, 3));
+  __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(target, inverse), _mm_set1_epi16(128));
+  __m128i faded = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+  return _mm_add_epi16(source, faded);
+}
+
+// Four channels of two pixels in 16 bit lanes, the first pixel low.
+static inline __m128i Widen(unsigned int first, unsigned int second)
+{
+  return _mm_unpacklo_epi8(_mm_set_epi32(0, 0, static_cast<int>(second), static_cast<int>(first)),
+    _mm_setzero_si128());
+}
+
+// (a * (256 - w) + b * w) >> 8 in every lane, none of it overflows 16 bits.
+static inline __m128i Lerp(__m128i a, __m128i b, __m128i weight)
+{
+  __m128i rest = _mm_sub_epi16(_mm_set1_epi16(256), weight);
+  return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, rest), _mm_mullo_epi16(b, weight)), 8);
+}
+
+// Two pixels at a time, with the same math as the scalar kernel.
+static void SpanSSE2(const unsigned int *texels, unsigned int pitch,
+                     unsigned int *target, unsigned int count,
+                     int u, int v, int du, int dv)
+{
+  unsigned int i = 0;
+
+  for(; i + 2 <= count; i += 2, u += 2 * du, v += 2 * dv)
+  {
+    int u1 = u + du;
+    int v1 = v + dv;
+    const unsigned int *a = texels + (v >> 16) * pitch + (u >> 16);
+    const unsigned int *b = texels + (v1 >> 16) * pitch + (u1 >> 16);
+
+    short fxa = static_cast<short>((u >> 8) & 255), fxb = static_cast<short>((u1 >> 8) & 255);
+    short fya = static_cast<short>((v >> 8) & 255), fyb = static_cast<short>((v1 >> 8) & 255);
+    __m128i fx = _mm_set_epi16(fxb, fxb, fxb, fxb, fxa, fxa, fxa, fxa);
+    __m128i fy = _mm_set_epi16(fyb, fyb, fyb, fyb, fya, fya, fya, fya);
+
+    __m128i top = Lerp(Widen(a[0], b[0]), Widen(a[1], b[1]), fx);
+    __m128i bottom = Lerp(Widen(a[pitch], b[pitch]), Widen(a[pitch + 1], b[pitch + 1]), fx);
+    __m128i source = Lerp(top, bottom, fy);
+
+    __m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(target + i)),
+      _mm_setzero_si128());
+    __m128i result = BlendWide(source, pixels);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(target + i), _mm_packus_epi16(result, result));
+  }
+
+  SpanScalar(texels, pitch, target + i, count - i, u, v, du, dv);
+}
+
+// Four pixels at a time.
+static void BlendSSE2(const unsigned int *source, unsigned int *target, unsigned int count)
+{
+  const __m128i zero = _mm_setzero_si128();
+  unsigned int i = 0;
+
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+    __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(target + i));
+
+    __m128i low = BlendWide(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(t, zero));
+    __m128i high = BlendWide(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(t, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(target + i), _mm_packus_epi16(low, high));
+  }
+
+  BlendScalar(source + i, target + i, count - i);
+}
+
+#endif // RASTERIZER_X86
+
+SpanKernel GetSpanKernel()
+{
+  return GetSpanKernel(GetIntegratorIsa());
+}
+
+SpanKernel GetSpanKernel(IntegratorIsa isa)
+{
+#ifdef RASTERIZER_X86
+  if((isa == IsaAVX2 || isa == IsaSSE2) && IsIntegratorIsaSupported(IsaSSE2))
+  {
+    return SpanSSE2;
+  }
+#endif
+
+  return SpanScalar;
+}
+
+BlendKernel GetBlendKernel()
+{
+  return GetBlendKernel(GetIntegratorIsa());
+}
+
+BlendKernel GetBlendKernel(IntegratorIsa isa)
+{
+#ifdef RASTERIZER_X86
+  if((isa == IsaAVX2 || isa == IsaSSE2) && IsIntegratorIsaSupported(IsaSSE2))
+  {
+    return BlendSSE2;
+  }
+#endif
+
+  return BlendScalar;
+}
+
+void BlitImage(Framebuffer &target, const unsigned int *pixels, unsigned int width,
+               unsigned int height, unsigned int stride, int x, int y)
+{
+  // Only the part over the target is drawn.
+  int left = std::max(0, -x);
+  int top = std::max(0, -y);
+  int right = std::min(static_cast<int>(width), static_cast<int>(target.GetWidth()) - x);
+  int bottom = std::min(static_cast<int>(height), static_cast<int>(target.GetHeight()) - y);
+  if(left >= right || top >= bottom)
+  {
+    return;
+  }
+
+  BlendKernel blend = GetBlendKernel();
+  for(int row = top; row < bottom; ++row)
+  {
+    blend(pixels + row * stride + left, target.GetRow(y + row) + x + left, right - left);
+  }
+}
+
+/* Narrows [first, last] to the steps t where start + t * step stays in
+ * [low, high]. Returns false if none do. */
+static bool ClipSteps(double start, double step, double low, double high, int &first, int &last)
+{
+  if(std::fabs(step) < 1e-12)
+  {
+    return start >= low && start <= high;
+  }
+
+  double a = (low - start) / step;
+  double b = (high - start) / step;
+  if(a > b)
+  {
+    std::swap(a, b);
+  }
+
+  first = std::max(first, static_cast<int>(std::ceil(a)));
+  last = std::min(last, static_cast<int>(std::floor(b)));
+  return first <= last;
+}
+
+static int ToFixed(double value)
+{
+  return static_cast<int>(std::floor(value * FixedOne + 0.5));
+}
+
+void DrawSprites(Framebuffer &target, const Sprite &sprite,
+                 const SpriteInstance *instances, unsigned int count)
+{
+  DrawSprites(target, sprite, instances, count, target.GetRect());
+}
+
+void DrawSprites(Framebuffer &target, const Sprite &sprite,
+                 const SpriteInstance *instances, unsigned int count,
+                 const PixelRect &clip)
+{
+  const unsigned int *texels = sprite.GetTexels();
+  PixelRect inside = clip.Intersect(target.GetRect());
+  if(texels == nullptr || inside.IsEmpty())
+  {
+    return;
+  }
+
+  SpanKernel span = GetSpanKernel();
+  double width = sprite.GetWidth();
+  double height = sprite.GetHeight();
+
+  // Samples may reach one texel into the border, where all is transparent.
+  double lowest = SpriteBorder - 1.0;
+  double highestU = SpriteBorder + width;
+  double highestV = SpriteBorder + height;
+
+  for(unsigned int k = 0; k < count; ++k)
+  {
+    const SpriteInstance &instance = instances[k];
+    if(instance.Radius <= 0.0f)
+    {
+      continue;
+    }
+
+    // Texels per pixel, and how a step along a row or a column moves in the sprite.
+    double scale = width / (2.0 * instance.Radius);
+    double angle = instance.Angle * (Pi / 180.0);
+    double c = std::cos(angle) * scale;
+    double s = std::sin(angle) * scale;
+
+    // The box around the turned sprite, with a pixel to spare for filtering.
+    double extentX = (width * std::fabs(c) + height * std::fabs(s)) / (2.0 * scale * scale) + 1.0;
+    double extentY = (width * std::fabs(s) + height * std::fabs(c)) / (2.0 * scale * scale) + 1.0;
+
+    int left = static_cast<int>(std::floor(instance.X - extentX));
+    int right = static_cast<int>(std::ceil(instance.X + extentX));
+    int top = std::max(inside.Top, static_cast<int>(std::floor(instance.Y - extentY)));
+    int bottom = std::min(inside.Bottom - 1, static_cast<int>(std::ceil(instance.Y + extentY)));
+
+    for(int y = top; y <= bottom; ++y)
+    {
+      // Where the middle of the leftmost pixel of the row lands in the sprite.
+      double px = left + 0.5 - instance.X;
+      double py = y + 0.5 - instance.Y;
+      double u = width * 0.5 - 0.5 + SpriteBorder + px * c + py * s;
+      double v = height * 0.5 - 0.5 + SpriteBorder - px * s + py * c;
+
+      int first = std::max(0, inside.Left - left);
+      int last = std::min(right - left, inside.Right - 1 - left);
+      if(first > last ||
+         !ClipSteps(u, c, lowest, highestU, first, last) ||
+         !ClipSteps(v, -s, lowest, highestV, first, last))
+      {
+        continue;
+      }
+
+      // Stepped from the start of the row, so clipping never moves a sample.
+      int du = ToFixed(c);
+      int dv = ToFixed(-s);
+      span(texels, sprite.GetPitch(), target.GetRow(y) + left + first, last - first + 1,
+        ToFixed(u) + first * du, ToFixed(v) + first * dv, du, dv);
+    }
+  }
+}
+
+/* Cuts a line down to the part inside [0, width) x [0, height).
+ * Returns false if none of it is. */
+static bool ClipLine(float &x0, float &y0, float &x1, float &y1, float width, float height)
+{
+  float dx = x1 - x0;
+  float dy = y1 - y0;
+  float t0 = 0.0f;
+  float t1 = 1.0f;
+
+  // Liang-Barsky, one edge at a time.
+  float p[4] = { -dx, dx, -dy, dy };
+  float q[4] = { x0, width - x0, y0, height - y0 };
+
+  for(unsigned int edge = 0; edge < 4; ++edge)
+  {
+    if(p[edge] == 0.0f)
+    {
+      if(q[edge] < 0.0f)
+      {
+        return false;
+      }
+      continue;
+    }
+
+    float t = q[edge] / p[edge];
+    if(p[edge] < 0.0f)
+    {
+      t0 = std::max(t0, t);
+    }
+    else
+    {
+      t1 = std::min(t1, t);
+    }
+  }
+
+  if(t0 > t1)
+  {
+    return false;
+  }
+
+  x1 = x0 + dx * t1;
+  y1 = y0 + dy * t1;
+  x0 = x0 + dx * t0;
+  y0 = y0 + dy * t0;
+  return true;
+}
+
+static inline void PlotPixel(Framebuffer &target, int x, int y, unsigned int color)
+{
+  if(x < 0 || y < 0 || x >= static_cast<int>(target.GetWidth()) ||
+     y >= static_cast<int>(target.GetHeight()))
+  {
+    return;
+  }
+
+  unsigned int &pixel = target.GetRow(y)[x];
+  pixel = (color >> 24) == 255 ? color : BlendColor(color, pixel);
+}
+
+// A premultiplied color with its coverage taken into account, 0 to 256.
+static inline unsigned int FadeColor(unsigned int color, unsigned int coverage)
+{
+  unsigned int result = 0;
+  for(unsigned int shift = 0; shift < 32; shift += 8)
+  {
+    result |= ((((color >> shift) & 255) * coverage) >> 8) << shift;
+  }
+
+  return result;
+}
+
+void DrawLine(Framebuffer &target, float x0, float y0, float x1, float y1,
+              unsigned int color)
+{
+  if(!ClipLine(x0, y0, x1, y1, static_cast<float>(target.GetWidth()),
+     static_cast<float>(target.GetHeight())))
+  {
+    return;
+  }
+
+  int ax = static_cast<int>(std::floor(x0));
+  int ay = static_cast<int>(std::floor(y0));
+  int bx = static_cast<int>(std::floor(x1));
+  int by = static_cast<int>(std::floor(y1));
+
+  int dx = std::abs(bx - ax);
+  int dy = -std::abs(by - ay);
+  int sx = ax < bx ? 1 : -1;
+  int sy = ay < by ? 1 : -1;
+  int error = dx + dy;
+
+  while(true)
+  {
+    PlotPixel(target, ax, ay, color);
+    if(ax == bx && ay == by)
+    {
+      break;
+    }
+
+    int twice = 2 * error;
+    if(twice >= dy)
+    {
+      error += dy;
+      ax += sx;
+    }
+    if(twice <= dx)
+    {
+      error += dx;
+      ay += sy;
+    }
+  }
+}
+
+void DrawSmoothLine(Framebuffer &target, float x0, float y0, float x1, float y1,
+                    unsigned int color)
+{
+  float width = static_cast<float>(target.GetWidth());
+  float height = static_cast<float>(target.GetHeight());
+  if(!ClipLine(x0, y0, x1, y1, width, height))
+  {
+    return;
+  }
+
+  // Xiaolin Wu's, stepping along the longer axis with pixel centers on whole numbers.
+  x0 -= 0.5f; y0 -= 0.5f;
+  x1 -= 0.5f; y1 -= 0.5f;
+
+  bool steep = std::fabs(y1 - y0) > std::fabs(x1 - x0);
+  if(steep)
+  {
+    std::swap(x0, y0);
+    std::swap(x1, y1);
+  }
+  if(x0 > x1)
+  {
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+  }
+
+  float gradient = x1 - x0 > 0.0f ? (y1 - y0) / (x1 - x0) : 0.0f;
+  int first = static_cast<int>(std::floor(x0 + 0.5f));
+  int last = static_cast<int>(std::floor(x1 + 0.5f));
+  float y = y0 + gradient * (first - x0);
+
+  for(int x = first; x <= last; ++x, y += gradient)
+  {
+    int below = static_cast<int>(std::floor(y));
+    unsigned int coverage = static_cast<unsigned int>((y - below) * 256.0f);
+
+    if(steep)
+    {
+      PlotPixel(target, below, x, FadeColor(color, 256 - coverage));
+      PlotPixel(target, below + 1, x, FadeColor(color, coverage));
+    }
+    else
+    {
+      PlotPixel(target, x, below, FadeColor(color, 256 - coverage));
+      PlotPixel(target, x, below + 1, FadeColor(color, coverage));
+    }
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include "Framebuffer.h"
+#include "Integrator.h"
+
+/* A sprite to draw, in pixels. The sprite is scaled so it is twice the
+ * radius across and turned clockwise by the angle in degrees, the way
+ * GDI+ turns things on the screen. */
+struct SpriteInstance
+{
+  float X;
+  float Y;
+  float Radius;
+  float Angle;
+};
+
+/* Draws count pixels of one row of a sprite over the pixels at target.
+ * u and v are where the first pixel lands in the sprite's texels, border
+ * included, and du and dv how far each next pixel moves; all are fixed
+ * point with 16 bits after the point. Texels are sampled bilinearly and
+ * blended over the target. */
+typedef void (*SpanKernel)(const unsigned int *texels, unsigned int pitch,
+                           unsigned int *target, unsigned int count,
+                           int u, int v, int du, int dv);
+
+/* Returns the kernel for an instruction set, or for the one the integrator
+ * uses. They agree pixel for pixel; AVX2 uses the SSE2 kernel, a row of a
+ * ball is too short to fill wider registers. */
+SpanKernel GetSpanKernel();
+SpanKernel GetSpanKernel(IntegratorIsa isa);
+
+/* Blends count premultiplied pixels over the pixels at target, as they
+ * are. */
+typedef void (*BlendKernel)(const unsigned int *source, unsigned int *target,
+                            unsigned int count);
+
+// Picked the same way as the span kernels.
+BlendKernel GetBlendKernel();
+BlendKernel GetBlendKernel(IntegratorIsa isa);
+
+/* Draws an image without scaling or turning it, its top left corner at
+ * x, y. Rows of the image are stride pixels apart. */
+void BlitImage(Framebuffer &target, const unsigned int *pixels, unsigned int width,
+               unsigned int height, unsigned int stride, int x, int y);
+
+/* Draws a batch of sprites in order, the later ones on top. Everything
+ * outside the target, or outside the clip rectangle, is cut off. */
+void DrawSprites(Framebuffer &target, const Sprite &sprite,
+                 const SpriteInstance *instances, unsigned int count);
+void DrawSprites(Framebuffer &target, const Sprite &sprite,
+                 const SpriteInstance *instances, unsigned int count,
+                 const PixelRect &clip);
+
+/* Draws a line one pixel wide from one point to another, in pixels. The
+ * smooth line blends pixels by how much of them it covers, the other
+ * one sets whole pixels (Bresenham) like GDI+ does by default. */
+void DrawLine(Framebuffer &target, float x0, float y0, float x1, float y1,
+              unsigned int color);
+void DrawSmoothLine(Framebuffer &target, float x0, float y0, float x1, float y1,
+                    unsigned int color);
+
+// Returns a premultiplied color drawn over another.
+unsigned int BlendColor(unsigned int source, unsigned int target);
+
+// Inlined accessors
+inline unsigned int BlendColor(unsigned int source, unsigned int target)
+{
+  unsigned int inverse = 255 - (source >> 24);
+  unsigned int result = 0;
+
+  // target * inverse / 255, rounded, one channel at a time.
+  for(unsigned int shift = 0; shift < 32; shift += 8)
+  {
+    unsigned int t = ((target >> shift) & 255) * inverse + 128;
+    unsigned int channel = ((source >> shift) & 255) + ((t + (t >> 8)) >> 8);
+    result |= channel << shift;
+  }
+
+  return result;
+}
+
+#endif
@@ -0,0 +1,390 @@
+#include "Renderer.h"
+#include <algorithm>
+#include <cmath>
+
+// Size of the made up ball, as big as the picture the window loads.
+const unsigned int DefaultBallSize = 64;
+
+Renderer::Renderer()
+{
+  target = nullptr;
+  clearColor = 0;
+  transform = Matrix3x3::Identity();
+  scale = 1.0;
+  smoothLines = false;
+  cacheSprites = true;
+  ballSprite.MakeBall(DefaultBallSize);
+
+  incremental = false;
+  overlay = nullptr;
+  drawnTarget = nullptr;
+  drawnClearColor = 0;
+  drawnSpriteVersion = 0;
+  redrawAll = true;
+  tilesX = 0;
+  tilesY = 0;
+}
+
+Renderer::~Renderer()
+{
+
+}
+
+void Renderer::SetCacheSprites(bool enabled)
+{
+  cacheSprites = enabled;
+  redrawAll = true;
+}
+
+void Renderer::SetTransform(const Matrix3x3 &transform)
+{
+  this->transform = transform;
+  redrawAll = true;
+
+  // How long a meter is on the screen, the same in every direction.
+  Vector2D origin = Vector2D::Transform(Vector2D(0, 0), transform);
+  Vector2D meter = Vector2D::Transform(Vector2D(1, 0), transform);
+  scale = std::sqrt((meter - origin).LengthSquared());
+}
+
+void Renderer::SetSmoothLines(bool enabled)
+{
+  smoothLines = enabled;
+  redrawAll = true;
+}
+
+void Renderer::SetIncremental(bool enabled)
+{
+  incremental = enabled;
+  redrawAll = true;
+}
+
+void Renderer::SetOverlay(const Framebuffer *overlay)
+{
+  this->overlay = overlay;
+  redrawAll = true;
+}
+
+void Renderer::Invalidate(const PixelRect &rect)
+{
+  // Before the first frame everything is drawn anyway.
+  if(!dirtyTiles.empty())
+  {
+    MarkTiles(rect);
+  }
+}
+
+void Renderer::Begin(Framebuffer &target, unsigned int clearColor)
+{
+  this->target = &target;
+  this->clearColor = clearColor;
+  lines.clear();
+  balls.clear();
+}
+
+void Renderer::AddLine(const Line &line)
+{
+  lines.push_back(line);
+}
+
+void Renderer::AddBall(const Vector2D &position, double radius, double orientation)
+{
+  Vector2D pixels = ToPixels(position);
+
+  SpriteInstance ball;
+  ball.X = static_cast<float>(pixels.X);
+  ball.Y = static_cast<float>(pixels.Y);
+  ball.Radius = static_cast<float>(radius * scale);
+  ball.Angle = static_cast<float>(orientation);
+  balls.push_back(ball);
+}
+
+static bool SameLines(const std::vector<Line> &a, const std::vector<Line> &b)
+{
+  if(a.size() != b.size())
+  {
+    return false;
+  }
+
+  for(unsigned int i = 0; i < a.size(); ++i)
+  {
+    if(a[i].GetStart().X != b[i].GetStart().X || a[i].GetStart().Y != b[i].GetStart().Y ||
+       a[i].GetEnd().X != b[i].GetEnd().X || a[i].GetEnd().Y != b[i].GetEnd().Y ||
+       a[i].GetColor() != b[i].GetColor())
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool SameBall(const SpriteInstance &a, const SpriteInstance &b)
+{
+  return a.X == b.X && a.Y == b.Y && a.Radius == b.Radius && a.Angle == b.Angle;
+}
+
+bool Renderer::NeedsRedraw() const
+{
+  return redrawAll || target != drawnTarget ||
+    background.GetWidth() != target->GetWidth() ||
+    background.GetHeight() != target->GetHeight() ||
+    clearColor != drawnClearColor ||
+    ballSprite.GetVersion() != drawnSpriteVersion ||
+    !SameLines(lines, drawnLines);
+}
+
+void Renderer::End()
+{
+  if(target == nullptr)
+  {
+    return;
+  }
+
+  PixelRect whole = target->GetRect();
+  dirtyRects.clear();
+
+  if(!incremental)
+  {
+    target->Clear(clearColor);
+    DrawLines(*target);
+    DrawBalls(whole);
+    DrawOverlay(whole);
+    dirtyRects.push_back(whole);
+  }
+  else if(NeedsRedraw())
+  {
+    // Lines only change now and then, draw them once into the background.
+    background.Resize(target->GetWidth(), target->GetHeight());
+    background.Clear(clearColor);
+    DrawLines(background);
+
+    target->Copy(background, whole);
+    DrawBalls(whole);
+    DrawOverlay(whole);
+    dirtyRects.push_back(whole);
+
+    drawnTarget = target;
+    drawnClearColor = clearColor;
+    drawnSpriteVersion = ballSprite.GetVersion();
+    drawnLines = lines;
+    redrawAll = false;
+
+    tilesX = (whole.Right + DirtyTileSize - 1) / DirtyTileSize;
+    tilesY = (whole.Bottom + DirtyTileSize - 1) / DirtyTileSize;
+    dirtyTiles.assign(tilesX * tilesY, 0);
+  }
+  else
+  {
+    // Where a ball was and where it is now both need drawing.
+    unsigned int common = static_cast<unsigned int>(std::min(balls.size(), drawnBalls.size()));
+    for(unsigned int i = 0; i < common; ++i)
+    {
+      if(!SameBall(balls[i], drawnBalls[i]))
+      {
+        MarkTiles(BoundsOf(drawnBalls[i]));
+        MarkTiles(BoundsOf(balls[i]));
+      }
+    }
+    for(unsigned int i = common; i < drawnBalls.size(); ++i)
+    {
+      MarkTiles(BoundsOf(drawnBalls[i]));
+    }
+    for(unsigned int i = common; i < balls.size(); ++i)
+    {
+      MarkTiles(BoundsOf(balls[i]));
+    }
+
+    // Runs of dirty tiles along each row of tiles.
+    for(int y = 0; y < tilesY; ++y)
+    {
+      for(int x = 0; x < tilesX; ++x)
+      {
+        if(!IsTileDirty(x, y))
+        {
+          continue;
+        }
+
+        int first = x;
+        while(x < tilesX && IsTileDirty(x, y))
+        {
+          x++;
+        }
+
+        PixelRect run(first * DirtyTileSize, y * DirtyTileSize, x * DirtyTileSize,
+          (y + 1) * DirtyTileSize);
+        dirtyRects.push_back(run.Intersect(whole));
+      }
+    }
+
+    for(const PixelRect &rect : dirtyRects)
+    {
+      target->Copy(background, rect);
+    }
+
+    // Balls that did not move may still overlap one that did.
+    if(!dirtyRects.empty())
+    {
+      for(const SpriteInstance &ball : balls)
+      {
+        DrawBallInDirtyTiles(ball);
+      }
+    }
+
+    for(const PixelRect &rect : dirtyRects)
+    {
+      DrawOverlay(rect);
+    }
+
+    std::fill(dirtyTiles.begin(), dirtyTiles.end(), 0);
+  }
+
+  drawnBalls = balls;
+  target = nullptr;
+}
+
+void Renderer::DrawLines(Framebuffer &into)
+{
+  for(const Line &line : lines)
+  {
+    Vector2D start = ToPixels(line.GetStart());
+    Vector2D end = ToPixels(line.GetEnd());
+
+    if(smoothLines)
+    {
+      DrawSmoothLine(into, static_cast<float>(start.X), static_cast<float>(start.Y),
+        static_cast<float>(end.X), static_cast<float>(end.Y), line.GetColor());
+    }
+    else
+    {
+      DrawLine(into, static_cast<float>(start.X), static_cast<float>(start.Y),
+        static_cast<float>(end.X), static_cast<float>(end.Y), line.GetColor());
+    }
+  }
+}
+
+void Renderer::DrawBalls(const PixelRect &clip)
+{
+  if(!cacheSprites)
+  {
+    if(!balls.empty())
+    {
+      DrawSprites(*target, ballSprite, &balls[0], static_cast<unsigned int>(balls.size()), clip);
+    }
+    return;
+  }
+
+  for(const SpriteInstance &ball : balls)
+  {
+    DrawBall(ball, clip);
+  }
+}
+
+void Renderer::DrawBall(const SpriteInstance &ball, const PixelRect &clip)
+{
+  unsigned int radius = cacheSprites ? static_cast<unsigned int>(ball.Radius + 0.5f) : 0;
+  const CachedSprite *cached = radius > 0 ? spriteCache.Find(ballSprite, radius, ball.Angle) : nullptr;
+  if(cached == nullptr)
+  {
+    DrawSprites(*target, ballSprite, &ball, 1, clip);
+    return;
+  }
+
+  // Rounded to the nearest whole pixel, like the radius.
+  int size = static_cast<int>(cached->Size);
+  int x = static_cast<int>(std::floor(ball.X + 0.5f)) - size / 2;
+  int y = static_cast<int>(std::floor(ball.Y + 0.5f)) - size / 2;
+
+  PixelRect inside = PixelRect(x, y, x + size, y + size).Intersect(clip);
+  if(inside.IsEmpty())
+  {
+    return;
+  }
+
+  const unsigned int *pixels = &cached->Pixels[0] + (inside.Top - y) * size + (inside.Left - x);
+  BlitImage(*target, pixels, inside.GetWidth(), inside.GetHeight(), size, inside.Left, inside.Top);
+}
+
+void Renderer::DrawBallInDirtyTiles(const SpriteInstance &ball)
+{
+  PixelRect bounds = BoundsOf(ball).Intersect(target->GetRect());
+  if(bounds.IsEmpty())
+  {
+    return;
+  }
+
+  int firstX = bounds.Left / DirtyTileSize;
+  int lastX = (bounds.Right - 1) / DirtyTileSize;
+  int firstY = bounds.Top / DirtyTileSize;
+  int lastY = (bounds.Bottom - 1) / DirtyTileSize;
+
+  for(int y = firstY; y <= lastY; ++y)
+  {
+    for(int x = firstX; x <= lastX; ++x)
+    {
+      if(!IsTileDirty(x, y))
+      {
+        continue;
+      }
+
+      int first = x;
+      while(x <= lastX && IsTileDirty(x, y))
+      {
+        x++;
+      }
+
+      PixelRect run(first * DirtyTileSize, y * DirtyTileSize, x * DirtyTileSize,
+        (y + 1) * DirtyTileSize);
+      DrawBall(ball, run.Intersect(bounds));
+    }
+  }
+}
+
+void Renderer::DrawOverlay(const PixelRect &rect)
+{
+  if(overlay == nullptr || overlay->GetWidth() != target->GetWidth() ||
+     overlay->GetHeight() != target->GetHeight())
+  {
+    return;
+  }
+
+  PixelRect inside = rect.Intersect(target->GetRect());
+  if(inside.IsEmpty())
+  {
+    return;
+  }
+
+  BlendKernel blend = GetBlendKernel();
+  for(int y = inside.Top; y < inside.Bottom; ++y)
+  {
+    const unsigned int *row = overlay->GetPixels() + y * overlay->GetWidth();
+    blend(row + inside.Left, target->GetRow(y) + inside.Left, inside.GetWidth());
+  }
+}
+
+PixelRect Renderer::BoundsOf(const SpriteInstance &ball) const
+{
+  // Rounding the radius and position and the filtered edge add up to two pixels.
+  float extent = ball.Radius + 2.0f;
+  return PixelRect(static_cast<int>(std::floor(ball.X - extent)),
+    static_cast<int>(std::floor(ball.Y - extent)),
+    static_cast<int>(std::ceil(ball.X + extent)) + 1,
+    static_cast<int>(std::ceil(ball.Y + extent)) + 1);
+}
+
+void Renderer::MarkTiles(const PixelRect &rect)
+{
+  PixelRect inside = rect.Intersect(PixelRect(0, 0, tilesX * DirtyTileSize, tilesY * DirtyTileSize));
+  if(inside.IsEmpty())
+  {
+    return;
+  }
+
+  for(int y = inside.Top / DirtyTileSize; y <= (inside.Bottom - 1) / DirtyTileSize; ++y)
+  {
+    for(int x = inside.Left / DirtyTileSize; x <= (inside.Right - 1) / DirtyTileSize; ++x)
+    {
+      dirtyTiles[y * tilesX + x] = 1;
+    }
+  }
+}
@@ -0,0 +1,165 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <vector>
+#include "Framebuffer.h"
+#include "Rasterizer.h"
+#include "SpriteCache.h"
+#include "Line.h"
+#include "Matrix3x3.h"
+#include "Vector2D.h"
+
+// Size of the tiles the screen is split into to keep track of what changed.
+const int DirtyTileSize = 32;
+
+/* Draws a scene of lines and balls into a framebuffer, without any
+ * window or graphics library. Lines and balls are collected between
+ * Begin and End and then drawn in one go, the lines first and every ball
+ * on top in a single batch. Positions are in meters and go through the
+ * view transform into pixels.
+ *
+ * Drawn incrementally, the lines are kept in a background of their own
+ * that is only redrawn when they change, and the target is assumed to
+ * still hold the last frame. Only tiles that a ball moved in or out of,
+ * or that were invalidated, are then drawn again: the background is
+ * copied back in, the balls over them drawn and the overlay blended on
+ * top. A frame costs about as much as the balls that moved, not the
+ * size of the screen. Balls are assumed to stay within their radius, as
+ * a round sprite does. */
+class Renderer
+{
+public:
+  // Constructor, balls are drawn with a made up ball until a sprite is set.
+  Renderer();
+
+  // Destructor
+  ~Renderer();
+
+  // The sprite balls are drawn with, loaded or made by the caller.
+  Sprite& GetBallSprite();
+
+  /* Balls are copied from turned and scaled copies of the sprite kept
+   * in the cache, rounded to whole pixels, unless it is turned off.
+   * Balls too big for the cache are drawn from the sprite. */
+  void SetCacheSprites(bool enabled);
+  bool GetCacheSprites() const;
+  SpriteCache& GetSpriteCache();
+
+  // Turns meters into pixels; it may scale, turn and flip.
+  void SetTransform(const Matrix3x3 &transform);
+  const Matrix3x3& GetTransform() const;
+
+  // Lines are drawn whole pixels at a time unless smoothed, like GDI+.
+  void SetSmoothLines(bool enabled);
+  bool GetSmoothLines() const;
+
+  // Off by default, every frame is then drawn from scratch.
+  void SetIncremental(bool enabled);
+  bool GetIncremental() const;
+
+  /* An image as big as the target blended over everything, such as text
+   * that changes now and then. Invalidate what changed in it. */
+  void SetOverlay(const Framebuffer *overlay);
+
+  // Makes the next frame draw a rectangle again.
+  void Invalidate(const PixelRect &rect);
+
+  // Starts a frame for a target.
+  void Begin(Framebuffer &target, unsigned int clearColor);
+
+  void AddLine(const Line &line);
+
+  // Orientation is in degrees, as kept in a BallStore.
+  void AddBall(const Vector2D &position, double radius, double orientation);
+
+  // Draws everything added since Begin.
+  void End();
+
+  // The parts of the target the last frame changed, all of it if drawn from scratch.
+  const std::vector<PixelRect>& GetDirtyRects() const;
+
+  // Returns where a point in meters ends up, in pixels.
+  Vector2D ToPixels(const Vector2D &position) const;
+
+private:
+  // Not copyable, a frame may be half done.
+  Renderer(const Renderer &);
+  Renderer& operator=(const Renderer &);
+
+  // Returns true if the background or everything on the target has to be redrawn.
+  bool NeedsRedraw() const;
+
+  void DrawLines(Framebuffer &into);
+
+  // Draws every ball, cut off at the rectangle.
+  void DrawBalls(const PixelRect &clip);
+  void DrawBall(const SpriteInstance &ball, const PixelRect &clip);
+
+  // Draws the parts of a ball that lie in dirty tiles.
+  void DrawBallInDirtyTiles(const SpriteInstance &ball);
+
+  void DrawOverlay(const PixelRect &rect);
+
+  // The pixels a ball may touch.
+  PixelRect BoundsOf(const SpriteInstance &ball) const;
+
+  void MarkTiles(const PixelRect &rect);
+  bool IsTileDirty(int x, int y) const;
+
+  Framebuffer *target;
+  unsigned int clearColor;
+  Sprite ballSprite;
+  Matrix3x3 transform;
+
+  // Pixels per meter, worked out from the transform.
+  double scale;
+  bool smoothLines;
+
+  SpriteCache spriteCache;
+  bool cacheSprites;
+
+  // Kept between frames so adding to them does not allocate.
+  std::vector<Line> lines;
+  std::vector<SpriteInstance> balls;
+
+  bool incremental;
+  const Framebuffer *overlay;
+  std::vector<PixelRect> dirtyRects;
+
+  // What the target holds from the last frame drawn incrementally.
+  Framebuffer background;
+  const Framebuffer *drawnTarget;
+  unsigned int drawnClearColor;
+  unsigned int drawnSpriteVersion;
+  std::vector<Line> drawnLines;
+  std::vector<SpriteInstance> drawnBalls;
+
+  // Set when a setting changes how everything looks.
+  bool redrawAll;
+
+  // One flag per tile, set for tiles to draw again.
+  std::vector<unsigned char> dirtyTiles;
+  int tilesX;
+  int tilesY;
+};
+
+// Inlined accessors
+inline Sprite& Renderer::GetBallSprite() { return ballSprite; }
+inline const Matrix3x3& Renderer::GetTransform() const { return transform; }
+inline bool Renderer::GetSmoothLines() const { return smoothLines; }
+inline SpriteCache& Renderer::GetSpriteCache() { return spriteCache; }
+inline bool Renderer::GetCacheSprites() const { return cacheSprites; }
+inline bool Renderer::GetIncremental() const { return incremental; }
+inline const std::vector<PixelRect>& Renderer::GetDirtyRects() const { return dirtyRects; }
+
+inline Vector2D Renderer::ToPixels(const Vector2D &position) const
+{
+  return Vector2D::Transform(position, transform);
+}
+
+inline bool Renderer::IsTileDirty(int x, int y) const
+{
+  return dirtyTiles[y * tilesX + x] != 0;
+}
+
+#endif
@@ -0,0 +1,248 @@
+#include "SimulationThread.h"
+#include <chrono>
+#include <cmath>
+#include "World.h"
+#include "StepScheduler.h"
+#include "GameTimer.h"
+
+// How long the thread sleeps when no step is due yet.
+const std::chrono::milliseconds IdleTime(1);
+
+SimCommand::SimCommand(SimCommandType type)
+{
+  Type = type;
+  Mass = 0.0;
+  Radius = 0.0;
+  Position = Vector2D(0, 0);
+  Value = 0.0;
+  Path = nullptr;
+}
+
+FrameState::FrameState()
+{
+  Alpha = 0.0;
+  StepTime = 0.01;
+  Tick = 0;
+  BallCollisions = true;
+  Lockstep = false;
+  Restitution = 1.0;
+  StepCount = 0;
+  StateHash = 0;
+
+  for(unsigned int i = 0; i < CounterCount; ++i)
+  {
+    Counts[i] = 0;
+  }
+}
+
+double FrameState::GetAlpha(long long now) const
+{
+  // A lockstep frame shows the step it was hashed at, until the next one.
+  if(Lockstep)
+  {
+    return 1.0;
+  }
+
+  // The simulation kept going since it published this.
+  double alpha = Alpha + GameTimer::TicksToSeconds(now - Tick) / StepTime;
+  return alpha < 1.0 ? alpha : 1.0;
+}
+
+SimulationThread::SimulationThread(World &world, StepScheduler &scheduler, Profiler *profiler)
+  : world(world), scheduler(scheduler)
+{
+  this->profiler = profiler;
+  running.store(false);
+
+  for(unsigned int i = 0; i < CounterCount; ++i)
+  {
+    stepCounts[i] = 0;
+  }
+}
+
+SimulationThread::~SimulationThread()
+{
+  Stop();
+}
+
+void SimulationThread::Start()
+{
+  if(IsRunning())
+  {
+    return;
+  }
+
+  // The first frame is there before the thread is.
+  RunCommands();
+  Publish();
+
+  running.store(true);
+  thread = std::thread(&SimulationThread::Loop, this);
+}
+
+void SimulationThread::Stop()
+{
+  running.store(false);
+  if(thread.joinable())
+  {
+    thread.join();
+  }
+}
+
+const FrameState& SimulationThread::AcquireFrame()
+{
+  frames.Acquire();
+  return frames.GetReadBuffer();
+}
+
+void SimulationThread::Loop()
+{
+  GameTimer timer;
+  timer.Start();
+  scheduler.Reset();
+
+  while(running.load(std::memory_order_relaxed))
+  {
+    if(profiler)
+    {
+      profiler->BeginFrame("simulation");
+    }
+
+    unsigned int changes;
+    {
+      ProfileScope zone(profiler, "commands");
+      changes = RunCommands();
+    }
+
+    // In lockstep the next step waits until the last one has been drawn.
+    double delta = timer.DeltaTime();
+    unsigned int steps = 0;
+    if(!scheduler.GetLockstep() || !frames.IsPending())
+    {
+      ProfileScope zone(profiler, "steps");
+      steps = scheduler.Advance(world, delta);
+    }
+
+    if(profiler)
+    {
+      profiler->EndFrame();
+    }
+
+    if(steps > 0)
+    {
+      KeepProfile();
+    }
+
+    if(steps > 0 || changes > 0)
+    {
+      Publish();
+    }
+    else
+    {
+      std::this_thread::sleep_for(IdleTime);
+    }
+  }
+}
+
+unsigned int SimulationThread::RunCommands()
+{
+  unsigned int count = 0;
+  SimCommand command;
+  while(commands.Pop(command))
+  {
+    RunCommand(command);
+    count++;
+  }
+
+  return count;
+}
+
+void SimulationThread::RunCommand(const SimCommand &command)
+{
+  switch(command.Type)
+  {
+  case CommandClearBalls:
+    world.ClearBalls();
+    break;
+  case CommandAddBall:
+    world.AddBall(command.Mass, command.Radius, command.Position);
+    break;
+  case CommandToggleBallCollisions:
+    world.SetBallCollisions(!world.GetBallCollisions());
+    break;
+  case CommandToggleLockstep:
+    scheduler.SetLockstep(!scheduler.GetLockstep());
+    break;
+  case CommandChangeRestitution:
+    world.SetRestitution(world.GetRestitution() + command.Value);
+    break;
+  case CommandSaveSnapshot:
+    world.SaveSnapshot(command.Path);
+    break;
+  case CommandLoadSnapshot:
+    // The time collected for the old state has nothing to do with the new one.
+    if(world.LoadSnapshot(command.Path))
+    {
+      scheduler.Reset();
+    }
+    break;
+  }
+}
+
+void SimulationThread::KeepProfile()
+{
+  if(!profiler)
+  {
+    return;
+  }
+
+  stepZones = profiler->GetLastFrame();
+  for(unsigned int i = 0; i < CounterCount; ++i)
+  {
+    stepCounts[i] = profiler->GetLastCount(static_cast<ProfileCounter>(i));
+  }
+}
+
+void SimulationThread::Publish()
+{
+  FrameState &frame = frames.GetWriteBuffer();
+  const BallStore &balls = world.GetBalls();
+
+  // Assigning keeps the memory of the copy, it was published before.
+  frame.PreviousPosition = balls.PreviousPosition;
+  frame.Position = balls.Position;
+  frame.PreviousOrientation = balls.PreviousOrientation;
+  frame.Orientation = balls.Orientation;
+  frame.Radius = balls.Radius;
+  frame.Lines = world.GetLines();
+
+  unsigned int count = balls.Count();
+  frame.Handles.resize(count);
+  frame.Grid.Clear();
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    frame.Handles[i] = balls.HandleOf(i);
+
+    double moved = std::sqrt((balls.Position[i] - balls.PreviousPosition[i]).LengthSquared());
+    frame.Grid.Insert(i, balls.Position[i], balls.Radius[i] + moved);
+  }
+  frame.Grid.Build();
+
+  frame.Alpha = scheduler.GetAlpha();
+  frame.StepTime = scheduler.GetStepTime();
+  frame.Tick = GameTimer::Now();
+
+  frame.BallCollisions = world.GetBallCollisions();
+  frame.Lockstep = scheduler.GetLockstep();
+  frame.Restitution = world.GetRestitution();
+  frame.StepCount = scheduler.GetStepCount();
+  frame.StateHash = frame.Lockstep ? world.ComputeStateHash() : 0;
+
+  frame.Zones = stepZones;
+  for(unsigned int i = 0; i < CounterCount; ++i)
+  {
+    frame.Counts[i] = stepCounts[i];
+  }
+
+  frames.Publish();
+}
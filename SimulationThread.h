@@ -0,0 +1,165 @@
+#ifndef SIMULATIONTHREAD_H
+#define SIMULATIONTHREAD_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "CommandQueue.h"
+#include "TripleBuffer.h"
+#include "BallStore.h"
+#include "BroadPhase.h"
+#include "Line.h"
+#include "Profiler.h"
+#include "Vector2D.h"
+
+class World;
+class StepScheduler;
+
+// What a SimCommand asks the simulation to do.
+enum SimCommandType
+{
+  CommandClearBalls,
+
+  // Adds a ball of Mass and Radius at Position.
+  CommandAddBall,
+
+  CommandToggleBallCollisions,
+  CommandToggleLockstep,
+
+  // Adds Value to the restitution of every line.
+  CommandChangeRestitution,
+
+  // Saves or loads the world to or from the snapshot file at Path.
+  CommandSaveSnapshot,
+  CommandLoadSnapshot
+};
+
+/* A change to the world asked for by another thread, applied by the
+ * simulation thread between two steps. */
+struct SimCommand
+{
+  // Constructor, the fields the type does not use are zero.
+  SimCommand(SimCommandType type = CommandClearBalls);
+
+  SimCommandType Type;
+  double Mass;
+  double Radius;
+  Vector2D Position;
+  double Value;
+
+  // Not copied, use a string that outlives the command.
+  const char *Path;
+};
+
+/* The state of the world after a step, as much as is needed to draw it.
+ * Balls are kept at the last two steps so they can be blended. */
+struct FrameState
+{
+  // Constructor, an empty world.
+  FrameState();
+
+  std::vector<Vector2D> PreviousPosition;
+  std::vector<Vector2D> Position;
+  std::vector<double> PreviousOrientation;
+  std::vector<double> Orientation;
+  std::vector<double> Radius;
+  std::vector<BallHandle> Handles;
+  std::vector<Line> Lines;
+
+  /* Every ball by where it is, with its radius grown by how far it moved
+   * in the last step, so the balls in view can be found wherever between
+   * the two steps they are drawn. Built on the simulation thread. */
+  UniformGrid Grid;
+
+  // How far past the last step the simulation was when it was published.
+  double Alpha;
+  double StepTime;
+  long long Tick;
+
+  bool BallCollisions;
+  bool Lockstep;
+  double Restitution;
+  unsigned int StepCount;
+
+  // Only worked out in lockstep, zero otherwise.
+  unsigned long long StateHash;
+
+  // The zones and counters of the last simulation frame.
+  std::vector<ProfileZone> Zones;
+  unsigned long long Counts[CounterCount];
+
+  // How far to blend from the previous to the current step at a tick.
+  double GetAlpha(long long now) const;
+};
+
+/* Steps a world on a thread of its own, so drawing it does not hold the
+ * physics back and the other way round.
+ *
+ * Once started the thread owns the world and the scheduler; nothing else
+ * may touch them until it is stopped. Other threads change the world by
+ * posting commands, which wait in a lock-free queue until the next step,
+ * and read it from FrameStates published through a triple buffer after
+ * every step. Only one thread may post and only one may read frames.
+ *
+ * In lockstep the thread waits for every frame to be picked up before it
+ * takes the next step, so there is still one step per frame drawn. */
+class SimulationThread
+{
+public:
+  // Constructor, the profiler may be null.
+  SimulationThread(World &world, StepScheduler &scheduler, Profiler *profiler);
+
+  // Destructor, stops the thread.
+  ~SimulationThread();
+
+  // Publishes the current state and starts stepping in real time.
+  void Start();
+
+  // Waits for the thread to finish its step, the world is free again.
+  void Stop();
+  bool IsRunning() const;
+
+  /* Queues a command for the next step. Returns false and drops it if
+   * the queue is full. Commands posted before Start run when it starts. */
+  bool Post(const SimCommand &command);
+
+  // Returns the latest state published.
+  const FrameState& AcquireFrame();
+
+private:
+  // Not copyable, it owns a thread.
+  SimulationThread(const SimulationThread &);
+  SimulationThread& operator=(const SimulationThread &);
+
+  void Loop();
+
+  // Runs the commands waiting, returns the number run.
+  unsigned int RunCommands();
+  void RunCommand(const SimCommand &command);
+
+  // Copies the world into the write buffer and publishes it.
+  void Publish();
+
+  // Keeps the profile of the last frame that took a step.
+  void KeepProfile();
+
+  World &world;
+  StepScheduler &scheduler;
+  Profiler *profiler;
+
+  std::thread thread;
+  std::atomic<bool> running;
+
+  CommandQueue<SimCommand, 256> commands;
+  TripleBuffer<FrameState> frames;
+
+  // Frames without a step would hide the ones with, so these are shown.
+  std::vector<ProfileZone> stepZones;
+  unsigned long long stepCounts[CounterCount];
+};
+
+// Inlined accessors
+inline bool SimulationThread::IsRunning() const { return running.load(std::memory_order_relaxed); }
+inline bool SimulationThread::Post(const SimCommand &command) { return commands.Push(command); }
+
+#endif
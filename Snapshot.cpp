@@ -0,0 +1,203 @@
+#include "Snapshot.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SnapshotWriter::SnapshotWriter(std::vector<unsigned char> &buffer)
+  : buffer(buffer)
+{
+  buffer.clear();
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+
+}
+
+void SnapshotWriter::Write(const void *data, size_t size)
+{
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+void SnapshotWriter::Write(bool value)
+{
+  buffer.push_back(value ? 1 : 0);
+}
+
+SnapshotReader::SnapshotReader(const unsigned char *data, size_t size)
+{
+  this->data = data;
+  this->size = size;
+  offset = 0;
+  valid = data != nullptr;
+}
+
+SnapshotReader::~SnapshotReader()
+{
+
+}
+
+bool SnapshotReader::Read(void *data, size_t size)
+{
+  if(!valid || size > this->size - offset)
+  {
+    valid = false;
+    return false;
+  }
+
+  memcpy(data, this->data + offset, size);
+  offset += size;
+  return true;
+}
+
+bool SnapshotReader::Read(bool &value)
+{
+  unsigned char byte = 0;
+  if(!Read(&byte, 1) || byte > 1)
+  {
+    valid = false;
+    return false;
+  }
+
+  value = byte == 1;
+  return true;
+}
+
+MappedFile::MappedFile()
+{
+  data = nullptr;
+  size = 0;
+
+#ifdef _WIN32
+  file = INVALID_HANDLE_VALUE;
+  mapping = nullptr;
+#else
+  file = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const char *path)
+{
+  Close();
+
+  file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if(file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+
+  LARGE_INTEGER fileSize;
+  if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+  {
+    Close();
+    return false;
+  }
+
+  mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if(mapping == nullptr)
+  {
+    Close();
+    return false;
+  }
+
+  data = static_cast<const unsigned char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if(data == nullptr)
+  {
+    Close();
+    return false;
+  }
+
+  size = static_cast<size_t>(fileSize.QuadPart);
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if(data != nullptr)
+  {
+    UnmapViewOfFile(data);
+  }
+
+  if(mapping != nullptr)
+  {
+    CloseHandle(mapping);
+  }
+
+  if(file != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(file);
+  }
+
+  data = nullptr;
+  size = 0;
+  file = INVALID_HANDLE_VALUE;
+  mapping = nullptr;
+}
+
+#else
+
+bool MappedFile::Open(const char *path)
+{
+  Close();
+
+  file = open(path, O_RDONLY);
+  if(file < 0)
+  {
+    return false;
+  }
+
+  struct stat info;
+  if(fstat(file, &info) != 0 || info.st_size <= 0)
+  {
+    Close();
+    return false;
+  }
+
+  void *mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+  if(mapped == MAP_FAILED)
+  {
+    Close();
+    return false;
+  }
+
+  // Snapshots are read front to back exactly once.
+  madvise(mapped, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+
+  data = static_cast<const unsigned char *>(mapped);
+  size = static_cast<size_t>(info.st_size);
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if(data != nullptr)
+  {
+    munmap(const_cast<unsigned char *>(data), size);
+  }
+
+  if(file >= 0)
+  {
+    close(file);
+  }
+
+  data = nullptr;
+  size = 0;
+  file = -1;
+}
+
+#endif
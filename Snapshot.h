@@ -0,0 +1,179 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+
+/* Snapshots store the state of a World as raw arrays in the byte order
+ * and layout of the machine that wrote them. They start with a header
+ * holding this version and the sizes of the stored structs, and are
+ * refused if any of these differ. Bump the version whenever the layout
+ * of a snapshot changes. */
+const unsigned int SnapshotMagic = 0x534C4C42;
+const unsigned int SnapshotVersion = 4;
+
+/* Appends values and whole arrays to a byte buffer.
+ * Arrays are copied in one go, so writing a snapshot costs a handful of
+ * copies no matter how many balls there are. */
+class SnapshotWriter
+{
+public:
+  // Constructor, the buffer is cleared.
+  SnapshotWriter(std::vector<unsigned char> &buffer);
+
+  // Destructor
+  ~SnapshotWriter();
+
+  void Write(const void *data, size_t size);
+
+  template<typename T>
+  void Write(const T &value);
+
+  // Bools are written as a byte of 0 or 1, whatever size they have.
+  void Write(bool value);
+
+  // Writes the number of elements followed by the elements.
+  template<typename T>
+  void WriteArray(const std::vector<T> &values);
+
+private:
+  std::vector<unsigned char> &buffer;
+};
+
+/* Reads back what a SnapshotWriter wrote, from memory it does not own.
+ * Reading past the end fails and every read after that fails as well,
+ * so callers can check once at the end. */
+class SnapshotReader
+{
+public:
+  // Constructor
+  SnapshotReader(const unsigned char *data, size_t size);
+
+  // Destructor
+  ~SnapshotReader();
+
+  bool Read(void *data, size_t size);
+
+  template<typename T>
+  bool Read(T &value);
+
+  // Fails unless the byte read is 0 or 1.
+  bool Read(bool &value);
+
+  /* Reads an array written by WriteArray, resizing values to fit with
+   * fill. Fails if the array does not have exactly count elements. */
+  template<typename T>
+  bool ReadArray(std::vector<T> &values, size_t count, const T &fill = T());
+
+  // Same as above, for arrays of any size that fits in the data left.
+  template<typename T>
+  bool ReadArray(std::vector<T> &values);
+
+  // Returns false once any read has failed.
+  bool IsValid() const;
+
+  // Returns how many bytes are left to read.
+  size_t GetRemaining() const;
+
+private:
+  const unsigned char *data;
+  size_t size;
+  size_t offset;
+  bool valid;
+};
+
+/* A file mapped into memory read only. Large snapshots are read straight
+ * from the page cache instead of being copied into a buffer first. */
+class MappedFile
+{
+public:
+  // Constructor
+  MappedFile();
+
+  // Destructor
+  ~MappedFile();
+
+  // Maps the whole file, returns false if it cannot be opened or is empty.
+  bool Open(const char *path);
+  void Close();
+
+  // Accessors
+  const unsigned char* GetData() const;
+  size_t GetSize() const;
+
+private:
+  // Not copyable, the mapping belongs to one object.
+  MappedFile(const MappedFile &);
+  MappedFile& operator=(const MappedFile &);
+
+  const unsigned char *data;
+  size_t size;
+
+#ifdef _WIN32
+  void *file;
+  void *mapping;
+#else
+  int file;
+#endif
+};
+
+template<typename T>
+inline void SnapshotWriter::Write(const T &value)
+{
+  Write(&value, sizeof(T));
+}
+
+template<typename T>
+inline void SnapshotWriter::WriteArray(const std::vector<T> &values)
+{
+  unsigned int count = static_cast<unsigned int>(values.size());
+  Write(count);
+  if(count > 0)
+  {
+    Write(static_cast<const void *>(values.data()), count * sizeof(T));
+  }
+}
+
+template<typename T>
+inline bool SnapshotReader::Read(T &value)
+{
+  return Read(&value, sizeof(T));
+}
+
+template<typename T>
+inline bool SnapshotReader::ReadArray(std::vector<T> &values, size_t count, const T &fill)
+{
+  // The count is checked against what is left before it is multiplied.
+  unsigned int stored = 0;
+  if(!Read(stored) || stored != count || count > (size - offset) / sizeof(T))
+  {
+    valid = false;
+    return false;
+  }
+
+  values.resize(count, fill);
+  return count == 0 || Read(static_cast<void *>(values.data()), count * sizeof(T));
+}
+
+template<typename T>
+inline bool SnapshotReader::ReadArray(std::vector<T> &values)
+{
+  unsigned int stored = 0;
+  if(!Read(stored) || stored > (size - offset) / sizeof(T))
+  {
+    valid = false;
+    return false;
+  }
+
+  values.resize(stored);
+  return stored == 0 || Read(static_cast<void *>(values.data()), stored * sizeof(T));
+}
+
+// Inlined accessors
+inline bool SnapshotReader::IsValid() const { return valid; }
+inline size_t SnapshotReader::GetRemaining() const { return size - offset; }
+inline const unsigned char* MappedFile::GetData() const { return data; }
+inline size_t MappedFile::GetSize() const { return size; }
+
+#endif
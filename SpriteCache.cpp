@@ -0,0 +1,242 @@
+#include "SpriteCache.h"
+#include <cmath>
+#include "Rasterizer.h"
+
+SpriteCache::SpriteCache(size_t budget, unsigned int angleSteps)
+{
+  this->budget = budget;
+  this->angleSteps = angleSteps > 0 ? angleSteps : 1;
+  used = 0;
+  newest = nullptr;
+  oldest = nullptr;
+  count = 0;
+  source = nullptr;
+  sourceVersion = 0;
+  hits = 0;
+  misses = 0;
+
+  table.assign(MaxCachedRadius * this->angleSteps, nullptr);
+}
+
+SpriteCache::~SpriteCache()
+{
+  Clear();
+}
+
+void SpriteCache::SetBudget(size_t bytes)
+{
+  budget = bytes;
+  MakeRoom(0);
+}
+
+void SpriteCache::Clear()
+{
+  while(newest)
+  {
+    CachedSprite *sprite = newest;
+    newest = sprite->Older;
+    table[sprite->Key] = nullptr;
+    delete sprite;
+  }
+
+  oldest = nullptr;
+  count = 0;
+  used = 0;
+}
+
+// Bytes a sprite takes up, pixels and all.
+static size_t SizeOf(const CachedSprite &sprite)
+{
+  return sizeof(CachedSprite) + sprite.Pixels.size() * sizeof(unsigned int);
+}
+
+// The angle step closest to an angle in degrees.
+static unsigned int StepOf(double angle, unsigned int steps)
+{
+  double turn = std::fmod(angle, 360.0);
+  if(turn < 0.0)
+  {
+    turn += 360.0;
+  }
+
+  unsigned int step = static_cast<unsigned int>(std::floor(turn / 360.0 * steps + 0.5));
+  return step < steps ? step : 0;
+}
+
+const CachedSprite *SpriteCache::Find(const Sprite &source, unsigned int radius, double angle)
+{
+  if(radius == 0 || radius > MaxCachedRadius)
+  {
+    return nullptr;
+  }
+
+  CheckSource(source);
+
+  unsigned int step = StepOf(angle, angleSteps);
+  unsigned int key = KeyOf(radius, step);
+  CachedSprite *sprite = table[key];
+
+  if(sprite)
+  {
+    hits++;
+    Unlink(sprite);
+    LinkNewest(sprite);
+  }
+  else
+  {
+    misses++;
+    sprite = new CachedSprite();
+    Render(source, radius, step, *sprite);
+    sprite = Insert(key, sprite);
+  }
+
+  return sprite;
+}
+
+void SpriteCache::Prepare(const Sprite &source, const std::vector<unsigned int> &radii, ThreadPool *pool)
+{
+  CheckSource(source);
+
+  // Every angle of every radius that is not there yet.
+  std::vector<unsigned int> missing;
+  for(unsigned int radius : radii)
+  {
+    if(radius == 0 || radius > MaxCachedRadius)
+    {
+      continue;
+    }
+
+    for(unsigned int step = 0; step < angleSteps; ++step)
+    {
+      unsigned int key = KeyOf(radius, step);
+      if(table[key] == nullptr)
+      {
+        missing.push_back(key);
+      }
+    }
+  }
+
+  // Drawing only reads the source, so the sprites can be drawn at once.
+  std::vector<CachedSprite *> drawn(missing.size(), nullptr);
+  ParallelFor(pool, static_cast<unsigned int>(missing.size()), 1,
+    [&](unsigned int begin, unsigned int end)
+  {
+    for(unsigned int i = begin; i < end; ++i)
+    {
+      drawn[i] = new CachedSprite();
+      Render(source, missing[i] / angleSteps + 1, missing[i] % angleSteps, *drawn[i]);
+    }
+  });
+
+  for(unsigned int i = 0; i < missing.size(); ++i)
+  {
+    Insert(missing[i], drawn[i]);
+  }
+}
+
+void SpriteCache::Render(const Sprite &source, unsigned int radius, unsigned int step,
+                         CachedSprite &sprite) const
+{
+  // A pixel to spare on each side for the filtered edge.
+  unsigned int size = 2 * radius + 2;
+  Framebuffer target(size, size);
+
+  SpriteInstance instance;
+  instance.X = size * 0.5f;
+  instance.Y = size * 0.5f;
+  instance.Radius = static_cast<float>(radius);
+  instance.Angle = static_cast<float>(step * 360.0 / angleSteps);
+  DrawSprites(target, source, &instance, 1);
+
+  sprite.Size = size;
+  sprite.Pixels.assign(target.GetPixels(), target.GetPixels() + size * size);
+  sprite.Key = 0;
+  sprite.Newer = nullptr;
+  sprite.Older = nullptr;
+}
+
+void SpriteCache::CheckSource(const Sprite &source)
+{
+  if(this->source != &source || sourceVersion != source.GetVersion())
+  {
+    Clear();
+    this->source = &source;
+    sourceVersion = source.GetVersion();
+  }
+}
+
+CachedSprite *SpriteCache::Insert(unsigned int key, CachedSprite *sprite)
+{
+  size_t size = SizeOf(*sprite);
+  if(!MakeRoom(size))
+  {
+    delete sprite;
+    return nullptr;
+  }
+
+  sprite->Key = key;
+  table[key] = sprite;
+  LinkNewest(sprite);
+  count++;
+  used += size;
+  return sprite;
+}
+
+bool SpriteCache::MakeRoom(size_t bytes)
+{
+  if(bytes > budget)
+  {
+    return false;
+  }
+
+  while(used + bytes > budget && oldest)
+  {
+    CachedSprite *sprite = oldest;
+    Unlink(sprite);
+    table[sprite->Key] = nullptr;
+    used -= SizeOf(*sprite);
+    count--;
+    delete sprite;
+  }
+
+  return true;
+}
+
+void SpriteCache::Unlink(CachedSprite *sprite)
+{
+  if(sprite->Newer)
+  {
+    sprite->Newer->Older = sprite->Older;
+  }
+  else
+  {
+    newest = sprite->Older;
+  }
+
+  if(sprite->Older)
+  {
+    sprite->Older->Newer = sprite->Newer;
+  }
+  else
+  {
+    oldest = sprite->Newer;
+  }
+
+  sprite->Newer = nullptr;
+  sprite->Older = nullptr;
+}
+
+void SpriteCache::LinkNewest(CachedSprite *sprite)
+{
+  sprite->Newer = nullptr;
+  sprite->Older = newest;
+  if(newest)
+  {
+    newest->Newer = sprite;
+  }
+  else
+  {
+    oldest = sprite;
+  }
+  newest = sprite;
+}
@@ -0,0 +1,126 @@
+#ifndef SPRITECACHE_H
+#define SPRITECACHE_H
+
+#include <cstddef>
+#include <vector>
+#include "Framebuffer.h"
+#include "ThreadPool.h"
+
+// Largest radius in pixels that is cached, bigger sprites are drawn directly.
+const unsigned int MaxCachedRadius = 128;
+
+// A turn is split into this many angles by default, five degrees apart.
+const unsigned int DefaultAngleSteps = 72;
+
+// Memory the cached sprites may take up by default, in bytes.
+const size_t DefaultSpriteBudget = 32 * 1024 * 1024;
+
+/* A sprite drawn ahead of time at one size and angle, ready to be copied
+ * to the screen as it is. The middle of the sprite lies at Size / 2. */
+struct CachedSprite
+{
+  unsigned int Size;
+  std::vector<unsigned int> Pixels;
+
+  // Where the cache keeps it, and its neighbours in order of use.
+  unsigned int Key;
+  CachedSprite *Newer;
+  CachedSprite *Older;
+};
+
+/* Keeps a sprite scaled to whole pixel radii and turned to a fixed
+ * number of angles, so drawing it is a plain copy. Balls only come in a
+ * few sizes and an angle a few degrees off does not show, so a small set
+ * of these covers every ball on the screen.
+ *
+ * Sprites are drawn the first time they are asked for, or ahead of time
+ * for a set of radii. Once they take up more than the budget the least
+ * recently used are thrown away. Changing the source sprite empties the
+ * cache. Not safe to use from more than one thread at a time. */
+class SpriteCache
+{
+public:
+  // Constructor
+  SpriteCache(size_t budget = DefaultSpriteBudget, unsigned int angleSteps = DefaultAngleSteps);
+
+  // Destructor
+  ~SpriteCache();
+
+  // Throws sprites away until the rest fits.
+  void SetBudget(size_t bytes);
+  size_t GetBudget() const;
+  size_t GetMemoryUsed() const;
+
+  unsigned int GetAngleSteps() const;
+  unsigned int GetCount() const;
+
+  // How often Find had the sprite already and how often it had to draw it.
+  unsigned long long GetHits() const;
+  unsigned long long GetMisses() const;
+
+  void Clear();
+
+  /* Returns the source at a radius in pixels, turned by the angle in
+   * degrees rounded to the nearest step, drawing it if need be. Returns
+   * null if the radius is zero or above MaxCachedRadius, or if the
+   * sprite does not fit in the budget. */
+  const CachedSprite *Find(const Sprite &source, unsigned int radius, double angle);
+
+  // Draws every angle of a set of radii ahead of time, spread over the pool.
+  void Prepare(const Sprite &source, const std::vector<unsigned int> &radii, ThreadPool *pool);
+
+private:
+  // Not copyable, it owns the sprites.
+  SpriteCache(const SpriteCache &);
+  SpriteCache& operator=(const SpriteCache &);
+
+  unsigned int KeyOf(unsigned int radius, unsigned int step) const;
+
+  // Draws the source at a radius and angle step into a sprite.
+  void Render(const Sprite &source, unsigned int radius, unsigned int step,
+              CachedSprite &sprite) const;
+
+  // Empties the cache if the source is not the one the sprites came from.
+  void CheckSource(const Sprite &source);
+
+  // Keeps a drawn sprite if there is room for it, returns null if not.
+  CachedSprite *Insert(unsigned int key, CachedSprite *sprite);
+
+  // Throws away the least recently used until bytes more would fit.
+  bool MakeRoom(size_t bytes);
+
+  // Takes a sprite out of the order of use, or puts it in front.
+  void Unlink(CachedSprite *sprite);
+  void LinkNewest(CachedSprite *sprite);
+
+  size_t budget;
+  size_t used;
+  unsigned int angleSteps;
+
+  // One slot per radius and angle step, null until drawn.
+  std::vector<CachedSprite *> table;
+
+  /* The sprites in use, linked from the most to the least recently used,
+   * so a hit and throwing away the oldest take the same time however
+   * many sprites there are. */
+  CachedSprite *newest;
+  CachedSprite *oldest;
+  unsigned int count;
+
+  const Sprite *source;
+  unsigned int sourceVersion;
+
+  unsigned long long hits;
+  unsigned long long misses;
+};
+
+// Inlined accessors
+inline size_t SpriteCache::GetBudget() const { return budget; }
+inline size_t SpriteCache::GetMemoryUsed() const { return used; }
+inline unsigned int SpriteCache::GetAngleSteps() const { return angleSteps; }
+inline unsigned int SpriteCache::GetCount() const { return count; }
+inline unsigned long long SpriteCache::GetHits() const { return hits; }
+inline unsigned long long SpriteCache::GetMisses() const { return misses; }
+inline unsigned int SpriteCache::KeyOf(unsigned int radius, unsigned int step) const { return (radius - 1) * angleSteps + step; }
+
+#endif
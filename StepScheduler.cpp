@@ -0,0 +1,95 @@
+#include "StepScheduler.h"
+#include <cmath>
+#include "World.h"
+
+StepScheduler::StepScheduler(double stepTime, unsigned int substeps,
+                             unsigned int maxStepsPerFrame)
+{
+  this->stepTime = stepTime > 0.0 ? stepTime : 0.01;
+  this->substeps = substeps > 0 ? substeps : 1;
+  this->maxStepsPerFrame = maxStepsPerFrame > 0 ? maxStepsPerFrame : 1;
+  lockstep = false;
+  stepCount = 0;
+  accumulator = 0.0;
+  droppedTime = 0.0;
+}
+
+StepScheduler::~StepScheduler()
+{
+
+}
+
+unsigned int StepScheduler::Advance(World &world, double elapsed)
+{
+  // Pretend exactly one step worth of time has passed.
+  if(lockstep)
+  {
+    accumulator = 0.0;
+    elapsed = stepTime;
+  }
+
+  if(elapsed > 0.0)
+  {
+    accumulator += elapsed;
+  }
+
+  double substepTime = stepTime / substeps;
+  unsigned int steps = 0;
+
+  while(accumulator >= stepTime && steps < maxStepsPerFrame)
+  {
+    // Keep the state we are stepping away from for interpolation.
+    world.StorePreviousState();
+
+    for(unsigned int i = 0; i < substeps; ++i)
+    {
+      world.Step(substepTime);
+    }
+
+    accumulator -= stepTime;
+    steps++;
+    stepCount++;
+  }
+
+  // Out of budget, drop whatever full steps are left so we don't
+  // fall further and further behind.
+  if(accumulator >= stepTime)
+  {
+    double kept = std::fmod(accumulator, stepTime);
+    droppedTime += accumulator - kept;
+    accumulator = kept;
+  }
+
+  return steps;
+}
+
+void StepScheduler::Reset()
+{
+  accumulator = 0.0;
+}
+
+void StepScheduler::SetLockstep(bool enabled)
+{
+  lockstep = enabled;
+  accumulator = 0.0;
+}
+
+void StepScheduler::SetStepTime(double stepTime)
+{
+  if(stepTime > 0.0)
+  {
+    // Keep the same fraction of a step, so the blend stays below one.
+    accumulator *= stepTime / this->stepTime;
+    this->stepTime = stepTime;
+  }
+}
+
+void StepScheduler::SetSubsteps(unsigned int substeps)
+{
+  this->substeps = substeps > 0 ? substeps : 1;
+}
+
+void StepScheduler::SetMaxStepsPerFrame(unsigned int maxSteps)
+{
+  maxStepsPerFrame = maxSteps > 0 ? maxSteps : 1;
+}
@@ -0,0 +1,78 @@
+#ifndef STEPSCHEDULER_H
+#define STEPSCHEDULER_H
+
+class World;
+
+/* Drives a World with a fixed timestep, no matter how long frames take.
+ * Real time is collected in an accumulator and spent in whole steps, each
+ * of which may be split into a number of equal substeps. How many steps
+ * may be taken in one frame is capped, so a frame that takes too long
+ * does not make the next one even slower; whatever does not fit within
+ * the cap is dropped and reported. The time left over in the accumulator
+ * tells the renderer how far to blend from the previous to the current
+ * state. */
+class StepScheduler
+{
+public:
+  // Constructor
+  StepScheduler(double stepTime = 0.01, unsigned int substeps = 1,
+                unsigned int maxStepsPerFrame = 8);
+
+  // Destructor
+  ~StepScheduler();
+
+  /* Adds elapsed real time and runs all steps that are due.
+   * Returns the number of steps taken. */
+  unsigned int Advance(World &world, double elapsed);
+
+  // Throws away any time collected but not yet simulated.
+  void Reset();
+
+  /* In lockstep every call to Advance takes exactly one step, however
+   * much time has passed. The simulation no longer keeps up with the
+   * clock, but the same input on the same frames always gives the same
+   * result, whatever the machine and its frame rate. */
+  void SetLockstep(bool enabled);
+  bool GetLockstep() const;
+
+  // Returns the number of steps taken since the scheduler was made.
+  unsigned int GetStepCount() const;
+
+  /* Returns how far the simulation is between the previous and the
+   * current step, from 0 up to but not including 1. */
+  double GetAlpha() const;
+
+  // Accessors
+  double GetStepTime() const;
+  unsigned int GetSubsteps() const;
+  unsigned int GetMaxStepsPerFrame() const;
+  double GetDroppedTime() const;
+
+  void SetStepTime(double stepTime);
+  void SetSubsteps(unsigned int substeps);
+  void SetMaxStepsPerFrame(unsigned int maxSteps);
+
+private:
+  double stepTime;
+  unsigned int substeps;
+  unsigned int maxStepsPerFrame;
+  bool lockstep;
+  unsigned int stepCount;
+
+  // Real time not yet simulated.
+  double accumulator;
+
+  // Total real time thrown away because of the catch up limit.
+  double droppedTime;
+};
+
+// Inlined accessors
+inline double StepScheduler::GetStepTime() const { return stepTime; }
+inline unsigned int StepScheduler::GetSubsteps() const { return substeps; }
+inline unsigned int StepScheduler::GetMaxStepsPerFrame() const { return maxStepsPerFrame; }
+inline bool StepScheduler::GetLockstep() const { return lockstep; }
+inline unsigned int StepScheduler::GetStepCount() const { return stepCount; }
+inline double StepScheduler::GetDroppedTime() const { return droppedTime; }
+inline double StepScheduler::GetAlpha() const { return accumulator / stepTime; }
+
+#endif
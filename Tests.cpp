@@ -0,0 +1,698 @@
+/* Checks that the fast paths agree with the simple ones they replace.
+ * Every test builds its input from a seed, runs the optimized code and a
+ * straightforward reference side by side and compares the results. Run
+ * without arguments to run every test, or name the tests to run. Returns
+ * non-zero if any check fails. */
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include "BroadPhase.h"
+#include "Integrator.h"
+#include "LineKernel.h"
+#include "OffscreenRenderer.h"
+#include "Renderer.h"
+#include "Snapshot.h"
+#include "StepScheduler.h"
+#include "SpriteCache.h"
+#include "World.h"
+#include "WorldBatch.h"
+#include "ThreadPool.h"
+#include "Random.h"
+
+struct TestCase
+{
+  const char *Name;
+  const char *Description;
+  bool (*Run)();
+};
+
+// Number of failed checks in the test running right now.
+static unsigned int failures = 0;
+
+// Reports a failed check, only the first few of a test are printed.
+static bool Check(bool passed, const char *what)
+{
+  if(!passed)
+  {
+    if(failures < 10)
+    {
+      printf("  failed: %s\n", what);
+    }
+    failures++;
+  }
+  return passed;
+}
+
+static bool Near(double a, double b)
+{
+  return std::fabs(a - b) <= 1e-12 * std::max(1.0, std::max(std::fabs(a), std::fabs(b)));
+}
+
+static bool Near(const Vector2D &a, const Vector2D &b)
+{
+  return Near(a.X, b.X) && Near(a.Y, b.Y);
+}
+
+static bool SamePair(const BallPair &a, const BallPair &b)
+{
+  return a.A == b.A && a.B == b.B;
+}
+
+static bool PairLess(const BallPair &a, const BallPair &b)
+{
+  return a.A != b.A ? a.A < b.A : a.B < b.B;
+}
+
+// A box of four lines with a slope in the middle, as in the window.
+static std::vector<Line> MakeBox()
+{
+  std::vector<Line> lines;
+  lines.push_back(Line(Vector2D(0.5, 12.0), Vector2D(0.5, 0.2)));
+  lines.push_back(Line(Vector2D(0.5, 0.2), Vector2D(15.5, 0.2)));
+  lines.push_back(Line(Vector2D(15.5, 0.2), Vector2D(15.5, 12.0)));
+  lines.push_back(Line(Vector2D(0.5, 12.0), Vector2D(15.5, 12.0)));
+  lines.push_back(Line(Vector2D(4.0, 5.0), Vector2D(11.0, 3.0)));
+  return lines;
+}
+
+static void AddRandomBalls(World &world, unsigned int count, unsigned long long seed)
+{
+  Random random(seed);
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    double radius = random.NextDouble(0.05, 0.15);
+    BallHandle ball = world.AddBall(radius * 10.0, radius,
+      Vector2D(random.NextDouble(1.0, 15.0), random.NextDouble(1.0, 11.5)));
+    world.ApplyImpulse(ball, Vector2D(random.NextDouble(-2.0, 2.0), random.NextDouble(-2.0, 2.0)) * radius);
+  }
+}
+
+// ---------- BROAD PHASE ------------ //
+
+static bool TestGridPairs()
+{
+  const unsigned int count = 12000;
+
+  Random random(1);
+  std::vector<Vector2D> positions(count);
+  std::vector<double> radii(count);
+  UniformGrid grid;
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    positions[i] = Vector2D(random.NextDouble(0.0, 80.0), random.NextDouble(0.0, 60.0));
+    radii[i] = random.NextDouble(0.02, 0.3);
+    grid.Insert(i, positions[i], radii[i]);
+  }
+
+  std::vector<BallPair> expected;
+  for(unsigned int a = 0; a < count; ++a)
+  {
+    for(unsigned int b = a + 1; b < count; ++b)
+    {
+      double reach = radii[a] + radii[b];
+      if((positions[a] - positions[b]).LengthSquared() <= reach * reach)
+      {
+        BallPair pair = { a, b };
+        expected.push_back(pair);
+      }
+    }
+  }
+
+  std::vector<BallPair> pairs;
+  grid.FindPairs(pairs);
+
+  // Searched row by row the pairs come out the same and in the same order.
+  std::vector<BallPair> byRows;
+  grid.Build();
+  for(unsigned int row = 0; row < grid.GetRowCount(); ++row)
+  {
+    grid.FindPairs(row, row + 1, byRows);
+  }
+  Check(byRows.size() == pairs.size() && std::equal(pairs.begin(), pairs.end(), byRows.begin(), SamePair),
+    "pairs found row by row match the pairs found at once");
+
+  bool ordered = true;
+  for(const BallPair &pair : pairs)
+  {
+    ordered = ordered && pair.A < pair.B;
+  }
+  Check(ordered, "every pair has A < B");
+
+  std::sort(pairs.begin(), pairs.end(), PairLess);
+  Check(pairs.size() == expected.size() && std::equal(pairs.begin(), pairs.end(), expected.begin(), SamePair),
+    "grid pairs match comparing every pair of balls");
+  return !expected.empty();
+}
+
+static bool TestGridQueryBox()
+{
+  Random random(2);
+  std::vector<Vector2D> positions(5000);
+  std::vector<double> radii(5000);
+  UniformGrid grid;
+  for(unsigned int i = 0; i < positions.size(); ++i)
+  {
+    positions[i] = Vector2D(random.NextDouble(0.0, 100.0), random.NextDouble(0.0, 50.0));
+    radii[i] = random.NextDouble(0.1, 0.6);
+    grid.Insert(i, positions[i], radii[i]);
+  }
+  grid.Build();
+
+  for(unsigned int query = 0; query < 200; ++query)
+  {
+    Vector2D min(random.NextDouble(-5.0, 95.0), random.NextDouble(-5.0, 45.0));
+    Vector2D max = min + Vector2D(random.NextDouble(0.0, 10.0), random.NextDouble(0.0, 10.0));
+
+    std::vector<unsigned int> found;
+    grid.QueryBox(min, max, [&found](unsigned int index) { found.push_back(index); });
+    std::sort(found.begin(), found.end());
+
+    std::vector<unsigned int> expected;
+    for(unsigned int i = 0; i < positions.size(); ++i)
+    {
+      if(positions[i].X + radii[i] >= min.X && positions[i].X - radii[i] <= max.X &&
+         positions[i].Y + radii[i] >= min.Y && positions[i].Y - radii[i] <= max.Y)
+      {
+        expected.push_back(i);
+      }
+    }
+
+    Check(found == expected, "balls in a box match testing every ball");
+  }
+  return true;
+}
+
+// ---------- KERNELS ------------ //
+
+static void FillStore(BallStore &balls, unsigned int count)
+{
+  Random random(3);
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    balls.Add(random.NextDouble(0.5, 5.0), 0.2, Vector2D(random.NextDouble(0.0, 20.0), random.NextDouble(0.0, 30.0)));
+    balls.Velocity[i] = Vector2D(random.NextDouble(-3.0, 3.0), random.NextDouble(-3.0, 3.0));
+    balls.AngularVelocity[i] = random.NextDouble(-9.0, 9.0);
+  }
+}
+
+static bool TestIntegrator()
+{
+  const unsigned int count = 1003;
+  const Vector2D gravity(0.0, -9.82);
+
+  for(unsigned int isa = IsaScalar + 1; isa < IsaCount; ++isa)
+  {
+    if(!IsIntegratorIsaSupported(static_cast<IntegratorIsa>(isa)))
+    {
+      printf("  %s not supported, skipped\n", GetIntegratorIsaName(static_cast<IntegratorIsa>(isa)));
+      continue;
+    }
+
+    BallStore expected, balls;
+    FillStore(expected, count);
+    FillStore(balls, count);
+
+    for(unsigned int step = 0; step < 100; ++step)
+    {
+      for(unsigned int i = 0; i < count; ++i)
+      {
+        Vector2D force(static_cast<double>(i % 3), 1.0);
+        expected.ForceAccumulator[i] = force;
+        expected.AngularAcceleration[i] = (i % 7) / 3.0;
+        balls.ForceAccumulator[i] = force;
+        balls.AngularAcceleration[i] = (i % 7) / 3.0;
+      }
+
+      // Start off the vector alignment so the tails are covered too.
+      IntegrateBalls(IsaScalar, expected, 0, count, gravity, 0.01);
+      IntegrateBalls(static_cast<IntegratorIsa>(isa), balls, 3, count, gravity, 0.01);
+      IntegrateBalls(IsaScalar, balls, 0, 3, gravity, 0.01);
+    }
+
+    bool same = true;
+    for(unsigned int i = 0; i < count; ++i)
+    {
+      same = same && Near(balls.Position[i], expected.Position[i]) &&
+        Near(balls.Velocity[i], expected.Velocity[i]) &&
+        Near(balls.Orientation[i], expected.Orientation[i]) &&
+        Near(balls.AngularVelocity[i], expected.AngularVelocity[i]);
+    }
+    Check(same, GetIntegratorIsaName(static_cast<IntegratorIsa>(isa)));
+  }
+  return true;
+}
+
+static bool TestLineKernel()
+{
+  const unsigned int numLines = 1001;
+
+  Random random(4);
+  PackedLines lines;
+  lines.Resize((numLines + LineLanes - 1) / LineLanes);
+  for(unsigned int i = 0; i < numLines; ++i)
+  {
+    Vector2D start(random.NextDouble(0.0, 20.0), random.NextDouble(0.0, 20.0));
+    Vector2D end = start + Vector2D(random.NextDouble(-2.0, 2.0), random.NextDouble(-2.0, 2.0));
+
+    // A few lines are points.
+    lines.Pack(i, Line(start, i % 50 == 0 ? start : end), i);
+  }
+
+  LineKernel scalar = GetLineKernel(IsaScalar);
+  for(unsigned int isa = IsaScalar + 1; isa < IsaCount; ++isa)
+  {
+    if(!IsIntegratorIsaSupported(static_cast<IntegratorIsa>(isa)))
+    {
+      continue;
+    }
+
+    LineKernel kernel = GetLineKernel(static_cast<IntegratorIsa>(isa));
+    Random balls(5);
+    bool same = true;
+    for(unsigned int ball = 0; ball < 2000; ++ball)
+    {
+      Vector2D center(balls.NextDouble(0.0, 20.0), balls.NextDouble(0.0, 20.0));
+      double radius = balls.NextDouble(0.05, 0.5);
+      for(unsigned int block = 0; block < lines.GetBlockCount(); ++block)
+      {
+        same = same && kernel(lines, block, center, radius * radius) ==
+          scalar(lines, block, center, radius * radius);
+      }
+    }
+    Check(same, GetIntegratorIsaName(static_cast<IntegratorIsa>(isa)));
+  }
+
+  // The kernel agrees with the distance worked out lane by lane.
+  Random balls(6);
+  bool same = true;
+  for(unsigned int ball = 0; ball < 2000; ++ball)
+  {
+    Vector2D center(balls.NextDouble(0.0, 20.0), balls.NextDouble(0.0, 20.0));
+    double radiusSq = std::pow(balls.NextDouble(0.05, 0.5), 2);
+    for(unsigned int block = 0; block < lines.GetBlockCount(); ++block)
+    {
+      unsigned int mask = scalar(lines, block, center, radiusSq);
+      for(unsigned int k = 0; k < LineLanes; ++k)
+      {
+        unsigned int lane = block * LineLanes + k;
+        bool touching = lines.Index[lane] != NoLine &&
+          OffsetFromLine(lines, lane, center).LengthSquared() <= radiusSq;
+        same = same && ((mask >> k) & 1) == (touching ? 1u : 0u);
+      }
+    }
+  }
+  Check(same, "scalar kernel matches the distance to every line");
+  return true;
+}
+
+// ---------- WORLD ------------ //
+
+static void BuildWorld(World &world, unsigned int balls)
+{
+  std::vector<Line> box = MakeBox();
+  for(const Line &line : box)
+  {
+    world.AddLine(line);
+  }
+  AddRandomBalls(world, balls, 7);
+}
+
+static bool TestThreadCounts()
+{
+  ThreadPool one(1), many(4);
+  World single, threaded;
+  single.SetThreadPool(&one);
+  threaded.SetThreadPool(&many);
+  BuildWorld(single, 4000);
+  BuildWorld(threaded, 4000);
+
+  bool same = true;
+  for(unsigned int step = 0; step < 300; ++step)
+  {
+    single.Step(0.01);
+    threaded.Step(0.01);
+    same = same && single.ComputeStateHash() == threaded.ComputeStateHash();
+  }
+  return Check(same, "state hash after every step on 1 and 4 threads");
+}
+
+static bool TestSchedulerStepTime()
+{
+  World world;
+  BuildWorld(world, 100);
+
+  StepScheduler scheduler(0.01);
+  scheduler.Advance(world, 0.025);
+  Check(scheduler.GetStepCount() == 2, "two steps out of 25 ms at 10 ms");
+
+  // Half a step left over is still half a step at any step time.
+  scheduler.SetStepTime(0.002);
+  Check(scheduler.GetAlpha() < 1.0, "alpha below one after shortening the step");
+  Check(std::fabs(scheduler.GetAlpha() - 0.5) < 1e-9, "alpha kept after shortening the step");
+
+  scheduler.SetStepTime(0.05);
+  Check(std::fabs(scheduler.GetAlpha() - 0.5) < 1e-9, "alpha kept after lengthening the step");
+
+  scheduler.Advance(world, 0.0);
+  return Check(scheduler.GetStepCount() == 2, "no step out of the time left over");
+}
+
+static bool TestSnapshot()
+{
+  World world;
+  BuildWorld(world, 2000);
+  world.SetRestitution(0.6);
+  world.AddForceField(Vector2D(0.5, 0.0));
+  for(unsigned int i = 0; i < 20; ++i)
+  {
+    Force push(Vector2D(1.0, 0.0), 2.0f, 5.0f);
+    push.Permanent = i % 2 == 0;
+    world.AddForce(world.GetBalls().HandleOf(i * 10), push);
+  }
+  for(unsigned int step = 0; step < 100; ++step)
+  {
+    world.Step(0.01);
+  }
+
+  std::vector<unsigned char> buffer;
+  world.SaveSnapshot(buffer);
+
+  World loaded;
+  Check(loaded.LoadSnapshot(buffer.data(), buffer.size()), "snapshot loads");
+  Check(loaded.ComputeStateHash() == world.ComputeStateHash(), "loaded state hash matches");
+
+  std::vector<unsigned char> saved;
+  loaded.SaveSnapshot(saved);
+  Check(saved == buffer, "loaded world saves the same bytes");
+
+  // Whatever is not part of the hash has to come back as well.
+  bool same = true;
+  for(unsigned int step = 0; step < 200; ++step)
+  {
+    world.Step(0.01);
+    loaded.Step(0.01);
+    same = same && loaded.ComputeStateHash() == world.ComputeStateHash();
+  }
+  Check(same, "loaded world steps the same as the saved one");
+
+  // Cut short anywhere a snapshot is refused and leaves the world alone.
+  World other;
+  BuildWorld(other, 100);
+  unsigned long long hash = other.ComputeStateHash();
+  for(size_t size = 0; size < buffer.size(); size += 1 + size / 3)
+  {
+    Check(!other.LoadSnapshot(buffer.data(), size), "truncated snapshot is refused");
+  }
+  Check(other.ComputeStateHash() == hash && other.GetLines().size() == MakeBox().size(),
+    "world is unchanged after failed loads");
+
+  // The settings start with a double and three bools of one byte each.
+  std::vector<unsigned char> corrupt = buffer;
+  corrupt[4 * sizeof(unsigned int) + sizeof(double)] = 2;
+  Check(!other.LoadSnapshot(corrupt.data(), corrupt.size()), "bool that is not 0 or 1 is refused");
+  return true;
+}
+
+// Saves a store and loads it back with the last free slot replaced.
+static bool LoadWithFreeSlot(const BallStore &balls, unsigned int slot)
+{
+  std::vector<unsigned char> buffer;
+  SnapshotWriter writer(buffer);
+  balls.Save(writer);
+
+  // The free slots are the last array written.
+  memcpy(&buffer[buffer.size() - sizeof(slot)], &slot, sizeof(slot));
+
+  BallStore loaded;
+  SnapshotReader reader(buffer.data(), buffer.size());
+  return loaded.Load(reader);
+}
+
+static bool TestSnapshotSlots()
+{
+  BallStore balls;
+  BallHandle handles[4];
+  for(unsigned int i = 0; i < 4; ++i)
+  {
+    handles[i] = balls.Add(1.0, 0.1, Vector2D(i, 0.0));
+  }
+  balls.Remove(handles[1]);
+  balls.Remove(handles[2]);
+
+  // Slot 2 was freed last, slot 1 before it.
+  Check(LoadWithFreeSlot(balls, handles[2].Slot), "free slots load");
+  Check(!LoadWithFreeSlot(balls, handles[0].Slot), "slot in use listed as free is refused");
+  Check(!LoadWithFreeSlot(balls, handles[1].Slot), "slot listed as free twice is refused");
+  Check(!LoadWithFreeSlot(balls, 4), "slot out of range is refused");
+  return true;
+}
+
+static bool TestBatch()
+{
+  WorldBatch batch;
+  batch.SetLines(MakeBox());
+  for(unsigned int i = 0; i < 4; ++i)
+  {
+    AddRandomBalls(batch.GetWorld(batch.AddWorld()), 500, 10 + i);
+  }
+
+  ThreadPool pool(4);
+  batch.Run(0.01, 200, &pool);
+
+  for(unsigned int i = 0; i < batch.GetWorldCount(); ++i)
+  {
+    World alone;
+    std::vector<Line> box = MakeBox();
+    for(const Line &line : box)
+    {
+      alone.AddLine(line);
+    }
+    AddRandomBalls(alone, 500, 10 + i);
+    for(unsigned int step = 0; step < 200; ++step)
+    {
+      alone.Step(0.01);
+    }
+
+    Check(batch.GetResults()[i].StateHash == alone.ComputeStateHash(),
+      "world of a batch steps the same as on its own");
+  }
+  return true;
+}
+
+static bool TestLineEdit()
+{
+  World world;
+  Line ground(Vector2D(0.0, 0.0), Vector2D(10.0, 0.0));
+  ground.SetRestitution(0.0f);
+  unsigned int floor = world.AddLine(ground);
+  world.AddBall(1.0, 0.2, Vector2D(5.0, 0.5));
+  for(unsigned int step = 0; step < 300; ++step)
+  {
+    world.Step(0.01);
+  }
+  Check(world.GetBalls().AwakeCount() == 0, "ball falls asleep on the floor");
+
+  // Lowered through GetLine, the floor is refit and the ball falls after it.
+  double resting = world.GetBalls().Position[0].Y;
+  world.GetLine(floor).SetStart(Vector2D(0.0, -1.0));
+  world.GetLine(floor).SetEnd(Vector2D(10.0, -1.0));
+  for(unsigned int step = 0; step < 300; ++step)
+  {
+    world.Step(0.01);
+  }
+
+  double y = world.GetBalls().Position[0].Y;
+  Check(std::fabs(y - (resting - 1.0)) < 0.01, "ball follows the lowered floor");
+  return true;
+}
+
+static bool TestPointLine()
+{
+  // A ball with its center right on a line that is a point, kept there without gravity.
+  World world;
+  world.ClearForceFields();
+  world.AddLine(Line(Vector2D(2.0, 2.0), Vector2D(2.0, 2.0)));
+  world.AddBall(1.0, 0.2, Vector2D(2.0, 2.0));
+  world.Step(0.01);
+
+  const BallStore &balls = world.GetBalls();
+  bool finite = std::isfinite(balls.Position[0].X) && std::isfinite(balls.Position[0].Y) &&
+    std::isfinite(balls.Velocity[0].X) && std::isfinite(balls.Velocity[0].Y);
+  Check(finite, "ball on a point stays finite");
+  Check(balls.Position[0].Y > 2.0, "ball on a point is pushed up");
+  return true;
+}
+
+// ---------- RENDERING ------------ //
+
+static void DrawFrame(Renderer &renderer, Framebuffer &target, unsigned int frame)
+{
+  renderer.Begin(target, MakeColor(0, 0, 0));
+
+  std::vector<Line> box = MakeBox();
+  for(const Line &line : box)
+  {
+    renderer.AddLine(line);
+  }
+  if(frame < 30)
+  {
+    renderer.AddLine(Line(Vector2D(2.0, 9.0), Vector2D(6.0, 10.0)));
+  }
+
+  // Every tenth ball moves and turns, some disappear half way.
+  unsigned int count = frame < 20 ? 300 : 280;
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    bool moving = i % 10 == 0;
+    double x = 1.0 + (i % 30) * 0.45 + (moving ? 0.02 * frame : 0.0);
+    double y = 1.0 + (i / 30) * 1.0 + (moving ? 0.5 * std::sin(frame * 0.2) : 0.0);
+    renderer.AddBall(Vector2D(x, y), 0.1 + 0.02 * (i % 8), moving ? frame * 3.7 + i : i * 17.0);
+  }
+
+  if(frame == 40)
+  {
+    renderer.SetCacheSprites(false);
+  }
+  renderer.End();
+}
+
+static bool TestSpriteCache()
+{
+  Sprite ball;
+  ball.MakeBall(64);
+
+  // Room for exactly three sprites of the same size.
+  SpriteCache cache;
+  cache.Find(ball, 10, 0.0);
+  size_t size = cache.GetMemoryUsed();
+  cache.Clear();
+  cache.SetBudget(3 * size);
+
+  const CachedSprite *first = cache.Find(ball, 10, 0.0);
+  cache.Find(ball, 10, 90.0);
+  cache.Find(ball, 10, 180.0);
+  Check(cache.Find(ball, 10, 0.0) == first, "cached sprite is found again");
+
+  // The least recently used, not the first drawn, makes room.
+  cache.Find(ball, 10, 270.0);
+  Check(cache.GetCount() == 3 && cache.GetMemoryUsed() == 3 * size, "cache stays within its budget");
+
+  unsigned long long misses = cache.GetMisses();
+  cache.Find(ball, 10, 0.0);
+  cache.Find(ball, 10, 180.0);
+  cache.Find(ball, 10, 270.0);
+  Check(cache.GetMisses() == misses, "recently used sprites are kept");
+  cache.Find(ball, 10, 90.0);
+  Check(cache.GetMisses() == misses + 1, "least recently used sprite was thrown away");
+
+  cache.SetBudget(0);
+  Check(cache.GetCount() == 0 && cache.GetMemoryUsed() == 0, "no budget empties the cache");
+  return true;
+}
+
+static bool TestIncrementalRender()
+{
+  const unsigned int width = 640, height = 480;
+  Matrix3x3 transform = Matrix3x3::ScaleUniform(40.0) * Matrix3x3::Translation(0, -height) *
+    Matrix3x3::Scale(1, -1);
+
+  Framebuffer full(width, height), incremental(width, height), overlay(width, height);
+  overlay.Clear(0);
+
+  Renderer fullRenderer, incrementalRenderer;
+  fullRenderer.SetTransform(transform);
+  fullRenderer.SetOverlay(&overlay);
+  incrementalRenderer.SetTransform(transform);
+  incrementalRenderer.SetOverlay(&overlay);
+  incrementalRenderer.SetIncremental(true);
+
+  bool same = true;
+  for(unsigned int frame = 0; frame < 50; ++frame)
+  {
+    // The overlay changes now and then, and says where.
+    if(frame == 10 || frame == 25)
+    {
+      overlay.Fill(PixelRect(100, 50, 300, 80), frame == 10 ? 0x80408020u : 0);
+      incrementalRenderer.Invalidate(PixelRect(100, 50, 300, 80));
+    }
+
+    DrawFrame(fullRenderer, full, frame);
+    DrawFrame(incrementalRenderer, incremental, frame);
+    same = same && memcmp(full.GetPixels(), incremental.GetPixels(), width * height * 4) == 0;
+  }
+  return Check(same, "incremental frames match frames drawn from scratch");
+}
+
+static bool TestFramePatterns()
+{
+  OffscreenRenderer offscreen(16, 16, nullptr);
+
+  const char *valid[] = { "frame%u.ppm", "frames/%06u.png", "%-8d", "100%%/%+05i.ppm" };
+  for(const char *pattern : valid)
+  {
+    Check(offscreen.OpenSequence(pattern, FramePpm), pattern);
+    offscreen.Close();
+  }
+
+  const char *invalid[] = { "frame.ppm", "%s.ppm", "%u%u.ppm", "%n%u", "%lu.ppm", "%.3u", "frame%" };
+  for(const char *pattern : invalid)
+  {
+    Check(!offscreen.OpenSequence(pattern, FramePpm), pattern);
+  }
+  return true;
+}
+
+static const TestCase Tests[] =
+{
+  { "grid", "broad phase pairs against every pair of balls", TestGridPairs },
+  { "querybox", "balls in a box against every ball", TestGridQueryBox },
+  { "integrator", "vector integrators against the scalar one", TestIntegrator },
+  { "linekernel", "vector line kernels against the scalar one", TestLineKernel },
+  { "threads", "stepping on one thread against many", TestThreadCounts },
+  { "scheduler", "changing the step time between frames", TestSchedulerStepTime },
+  { "snapshot", "saving and loading a world", TestSnapshot },
+  { "slots", "loading the handle table of a snapshot", TestSnapshotSlots },
+  { "batch", "worlds of a batch against worlds on their own", TestBatch },
+  { "pointline", "a ball centered on a line of no length", TestPointLine },
+  { "lineedit", "moving a line through the world", TestLineEdit },
+  { "spritecache", "throwing away the least recently used sprites", TestSpriteCache },
+  { "render", "incremental drawing against drawing from scratch", TestIncrementalRender },
+  { "patterns", "names of rendered frames", TestFramePatterns },
+};
+
+static const unsigned int NumTests = sizeof(Tests) / sizeof(Tests[0]);
+
+int main(int argc, char **argv)
+{
+  unsigned int run = 0, failed = 0;
+  for(unsigned int i = 0; i < NumTests; ++i)
+  {
+    bool wanted = argc < 2;
+    for(int arg = 1; arg < argc; ++arg)
+    {
+      wanted = wanted || strcmp(argv[arg], Tests[i].Name) == 0;
+    }
+    if(!wanted)
+    {
+      continue;
+    }
+
+    printf("%s: %s\n", Tests[i].Name, Tests[i].Description);
+    failures = 0;
+    bool passed = Tests[i].Run() && failures == 0;
+    printf("%s: %s\n", Tests[i].Name, passed ? "passed" : "FAILED");
+
+    run++;
+    failed += passed ? 0 : 1;
+  }
+
+  if(run == 0)
+  {
+    fprintf(stderr, "No such test\n");
+    return 1;
+  }
+  return failed == 0 ? 0 : 1;
+}
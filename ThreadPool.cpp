@@ -0,0 +1,201 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+  if(threadCount == 0)
+  {
+    threadCount = std::thread::hardware_concurrency();
+    if(threadCount == 0) threadCount = 1;
+  }
+
+  queuedTasks = 0;
+  quitting = false;
+
+  for(unsigned int i = 0; i < threadCount; ++i)
+  {
+    queues.push_back(new Queue());
+    queues.back()->Head = 0;
+  }
+
+  // The calling thread is the first one, so we only start the rest.
+  for(unsigned int i = 1; i < threadCount; ++i)
+  {
+    workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(sleepLock);
+    quitting = true;
+  }
+  wake.notify_all();
+
+  for(std::thread &worker : workers)
+  {
+    worker.join();
+  }
+
+  for(Queue *queue : queues)
+  {
+    delete queue;
+  }
+}
+
+void ThreadPool::ParallelFor(unsigned int count, unsigned int grainSize, const RangeFunc &func)
+{
+  if(count == 0)
+  {
+    return;
+  }
+
+  if(grainSize == 0)
+  {
+    grainSize = 1;
+  }
+
+  unsigned int numChunks = (count + grainSize - 1) / grainSize;
+
+  // Nothing to share, skip the queues altogether.
+  if(numChunks == 1 || workers.empty())
+  {
+    for(unsigned int begin = 0; begin < count; begin += grainSize)
+    {
+      unsigned int end = count - begin > grainSize ? begin + grainSize : count;
+      func(begin, end);
+    }
+    return;
+  }
+
+  Job job;
+  job.Func = &func;
+  job.Remaining = numChunks;
+
+  // Count the tasks before they can be taken, so the count never drops below zero.
+  {
+    std::lock_guard<std::mutex> lock(sleepLock);
+    queuedTasks += numChunks;
+  }
+
+  // Deal the chunks out over all queues.
+  for(unsigned int c = 0; c < numChunks; ++c)
+  {
+    Task task;
+    task.Owner = &job;
+    task.Begin = c * grainSize;
+    task.End = count - task.Begin > grainSize ? task.Begin + grainSize : count;
+
+    Queue *queue = queues[c % queues.size()];
+    std::lock_guard<std::mutex> lock(queue->Lock);
+    queue->Tasks.push_back(task);
+  }
+
+  wake.notify_all();
+
+  // Help out until every chunk of our job is done.
+  while(job.Remaining.load() > 0)
+  {
+    if(!RunOne(0))
+    {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void ThreadPool::WorkerLoop(unsigned int index)
+{
+  while(true)
+  {
+    if(RunOne(index))
+    {
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepLock);
+    while(!quitting && queuedTasks.load() == 0)
+    {
+      wake.wait(lock);
+    }
+
+    if(quitting)
+    {
+      return;
+    }
+  }
+}
+
+bool ThreadPool::RunOne(unsigned int index)
+{
+  Task task;
+  bool found = false;
+
+  // Newest task from our own queue first, it is most likely still in cache.
+  {
+    Queue *own = queues[index];
+    std::lock_guard<std::mutex> lock(own->Lock);
+    if(own->Head < own->Tasks.size())
+    {
+      task = own->Tasks.back();
+      own->Tasks.pop_back();
+      found = true;
+    }
+
+    if(own->Head == own->Tasks.size())
+    {
+      own->Tasks.clear();
+      own->Head = 0;
+    }
+  }
+
+  // Otherwise steal the oldest task from someone else.
+  for(unsigned int i = 1; !found && i < queues.size(); ++i)
+  {
+    Queue *victim = queues[(index + i) % queues.size()];
+    std::lock_guard<std::mutex> lock(victim->Lock);
+    if(victim->Head < victim->Tasks.size())
+    {
+      task = victim->Tasks[victim->Head++];
+      found = true;
+    }
+
+    if(victim->Head == victim->Tasks.size())
+    {
+      victim->Tasks.clear();
+      victim->Head = 0;
+    }
+  }
+
+  if(!found)
+  {
+    return false;
+  }
+
+  queuedTasks--;
+
+  (*task.Owner->Func)(task.Begin, task.End);
+  task.Owner->Remaining--;
+
+  return true;
+}
+
+void ParallelFor(ThreadPool *pool, unsigned int count, unsigned int grainSize,
+                 const RangeFunc &func)
+{
+  if(pool != nullptr)
+  {
+    pool->ParallelFor(count, grainSize, func);
+    return;
+  }
+
+  if(grainSize == 0)
+  {
+    grainSize = 1;
+  }
+
+  for(unsigned int begin = 0; begin < count; begin += grainSize)
+  {
+    unsigned int end = count - begin > grainSize ? begin + grainSize : count;
+    func(begin, end);
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work done on a range [begin, end) of items.
+typedef std::function<void(unsigned int begin, unsigned int end)> RangeFunc;
+
+/* Pool of worker threads that share work by stealing.
+ * Work is handed out as chunks spread over one queue per thread. A thread
+ * takes the newest chunk from its own queue and, once that runs dry,
+ * steals the oldest chunk from one of the others. The thread calling
+ * ParallelFor works on its own job until it is done instead of waiting. */
+class ThreadPool
+{
+public:
+  /* Constructor, threadCount includes the calling thread.
+   * Zero uses one thread per hardware thread. */
+  ThreadPool(unsigned int threadCount = 0);
+
+  // Destructor, waits for the workers to finish.
+  ~ThreadPool();
+
+  // Returns the number of threads work is spread over, including the caller.
+  unsigned int GetThreadCount() const;
+
+  /* Splits [0, count) into chunks of grainSize items and runs func on
+   * each of them. Returns once every chunk is done. */
+  void ParallelFor(unsigned int count, unsigned int grainSize, const RangeFunc &func);
+
+private:
+  struct Job
+  {
+    const RangeFunc *Func;
+    std::atomic<unsigned int> Remaining;
+  };
+
+  struct Task
+  {
+    Job *Owner;
+    unsigned int Begin;
+    unsigned int End;
+  };
+
+  /* Tasks in [Head, end) are still waiting. Once they have all been
+   * taken the vector is cleared but keeps its memory, so queueing
+   * does not allocate once a queue has seen its largest job. */
+  struct Queue
+  {
+    std::mutex Lock;
+    std::vector<Task> Tasks;
+    size_t Head;
+  };
+
+  void WorkerLoop(unsigned int index);
+
+  // Runs one task from our own queue, or a stolen one.
+  // Returns false if there was nothing to do.
+  bool RunOne(unsigned int index);
+
+  // Queue 0 belongs to whoever calls ParallelFor.
+  std::vector<Queue *> queues;
+  std::vector<std::thread> workers;
+
+  // Workers sleep here while there are no tasks. Tasks are only ever
+  // added while holding the lock, so no wake up can be missed.
+  std::mutex sleepLock;
+  std::condition_variable wake;
+  std::atomic<unsigned int> queuedTasks;
+  bool quitting;
+};
+
+inline unsigned int ThreadPool::GetThreadCount() const
+{
+  return static_cast<unsigned int>(queues.size());
+}
+
+/* Runs func over [0, count) in chunks of grainSize, spread over the pool.
+ * Without a pool the chunks run in order on the calling thread. The
+ * chunks are the same either way, so work that only depends on its own
+ * chunk gives the same result for any number of threads. */
+void ParallelFor(ThreadPool *pool, unsigned int count, unsigned int grainSize,
+                 const RangeFunc &func);
+
+#endif
@@ -0,0 +1,578 @@
+#include "Trajectory.h"
+#include <algorithm>
+#include <cmath>
+
+// Start and end of a trajectory file.
+const unsigned int TrajectoryMagic = 0x4A525442;
+const unsigned int TrajectoryVersion = 1;
+const unsigned int TrajectoryIndexMagic = 0x49525442;
+
+// Starts every frame, so the end of the frames can be found without the index.
+const unsigned int TrajectoryFrameMagic = 0x46525442;
+
+// Bytes in front of every frame: the magic and the size of the rest.
+const size_t FrameHeaderSize = 2 * sizeof(unsigned int);
+
+// Values stored per ball: position, velocity and orientation.
+const unsigned int ValuesPerBall = 5;
+
+// Quantized values are kept well inside a long long, so differences fit too.
+const double MaxQuantized = 4.0e18;
+
+// Marks slots without a ball, and a reader that has not decoded anything.
+const unsigned int NoBallIndex = ~0u;
+const unsigned int NoFrame = ~0u;
+
+// Header size on disk: magic, version, interval, keyframes and the quanta.
+const size_t HeaderSize = 4 * sizeof(unsigned int) + 3 * sizeof(double);
+
+// Trailer size on disk: frame count, index offset and magic.
+const size_t TrailerSize = sizeof(unsigned int) + sizeof(unsigned long long) + sizeof(unsigned int);
+
+TrajectorySettings::TrajectorySettings()
+{
+  Interval = 1;
+  PositionQuantum = 1.0e-5;
+  VelocityQuantum = 1.0e-4;
+  OrientationQuantum = 1.0e-4;
+  KeyframeInterval = 64;
+  QueueCapacity = 16;
+}
+
+static inline long long Quantize(double value, double quantum)
+{
+  double scaled = value / quantum;
+  if(!(scaled > -MaxQuantized && scaled < MaxQuantized))
+  {
+    return 0;
+  }
+
+  return static_cast<long long>(std::floor(scaled + 0.5));
+}
+
+// Small numbers of either sign become small unsigned numbers.
+static inline unsigned long long ZigZag(long long value)
+{
+  return (static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63);
+}
+
+static inline long long UnZigZag(unsigned long long value)
+{
+  return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+}
+
+// Seven bits per byte, the high bit says whether more bytes follow.
+static inline void PutVarint(std::vector<unsigned char> &out, unsigned long long value)
+{
+  while(value >= 0x80)
+  {
+    out.push_back(static_cast<unsigned char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<unsigned char>(value));
+}
+
+static inline bool GetVarint(const unsigned char *&data, const unsigned char *end, unsigned long long &value)
+{
+  value = 0;
+  for(unsigned int shift = 0; shift < 64 && data < end; shift += 7)
+  {
+    unsigned char byte = *data++;
+    value |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+    if(!(byte & 0x80))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+TrajectoryRecorder::TrajectoryRecorder()
+{
+  file = nullptr;
+  calls = 0;
+  framesRecorded = 0;
+  framesDropped = 0;
+  queueHead = 0;
+  offset = 0;
+  closing = false;
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+  Close();
+}
+
+bool TrajectoryRecorder::Open(const char *path, const TrajectorySettings &settings)
+{
+  Close();
+
+  if(settings.Interval == 0 || settings.KeyframeInterval == 0 || settings.QueueCapacity == 0 ||
+     !(settings.PositionQuantum > 0.0) || !(settings.VelocityQuantum > 0.0) ||
+     !(settings.OrientationQuantum > 0.0))
+  {
+    return false;
+  }
+
+  file = fopen(path, "wb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+
+  this->settings = settings;
+  fwrite(&TrajectoryMagic, sizeof(unsigned int), 1, file);
+  fwrite(&TrajectoryVersion, sizeof(unsigned int), 1, file);
+  fwrite(&settings.Interval, sizeof(unsigned int), 1, file);
+  fwrite(&settings.KeyframeInterval, sizeof(unsigned int), 1, file);
+  fwrite(&settings.PositionQuantum, sizeof(double), 1, file);
+  fwrite(&settings.VelocityQuantum, sizeof(double), 1, file);
+  fwrite(&settings.OrientationQuantum, sizeof(double), 1, file);
+
+  calls = 0;
+  framesRecorded = 0;
+  framesDropped = 0;
+  offset = HeaderSize;
+  index.clear();
+  base.clear();
+  baseGeneration.clear();
+  baseFrame.clear();
+
+  buffers.resize(settings.QueueCapacity);
+  bufferStep.assign(settings.QueueCapacity, 0);
+  bufferKeyframe.assign(settings.QueueCapacity, 0);
+  freeBuffers.clear();
+  for(unsigned int i = settings.QueueCapacity; i > 0; --i)
+  {
+    freeBuffers.push_back(i - 1);
+  }
+  queued.clear();
+  queued.reserve(settings.QueueCapacity);
+  queueHead = 0;
+
+  closing = false;
+  writer = std::thread(&TrajectoryRecorder::WriterLoop, this);
+  return true;
+}
+
+void TrajectoryRecorder::Close()
+{
+  if(file == nullptr)
+  {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    closing = true;
+  }
+  wake.notify_one();
+  writer.join();
+
+  // The index goes last, so a file cut short still starts with whole frames.
+  unsigned int count = static_cast<unsigned int>(index.size());
+  if(count > 0)
+  {
+    fwrite(index.data(), sizeof(IndexEntry), count, file);
+  }
+  fwrite(&count, sizeof(unsigned int), 1, file);
+  fwrite(&offset, sizeof(unsigned long long), 1, file);
+  fwrite(&TrajectoryIndexMagic, sizeof(unsigned int), 1, file);
+
+  fclose(file);
+  file = nullptr;
+}
+
+void TrajectoryRecorder::Record(const BallStore &balls)
+{
+  if(file == nullptr || calls++ % settings.Interval != 0)
+  {
+    return;
+  }
+
+  unsigned int buffer;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if(freeBuffers.empty())
+    {
+      // The disk is behind, better lose a frame than stall the step.
+      framesDropped++;
+      return;
+    }
+
+    buffer = freeBuffers.back();
+    freeBuffers.pop_back();
+  }
+
+  bool keyframe = framesRecorded % settings.KeyframeInterval == 0;
+  bufferStep[buffer] = calls - 1;
+  bufferKeyframe[buffer] = keyframe ? 1 : 0;
+  Encode(balls, calls - 1, keyframe, buffers[buffer]);
+  framesRecorded++;
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    queued.push_back(buffer);
+  }
+  wake.notify_one();
+}
+
+void TrajectoryRecorder::Encode(const BallStore &balls, unsigned int step, bool keyframe,
+                                std::vector<unsigned char> &out)
+{
+  unsigned int count = balls.Count();
+
+  // Going through the balls by slot lets the slots be stored as small gaps.
+  unsigned int slots = 0;
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    slots = std::max(slots, balls.HandleOf(i).Slot + 1);
+  }
+
+  slotBall.assign(slots, NoBallIndex);
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    slotBall[balls.HandleOf(i).Slot] = i;
+  }
+
+  if(baseFrame.size() < slots)
+  {
+    base.resize(slots * ValuesPerBall, 0);
+    baseGeneration.resize(slots, 0);
+    baseFrame.resize(slots, 0);
+  }
+
+  // Frames are numbered from one here, so zero means never seen.
+  unsigned int frame = framesRecorded + 1;
+
+  out.clear();
+  PutVarint(out, step);
+  out.push_back(keyframe ? 1 : 0);
+  PutVarint(out, count);
+
+  unsigned int next = 0;
+  for(unsigned int slot = 0; slot < slots; ++slot)
+  {
+    unsigned int i = slotBall[slot];
+    if(i == NoBallIndex)
+    {
+      continue;
+    }
+
+    unsigned int generation = balls.HandleOf(i).Generation;
+    PutVarint(out, slot - next);
+    PutVarint(out, generation);
+    next = slot + 1;
+
+    // A ball only has something to be stored against if it was there last frame.
+    bool known = !keyframe && baseFrame[slot] == frame - 1 && baseGeneration[slot] == generation;
+
+    long long values[ValuesPerBall];
+    values[0] = Quantize(balls.Position[i].X, settings.PositionQuantum);
+    values[1] = Quantize(balls.Position[i].Y, settings.PositionQuantum);
+    values[2] = Quantize(balls.Velocity[i].X, settings.VelocityQuantum);
+    values[3] = Quantize(balls.Velocity[i].Y, settings.VelocityQuantum);
+    values[4] = Quantize(balls.Orientation[i], settings.OrientationQuantum);
+
+    long long *previous = &base[slot * ValuesPerBall];
+    for(unsigned int v = 0; v < ValuesPerBall; ++v)
+    {
+      PutVarint(out, ZigZag(values[v] - (known ? previous[v] : 0)));
+      previous[v] = values[v];
+    }
+
+    baseGeneration[slot] = generation;
+    baseFrame[slot] = frame;
+  }
+}
+
+void TrajectoryRecorder::WriterLoop()
+{
+  std::unique_lock<std::mutex> guard(lock);
+
+  while(true)
+  {
+    wake.wait(guard, [this]() { return queueHead < queued.size() || closing; });
+    if(queueHead == queued.size())
+    {
+      break;
+    }
+
+    unsigned int buffer = queued[queueHead++];
+    if(queueHead == queued.size())
+    {
+      queued.clear();
+      queueHead = 0;
+    }
+
+    guard.unlock();
+
+    // Every frame starts with its size, so files can be walked without the index.
+    const std::vector<unsigned char> &data = buffers[buffer];
+    unsigned int size = static_cast<unsigned int>(data.size());
+    fwrite(&TrajectoryFrameMagic, sizeof(unsigned int), 1, file);
+    fwrite(&size, sizeof(unsigned int), 1, file);
+    fwrite(data.data(), 1, size, file);
+
+    IndexEntry entry;
+    entry.Offset = offset;
+    entry.Step = bufferStep[buffer];
+    entry.Keyframe = bufferKeyframe[buffer];
+    index.push_back(entry);
+    offset += FrameHeaderSize + size;
+
+    guard.lock();
+    freeBuffers.push_back(buffer);
+  }
+}
+
+TrajectoryReader::TrajectoryReader()
+{
+  decodedFrame = NoFrame;
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+
+}
+
+bool TrajectoryReader::Open(const char *path)
+{
+  Close();
+
+  if(!file.Open(path))
+  {
+    return false;
+  }
+
+  SnapshotReader header(file.GetData(), file.GetSize());
+  unsigned int magic = 0, version = 0;
+  header.Read(magic);
+  header.Read(version);
+  header.Read(settings.Interval);
+  header.Read(settings.KeyframeInterval);
+  header.Read(settings.PositionQuantum);
+  header.Read(settings.VelocityQuantum);
+  header.Read(settings.OrientationQuantum);
+
+  if(!header.IsValid() || magic != TrajectoryMagic || version != TrajectoryVersion)
+  {
+    Close();
+    return false;
+  }
+
+  // Use the index if the recorder got to write one, else find the frames.
+  size_t size = file.GetSize();
+  bool indexed = false;
+  if(size >= HeaderSize + TrailerSize)
+  {
+    SnapshotReader trailer(file.GetData() + size - TrailerSize, TrailerSize);
+    unsigned int count = 0, indexMagic = 0;
+    unsigned long long indexOffset = 0;
+    trailer.Read(count);
+    trailer.Read(indexOffset);
+    trailer.Read(indexMagic);
+
+    if(indexMagic == TrajectoryIndexMagic && indexOffset >= HeaderSize &&
+       indexOffset + count * sizeof(IndexEntry) == size - TrailerSize)
+    {
+      index.resize(count);
+      if(count > 0)
+      {
+        memcpy(index.data(), file.GetData() + indexOffset, count * sizeof(IndexEntry));
+      }
+      indexed = true;
+    }
+  }
+
+  if(!indexed)
+  {
+    ScanFrames(HeaderSize);
+  }
+
+  return true;
+}
+
+void TrajectoryReader::Close()
+{
+  file.Close();
+  index.clear();
+  decodedFrame = NoFrame;
+}
+
+void TrajectoryReader::ScanFrames(size_t first)
+{
+  const unsigned char *data = file.GetData();
+  size_t size = file.GetSize();
+  size_t offset = first;
+
+  index.clear();
+  while(size - offset >= FrameHeaderSize)
+  {
+    unsigned int magic, length;
+    memcpy(&magic, data + offset, sizeof(unsigned int));
+    memcpy(&length, data + offset + sizeof(unsigned int), sizeof(unsigned int));
+    if(magic != TrajectoryFrameMagic || length > size - offset - FrameHeaderSize)
+    {
+      // The recorder was stopped halfway through this one.
+      break;
+    }
+
+    const unsigned char *payload = data + offset + FrameHeaderSize;
+    const unsigned char *end = payload + length;
+    unsigned long long step;
+    if(!GetVarint(payload, end, step) || payload == end)
+    {
+      break;
+    }
+
+    IndexEntry entry;
+    entry.Offset = offset;
+    entry.Step = static_cast<unsigned int>(step);
+    entry.Keyframe = *payload;
+    index.push_back(entry);
+
+    offset += FrameHeaderSize + length;
+  }
+
+  // A file never starts without a keyframe, anything else is not ours.
+  if(!index.empty() && !index[0].Keyframe)
+  {
+    index.clear();
+  }
+}
+
+bool TrajectoryReader::ReadFrame(unsigned int frame, TrajectoryFrame &out)
+{
+  if(frame >= index.size())
+  {
+    return false;
+  }
+
+  if(decodedFrame != frame)
+  {
+    // Carry on from the frame decoded last if that is closer than the keyframe.
+    unsigned int start = frame;
+    while(start > 0 && !index[start].Keyframe)
+    {
+      start--;
+    }
+
+    if(decodedFrame != NoFrame && decodedFrame >= start && decodedFrame < frame)
+    {
+      start = decodedFrame + 1;
+    }
+
+    for(unsigned int f = start; f <= frame; ++f)
+    {
+      if(!DecodeFrame(f))
+      {
+        decodedFrame = NoFrame;
+        return false;
+      }
+      decodedFrame = f;
+    }
+  }
+
+  unsigned int count = static_cast<unsigned int>(frameSlots.size());
+  out.Step = index[frame].Step;
+  out.Handles.resize(count);
+  out.Position.resize(count);
+  out.Velocity.resize(count);
+  out.Orientation.resize(count);
+
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    unsigned int slot = frameSlots[i];
+    const long long *values = &base[slot * ValuesPerBall];
+
+    out.Handles[i].Slot = slot;
+    out.Handles[i].Generation = baseGeneration[slot];
+    out.Position[i] = Vector2D(values[0] * settings.PositionQuantum, values[1] * settings.PositionQuantum);
+    out.Velocity[i] = Vector2D(values[2] * settings.VelocityQuantum, values[3] * settings.VelocityQuantum);
+    out.Orientation[i] = values[4] * settings.OrientationQuantum;
+  }
+
+  return true;
+}
+
+bool TrajectoryReader::DecodeFrame(unsigned int frame)
+{
+  const unsigned char *data = file.GetData();
+  size_t offset = static_cast<size_t>(index[frame].Offset);
+  if(offset > file.GetSize() - FrameHeaderSize)
+  {
+    return false;
+  }
+
+  unsigned int magic, length;
+  memcpy(&magic, data + offset, sizeof(unsigned int));
+  memcpy(&length, data + offset + sizeof(unsigned int), sizeof(unsigned int));
+  if(magic != TrajectoryFrameMagic || length > file.GetSize() - offset - FrameHeaderSize)
+  {
+    return false;
+  }
+
+  const unsigned char *payload = data + offset + FrameHeaderSize;
+  const unsigned char *end = payload + length;
+
+  unsigned long long step, count;
+  if(!GetVarint(payload, end, step) || payload == end)
+  {
+    return false;
+  }
+
+  bool keyframe = *payload++ != 0;
+  if(!GetVarint(payload, end, count) || count > length)
+  {
+    return false;
+  }
+
+  // Numbered from one, like the recorder does.
+  unsigned int id = frame + 1;
+
+  frameSlots.clear();
+  unsigned long long next = 0;
+  for(unsigned long long i = 0; i < count; ++i)
+  {
+    unsigned long long gap, generation;
+    if(!GetVarint(payload, end, gap) || !GetVarint(payload, end, generation))
+    {
+      return false;
+    }
+
+    // Every ball takes at least a byte per value, which bounds the slots.
+    unsigned long long slot = next + gap;
+    if(slot >= next + length)
+    {
+      return false;
+    }
+    next = slot + 1;
+
+    if(baseFrame.size() <= slot)
+    {
+      base.resize((slot + 1) * ValuesPerBall, 0);
+      baseGeneration.resize(slot + 1, 0);
+      baseFrame.resize(slot + 1, 0);
+    }
+
+    bool known = !keyframe && baseFrame[slot] == id - 1 && baseGeneration[slot] == generation;
+    long long *values = &base[slot * ValuesPerBall];
+
+    for(unsigned int v = 0; v < ValuesPerBall; ++v)
+    {
+      unsigned long long delta;
+      if(!GetVarint(payload, end, delta))
+      {
+        return false;
+      }
+      values[v] = (known ? values[v] : 0) + UnZigZag(delta);
+    }
+
+    baseGeneration[slot] = static_cast<unsigned int>(generation);
+    baseFrame[slot] = id;
+    frameSlots.push_back(static_cast<unsigned int>(slot));
+  }
+
+  return true;
+}
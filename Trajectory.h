@@ -0,0 +1,183 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Vector2D.h"
+#include "BallStore.h"
+#include "Snapshot.h"
+
+// How a trajectory file is recorded.
+struct TrajectorySettings
+{
+  // Constructor, sets the defaults.
+  TrajectorySettings();
+
+  // A frame is recorded every this many calls to Record.
+  unsigned int Interval;
+
+  /* Values are stored as whole multiples of these, in meters, meters per
+   * second and radians. Anything finer than half a quantum is lost. */
+  double PositionQuantum;
+  double VelocityQuantum;
+  double OrientationQuantum;
+
+  // Every this many frames one is stored on its own, readers seek to those.
+  unsigned int KeyframeInterval;
+
+  // Frames that may wait for the disk before new ones are dropped.
+  unsigned int QueueCapacity;
+};
+
+/* Streams the position, velocity and orientation of every ball to a file.
+ * Values are quantized to integers and stored as the difference to the
+ * same ball in the frame before, which is mostly a byte or two per value.
+ * Balls are matched by their handle, so balls may come and go.
+ *
+ * Frames are encoded on the thread calling Record and written by a
+ * thread of the recorder, so the step never waits for the disk. If the
+ * disk falls behind so far that all QueueCapacity buffers are waiting,
+ * frames are dropped rather than waited for; the next frame is stored
+ * against the last one that made it, so the file stays readable.
+ *
+ * Close writes an index of all frames to the end of the file. A file
+ * that was never closed can still be read up to its last whole frame. */
+class TrajectoryRecorder
+{
+public:
+  // Constructor
+  TrajectoryRecorder();
+
+  // Destructor, closes the file.
+  ~TrajectoryRecorder();
+
+  bool Open(const char *path, const TrajectorySettings &settings = TrajectorySettings());
+
+  // Writes out the frames still waiting and the index.
+  void Close();
+
+  // Call once per step, records a frame every Interval calls.
+  void Record(const BallStore &balls);
+
+  bool IsOpen() const;
+  unsigned int GetFramesRecorded() const;
+  unsigned int GetFramesDropped() const;
+
+private:
+  struct IndexEntry
+  {
+    unsigned long long Offset;
+    unsigned int Step;
+    unsigned int Keyframe;
+  };
+
+  // Encodes a frame into a buffer, against the previous frame unless keyframe.
+  void Encode(const BallStore &balls, unsigned int step, bool keyframe,
+              std::vector<unsigned char> &buffer);
+
+  void WriterLoop();
+
+  FILE *file;
+  TrajectorySettings settings;
+  unsigned int calls;
+  unsigned int framesRecorded;
+  unsigned int framesDropped;
+
+  // Quantized values of the last recorded frame, by handle slot.
+  std::vector<long long> base;
+  std::vector<unsigned int> baseGeneration;
+  std::vector<unsigned int> baseFrame;
+
+  // Ball indices sorted by slot, rebuilt for every frame.
+  std::vector<unsigned int> slotBall;
+
+  /* Encoded frames travel from Record to the writer through these.
+   * Buffers keep their memory, so a running recorder does not allocate. */
+  std::vector<std::vector<unsigned char> > buffers;
+  std::vector<unsigned int> bufferStep;
+  std::vector<unsigned int> bufferKeyframe;
+  std::vector<unsigned int> freeBuffers;
+  std::vector<unsigned int> queued;
+  size_t queueHead;
+
+  // Only touched by the writer thread until it is joined.
+  std::vector<IndexEntry> index;
+  unsigned long long offset;
+
+  std::thread writer;
+  std::mutex lock;
+  std::condition_variable wake;
+  bool closing;
+};
+
+// One frame read back from a trajectory file.
+struct TrajectoryFrame
+{
+  unsigned int Step;
+  std::vector<BallHandle> Handles;
+  std::vector<Vector2D> Position;
+  std::vector<Vector2D> Velocity;
+  std::vector<double> Orientation;
+};
+
+/* Reads trajectory files, with any frame reachable through the index.
+ * Going to a frame decodes forward from the keyframe before it, reading
+ * the frames in order only decodes each one once. */
+class TrajectoryReader
+{
+public:
+  // Constructor
+  TrajectoryReader();
+
+  // Destructor
+  ~TrajectoryReader();
+
+  bool Open(const char *path);
+  void Close();
+
+  unsigned int GetFrameCount() const;
+  const TrajectorySettings& GetSettings() const;
+
+  // Returns the step a frame was recorded at without decoding it.
+  unsigned int GetFrameStep(unsigned int frame) const;
+
+  // Decodes a frame, returns false if it does not exist or is damaged.
+  bool ReadFrame(unsigned int frame, TrajectoryFrame &out);
+
+private:
+  struct IndexEntry
+  {
+    unsigned long long Offset;
+    unsigned int Step;
+    unsigned int Keyframe;
+  };
+
+  // Walks the frames one by one, for files that were never closed.
+  void ScanFrames(size_t first);
+
+  bool DecodeFrame(unsigned int frame);
+
+  MappedFile file;
+  TrajectorySettings settings;
+  std::vector<IndexEntry> index;
+
+  // State after the last decoded frame, by handle slot.
+  std::vector<long long> base;
+  std::vector<unsigned int> baseGeneration;
+  std::vector<unsigned int> baseFrame;
+  std::vector<unsigned int> frameSlots;
+  unsigned int decodedFrame;
+};
+
+// Inlined accessors
+inline bool TrajectoryRecorder::IsOpen() const { return file != nullptr; }
+inline unsigned int TrajectoryRecorder::GetFramesRecorded() const { return framesRecorded; }
+inline unsigned int TrajectoryRecorder::GetFramesDropped() const { return framesDropped; }
+inline unsigned int TrajectoryReader::GetFrameCount() const { return static_cast<unsigned int>(index.size()); }
+inline const TrajectorySettings& TrajectoryReader::GetSettings() const { return settings; }
+inline unsigned int TrajectoryReader::GetFrameStep(unsigned int frame) const { return index[frame].Step; }
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+/* Three copies of a value passed from one writing thread to one reading
+ * thread without locks or waiting. The writer fills its own copy and
+ * publishes it, the reader picks up the latest published copy and may
+ * read it for as long as it likes. The third copy sits between the two,
+ * so neither ever has to wait for the other; copies published while
+ * the reader was busy are skipped.
+ *
+ * The copies are reused in turn, so a value holding vectors stops
+ * allocating once each copy has grown to size. */
+template<typename T>
+class TripleBuffer
+{
+public:
+  // Constructor
+  TripleBuffer();
+
+  // The copy the writer fills, only the writer may use it.
+  T& GetWriteBuffer();
+
+  // Hands the write buffer to the reader and starts on another copy.
+  void Publish();
+
+  /* Picks up the latest published copy if there is one the reader has
+   * not seen yet. Returns true if it did. */
+  bool Acquire();
+
+  // The copy the reader picked up last, only the reader may use it.
+  const T& GetReadBuffer() const;
+
+  // Returns true while a published copy has not been picked up.
+  bool IsPending() const;
+
+private:
+  // Not copyable, the exchange is atomic.
+  TripleBuffer(const TripleBuffer &);
+  TripleBuffer& operator=(const TripleBuffer &);
+
+  // The index of the copy in the middle, with a flag if it is new.
+  static const unsigned int IndexMask = 3;
+  static const unsigned int Fresh = 4;
+
+  T copies[3];
+  unsigned int writeIndex;
+  unsigned int readIndex;
+  std::atomic<unsigned int> middle;
+};
+
+template<typename T>
+TripleBuffer<T>::TripleBuffer()
+{
+  writeIndex = 0;
+  middle.store(1);
+  readIndex = 2;
+}
+
+template<typename T>
+inline T& TripleBuffer<T>::GetWriteBuffer()
+{
+  return copies[writeIndex];
+}
+
+template<typename T>
+void TripleBuffer<T>::Publish()
+{
+  // Whatever was in the middle becomes the next copy to write.
+  writeIndex = middle.exchange(writeIndex | Fresh, std::memory_order_acq_rel) & IndexMask;
+}
+
+template<typename T>
+bool TripleBuffer<T>::Acquire()
+{
+  if((middle.load(std::memory_order_relaxed) & Fresh) == 0)
+  {
+    return false;
+  }
+
+  readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & IndexMask;
+  return true;
+}
+
+template<typename T>
+inline const T& TripleBuffer<T>::GetReadBuffer() const
+{
+  return copies[readIndex];
+}
+
+template<typename T>
+inline bool TripleBuffer<T>::IsPending() const
+{
+  return (middle.load(std::memory_order_acquire) & Fresh) != 0;
+}
+
+#endif
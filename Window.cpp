@@ -1,39 +1,90 @@
 #include "Window.h"
-#include "Ball.h"
+#include <algorithm>
+#include <cmath>
 #include "Line.h"
 #include "Physics.h"
 
 extern const double MetersPerPixel;
 
+// File the world is saved to and loaded from.
+const char SnapshotFile[] = "balls.snapshot";
+
+// Seed of the balls added, the same on every run and every machine.
+const unsigned long long BallSeed = 1;
+
+// Balls added are one of this many sizes, from the smallest up.
+const unsigned int BallSizes = 18;
+const unsigned int SmallestBallSize = 19;
+
+// Past this many changed rectangles the whole frame is copied in one go.
+const unsigned int MaxPresentRects = 64;
+
+// Zoom for one notch of the mouse wheel or one key press.
+const double ZoomStep = 1.1;
+
+// How far from the mouse a ball may be to be picked to follow, in pixels.
+const double PickDistance = 40.0;
+
+// Returns true if two sets of lines lie in the same places.
+static bool SameGeometry(const std::vector<Line> &a, const std::vector<Line> &b)
+{
+  if(a.size() != b.size())
+  {
+    return false;
+  }
+
+  for(unsigned int i = 0; i < a.size(); ++i)
+  {
+    if(a[i].GetStart().X != b[i].GetStart().X || a[i].GetStart().Y != b[i].GetStart().Y ||
+       a[i].GetEnd().X != b[i].GetEnd().X || a[i].GetEnd().Y != b[i].GetEnd().Y)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
 using Gdiplus::Graphics;
 
 Window::Window(HINSTANCE instance, UINT width, UINT height)
+  : simulation(world, scheduler, &profiler)
 {
   this->width = width;
   this->height = height;
   this->appInstance = instance;
   this->gdiStartToken = 0;
-  this->bufferGraphics = nullptr;
   this->windowGraphics = nullptr;
   this->backBuffer = nullptr;
-  this->globalRestitution = 1.0f;
-  this->ballCollisionsOn = true;
+  this->hudBitmap = nullptr;
+  this->hudGraphics = nullptr;
+  this->hudDrawn = false;
+  this->presentAll = true;
+  this->drawnCameraVersion = 0;
+  this->pickFollowed = false;
+  this->mouseX = 0;
+  this->mouseY = 0;
+  this->dragging = false;
+
+  // The physics runs at 100 steps per second with two substeps each.
+  scheduler.SetStepTime(0.01);
+  scheduler.SetSubsteps(2);
+  scheduler.SetMaxStepsPerFrame(10);
+
+  world.SetThreadPool(&threadPool);
+  world.SetProfiler(&profiler);
+  showProfiler = false;
 }
 
 Window::~Window()
 {
+  delete hudGraphics;
+  delete hudBitmap;
   delete backBuffer;
-  delete bufferGraphics;
   delete windowGraphics;
   delete fpsFont;
   delete fpsStrBuffer;
 
-  // Remove all resources used by our balls.
-  for(Ball *b : balls) delete b;
-
-  // Clear the pointers to the balls.
-  balls.clear();
-
   // Must be called last, can't remove gdi+ objects once its closed.
   GdiplusShutdown(gdiStartToken);
 }
@@ -84,26 +135,51 @@ bool Window::Initialize()
 
   HDC hdc = GetDC(hWindow);
   windowGraphics = new Graphics(hdc);
-  backBuffer = new Bitmap(width, height, windowGraphics);
-  bufferGraphics = new Graphics(backBuffer);
 
-  // Transform used to turn our coordinates in meters into pixels.
-  // Also inverts the y axis to produce a more typical coordinate system.
-  screenTransformMat =
-    Matrix3x3::ScaleUniform(1.0f / MetersPerPixel) *
-    Matrix3x3::Translation(0, -((int)height)) *
-    Matrix3x3::Scale(1, -1); 
+  framebuffer.Resize(width, height);
+  backBuffer = new Bitmap(width, height, width * 4, PixelFormat32bppPARGB,
+    reinterpret_cast<BYTE *>(framebuffer.GetPixels()));
+  LoadBallSprite(L"ball.png");
+
+  // GDI+ draws the text straight into the HUD layer's pixels.
+  hudLayer.Resize(width, height);
+  hudLayer.Clear(0);
+  hudBitmap = new Bitmap(width, height, width * 4, PixelFormat32bppPARGB,
+    reinterpret_cast<BYTE *>(hudLayer.GetPixels()));
+  hudGraphics = new Graphics(hudBitmap);
+
+  // ClearType needs something opaque to draw on, the layer is see through.
+  hudGraphics->SetTextRenderingHint(TextRenderingHintAntiAlias);
+
+  // Only what moved or changed is drawn again each frame.
+  renderer.SetOverlay(&hudLayer);
+  renderer.SetIncremental(true);
+
+  // The camera turns our coordinates in meters into pixels, y pointing up.
+  camera.SetViewport(width, height);
+  ResetCamera();
+  renderer.SetTransform(camera.GetTransform());
+  drawnCameraVersion = camera.GetVersion();
+
+  // Balls only come in the sizes AddBall makes, turn those ahead of time.
+  std::vector<unsigned int> radii;
+  for(unsigned int size = 0; size < BallSizes; ++size)
+  {
+    double radius = (SmallestBallSize + size) / 100.0;
+    radii.push_back(static_cast<unsigned int>(radius / MetersPerPixel + 0.5));
+  }
+  renderer.GetSpriteCache().Prepare(renderer.GetBallSprite(), radii, &threadPool);
 
 
   // Test Line
-  lines.push_back(new Line(this, Vector2D(0.5f, 5.0f), Vector2D(7.5f, 5.0f)));
-  lines.push_back(new Line(this, Vector2D(7.5f, 5.0f), Vector2D(7.5f, 0.2f)));
-  lines.push_back(new Line(this, Vector2D(0.5f, 0.2f), Vector2D(7.5f, 0.2f)));
-  lines.push_back(new Line(this, Vector2D(0.5f, 5.0f), Vector2D(0.5f, 0.2f)));
-
-  lines.push_back(new Line(this, Vector2D(2.7f, 2.3f), Vector2D(5.2f, 3.8f)));
-  lines.push_back(new Line(this, Vector2D(3.2f, 0.2f), Vector2D(5.1f, 0.9f)));
-  lines.push_back(new Line(this, Vector2D(5.1f, 0.9f), Vector2D(5.5f, 0.2f)));
+  world.AddLine(Line(Vector2D(0.5f, 5.0f), Vector2D(7.5f, 5.0f)));
+  world.AddLine(Line(Vector2D(7.5f, 5.0f), Vector2D(7.5f, 0.2f)));
+  world.AddLine(Line(Vector2D(0.5f, 0.2f), Vector2D(7.5f, 0.2f)));
+  world.AddLine(Line(Vector2D(0.5f, 5.0f), Vector2D(0.5f, 0.2f)));
+
+  world.AddLine(Line(Vector2D(2.7f, 2.3f), Vector2D(5.2f, 3.8f)));
+  world.AddLine(Line(Vector2D(3.2f, 0.2f), Vector2D(5.1f, 0.9f)));
+  world.AddLine(Line(Vector2D(5.1f, 0.9f), Vector2D(5.5f, 0.2f)));
   
   
   ResetBalls();
@@ -115,14 +191,37 @@ bool Window::Initialize()
   return true;
 }
 
-void Window::ResetBalls()
+void Window::LoadBallSprite(const WCHAR *path)
 {
-  for(Ball *pBall : balls)
+  // Without the picture the renderer's own ball is used.
+  Bitmap image(path);
+  if(image.GetLastStatus() != Ok)
   {
-    delete pBall;
+    return;
   }
-  balls.clear();
-  balls.shrink_to_fit();
+
+  Rect rect(0, 0, image.GetWidth(), image.GetHeight());
+  BitmapData data;
+  if(image.LockBits(&rect, ImageLockModeRead, PixelFormat32bppPARGB, &data) == Ok)
+  {
+    renderer.GetBallSprite().Load(data.Width, data.Height,
+      static_cast<const unsigned int *>(data.Scan0), data.Stride / 4);
+    image.UnlockBits(&data);
+  }
+}
+
+void Window::ResetCamera()
+{
+  // The corner of the world in the corner of the window, as the box was laid out.
+  camera.StopFollowing();
+  camera.SetZoom(1.0 / MetersPerPixel);
+  camera.SetCenter(Vector2D(width * 0.5 * MetersPerPixel, height * 0.5 * MetersPerPixel));
+}
+
+void Window::ResetBalls()
+{
+  simulation.Post(SimCommand(CommandClearBalls));
+  random.Seed(BallSeed);
 
   AddBall();
 
@@ -131,12 +230,28 @@ void Window::ResetBalls()
 void Window::AddBall()
 {
   // Test ball
-  Ball *b = new Ball(this);
-  float sz = rand() % 18 + 19;
-  b->Initialize(sz / 13.0f, sz / 100.0f, Vector2D(4.8f, 3.9f));
-  balls.push_back(b);
+  float sz = random.NextInt(BallSizes) + SmallestBallSize;
+
+  SimCommand command(CommandAddBall);
+  command.Mass = sz / 13.0f;
+  command.Radius = sz / 100.0f;
+  command.Position = Vector2D(4.8f, 3.9f);
+  simulation.Post(command);
+}
+
+void Window::SaveWorld()
+{
+  SimCommand command(CommandSaveSnapshot);
+  command.Path = SnapshotFile;
+  simulation.Post(command);
 }
 
+void Window::LoadWorld()
+{
+  SimCommand command(CommandLoadSnapshot);
+  command.Path = SnapshotFile;
+  simulation.Post(command);
+}
 
 bool Window::Run()
 {
@@ -153,11 +268,13 @@ bool Window::Run()
   frames = 0;
   lastFps = 0;
 
-  // Maximum simulation time used as a temporary fix for physics breaking when moving window.
-  double maxStep = 0.01;
-  
+  // From here on the world belongs to the simulation thread.
+  simulation.Start();
+
   while(true)
   {
+    drawProfiler.BeginFrame();
+
     if(PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
     {
       if(msg.message == WM_QUIT)
@@ -165,24 +282,17 @@ bool Window::Run()
         break;
       }
 
+      ProfileScope zone(&drawProfiler, "messages");
       TranslateMessage(&msg);
       DispatchMessage(&msg);
     }
 
     delta = timer.DeltaTime();
-
-    // Temporary.
-    if(delta > maxStep)
-    {
-      UpdateSimulation(maxStep);
-    }
-    else
-    {
-      UpdateSimulation(delta);
-    }
-    
+    camera.Update(delta);
 
     Draw();
+    drawProfiler.EndFrame();
+
     frames++;
     frameTimer += delta;
     if(frameTimer >= 1.0)
@@ -193,252 +303,386 @@ bool Window::Run()
     }
   }
 
+  simulation.Stop();
   return true;
 }
 
-void Window::UpdateSimulation(double deltaTime)
+void Window::ChangeRestitution(double change)
 {
-  for(Ball *ball : balls)
-  {
-    for(Line *line : lines)
-    {
-      Vector2D closest = ClosestPointOnLine(ball->Position, (*line));
+  SimCommand command(CommandChangeRestitution);
+  command.Value = change;
+  simulation.Post(command);
+}
 
-      if(closest.X < line->GetStart().X)
-      {
-        closest = line->GetStart();
-      }
-      else if(closest.X > line->GetEnd().X)
-      {
-        closest = line->GetEnd();
-      }
+Gdiplus::Point Window::TransformToWindow(const Vector2D &vec) const
+{
+  Vector2D transformed = Vector2D::Transform(vec, camera.GetTransform());
+
+  return Gdiplus::Point(static_cast<int>(transformed.X),
+    static_cast<int>(transformed.Y));
+}
+
+void Window::GetFpsString(WCHAR *buffer, int size)
+{
+  if(size < 11) return;
 
-      float distance = (ball->Position - closest).Length();
+  // Counted over a whole second, so the text only changes once a second.
+  swprintf(buffer, L"FPS: %4d ", lastFps);
+}
 
-      /* If the distance between the balls center and the line
-       * is smaller than the balls radius, we have a collision. */
-      if(distance < ball->Radius)
+void Window::UpdateFollow(const FrameState &frame, double alpha)
+{
+  if(pickFollowed)
+  {
+    // The ball closest to the mouse, if any is near enough.
+    Vector2D mouse = camera.ToWorld(mouseX, mouseY);
+    double best = PickDistance / camera.GetZoom();
+    int picked = -1;
+
+    frame.Grid.Query(mouse, best, [&](unsigned int i)
+    {
+      double distance = std::sqrt((frame.Position[i] - mouse).LengthSquared()) - frame.Radius[i];
+      if(distance < best)
       {
-        Vector2D lineVec = line->GetEnd() - line->GetStart();
-        
-        /* Newtons laws of physics gives us that for every action
-         * theres an equal and opposite reaction. 
-         * Because of this we can calculate the force applied to the ball
-         * by calculating the force the ball exerts on the line. */
-
-        // The lines normal as a unit vector will be the direction.
-        Vector2D surfaceNorm = lineVec.Perpendicular().Unit();
-
-        /* In order to get the magnitude of the force we will calculate
-         * the impulse caused by the ball.
-         * Since the ball must not penetrate the line we can assume
-         * that the force must be equal to whatever force the ball
-         * exerts on the line along its normal. */
-
-        // Here we project the balls momentum on the lines normal.
-        double mag = Vector2D::Dot(ball->Velocity * ball->Mass, surfaceNorm);
-
-        /* The response will now be to add the velocity change caused by
-         * the opposite impulse. */
-        ball->ApplyImpulse(surfaceNorm * -(1.0 + line->GetRestitution()) * mag);
-
-        // Separate the ball from the line
-        if(mag >= 0)
-        {
-          ball->Position += surfaceNorm * -(ball->Radius - distance);
-        }
-        else
-        {
-          ball->Position += surfaceNorm * (ball->Radius - distance);
-        }
-       
-        /* Next we calculate the angular impulse by using the difference in
-        velocities between the objects along the surface. */
-
-        // We calculate the force parallell to the surface
-        double d = Vector2D::Dot(ball->Velocity * ball->Mass, lineVec.Unit());
-        // Calculate the actual distance between the ball's center and the closest point on the line.
-        double r = (closest - ball->Position).Length();
-        // Calculate the angular impulse as the force parallell to the surface, scaled up by our scale factor for using metres
-       
-        double angImpulse = d * 256 / (3.141592 * ball->Mass) // 256 is scale factor for using metres
-          -(1.0 + line->GetRestitution()) * r * ball->AngularVelocity;
-
-        // Finally we apply the angular impulse!
-        ball->ApplyAngularImpulse(angImpulse);
+        best = distance;
+        picked = static_cast<int>(i);
       }
-    }
-    if(ballCollisionsOn)
+    });
+
+    if(picked >= 0)
     {
-      DoBallCollisions(ball);
+      followed = frame.Handles[picked];
+      camera.Follow(frame.Position[picked]);
     }
-    // Update our ball
-    Update(ball, deltaTime);
+    pickFollowed = false;
   }
-}
 
-void Window::DoBallCollisions(Ball *pBall)
-{
-  for(Ball *pOther : balls)
+  if(!camera.IsFollowing())
   {
-    // Ignore doing collisions against itself..
-    if(pOther == pBall) continue;
+    return;
+  }
 
-    double minDistance = pBall->Radius + pOther->Radius;
-    Vector2D diff = pBall->Position - pOther->Position;
-    
-    if(diff.Length() > minDistance)
+  // Balls move around in the store, look it up by its handle.
+  for(unsigned int i = 0; i < frame.Handles.size(); ++i)
+  {
+    if(frame.Handles[i].Slot == followed.Slot && frame.Handles[i].Generation == followed.Generation)
     {
-      // Balls are not intersecting..
-      continue;
+      camera.Follow(frame.PreviousPosition[i] * (1.0 - alpha) + frame.Position[i] * alpha);
+      return;
     }
+  }
 
-    // Point of collision is the balls position +
-    // the diff vector(unit) scaled by the balls radius
-    Vector2D colPoint = pBall->Position + diff.Unit() * pBall->Radius;
-
-    // We can now calculate the relative velocity based on the angular velocity
-    // of the two balls togther with their linear velocities.
-
-    Vector2D rBallP = (colPoint - pBall->Position).Perpendicular();
-    Vector2D rOtherP = (colPoint - pOther->Position).Perpendicular();
-
-    Vector2D pointVelBall = pBall->Velocity + rBallP * pBall->AngularVelocity;
+  // It is gone, stay where we are.
+  camera.StopFollowing();
+}
 
-    Vector2D pointVelOther = pOther->Velocity + rOtherP * pOther->AngularVelocity;
+void Window::DrawScene(const FrameState &frame, double alpha)
+{
+  UpdateFollow(frame, alpha);
 
-    Vector2D relativeVelocity = pointVelBall - pointVelOther;
+  // Moving the camera changes every pixel, the renderer starts over.
+  if(camera.GetVersion() != drawnCameraVersion)
+  {
+    renderer.SetTransform(camera.GetTransform());
+    drawnCameraVersion = camera.GetVersion();
+  }
 
-    // The collision normal is easy to find with circles, its simply the vector between the collision
-    // point and the incident circle.
-    Vector2D colNormal = (colPoint - pBall->Position).Unit();
-    
-    double angA = pow(Vector2D::Dot(rBallP, colNormal), 2.0) / (pBall->Mass * pow(pBall->Radius, 2.0));
-    double angB = pow(Vector2D::Dot(rOtherP, colNormal), 2.0) / (pOther->Mass * pow(pBall->Radius, 2.0));
+  // Balls just outside still bleed a pixel or two into the view.
+  Vector2D viewMin, viewMax;
+  camera.GetVisibleArea(viewMin, viewMax);
+  Vector2D margin(2.0 / camera.GetZoom(), 2.0 / camera.GetZoom());
+  viewMin = viewMin - margin;
+  viewMax = viewMax + margin;
 
-    double denominator = (1.0 / pBall->Mass + 1.0 / pOther->Mass) +
-      pow(Vector2D::Dot(rBallP, colNormal), 2.0) / (pBall->Mass * pow(pBall->Radius, 2.0)) +
-      pow(Vector2D::Dot(rOtherP, colNormal), 2.0) / (pOther->Mass * pow(pBall->Radius, 2.0));
+  if(!SameGeometry(frame.Lines, treeLines))
+  {
+    treeLines = frame.Lines;
+    lineTree.Build(treeLines);
+  }
 
-    double e = 0.85f;
+  // Sorted back into the order of the frame, so overlaps are drawn the same wherever the view is.
+  visibleLines.clear();
+  lineTree.Query(viewMin, viewMax, [&](unsigned int i) { visibleLines.push_back(i); });
+  std::sort(visibleLines.begin(), visibleLines.end());
 
-    double j = -(1.0 + e) * Vector2D::Dot(relativeVelocity, colNormal) /
-      denominator;
+  visibleBalls.clear();
+  frame.Grid.QueryBox(viewMin, viewMax, [&](unsigned int i) { visibleBalls.push_back(i); });
+  std::sort(visibleBalls.begin(), visibleBalls.end());
 
-    pBall->Velocity = pBall->Velocity + colNormal *( j / pBall->Mass);
-    pOther->Velocity = pOther->Velocity - colNormal *( j / pOther->Mass);
+  renderer.Begin(framebuffer, MakeColor(0, 0, 0));
 
-    pBall->AngularVelocity = pBall->AngularVelocity + Vector2D::Dot(rBallP, colNormal * j) /
-      (0.5 * pBall->Mass * pow(pBall->Radius, 2.0));
+  for(unsigned int i : visibleLines)
+  {
+    renderer.AddLine(frame.Lines[i]);
+  }
 
-    pOther->AngularVelocity = pOther->AngularVelocity - Vector2D::Dot(rOtherP, colNormal * j) /
-      (0.5 * pOther->Mass * pow(pOther->Radius, 2.0));
+  // Blend between the last two steps by how far into the next step we are.
+  for(unsigned int i : visibleBalls)
+  {
+    Vector2D position = frame.PreviousPosition[i] * (1.0 - alpha) +
+      frame.Position[i] * alpha;
+    double orientation = frame.PreviousOrientation[i] * (1.0 - alpha) +
+      frame.Orientation[i] * alpha;
 
-    double overlap = diff.Length() - minDistance;
-    double sumMass = pBall->Mass + pOther->Mass;
-    pBall->Position += diff.Unit() * -(overlap /  2.0);
-    pOther->Position += diff.Unit() * (overlap / 2.0);
+    renderer.AddBall(position, frame.Radius[i], orientation);
   }
+
+  renderer.End();
 }
 
-void Window::UpdateGlobalRestitution()
+void Window::DrawProfiler(Graphics *g, Brush *brush, const FrameState &frame)
 {
-  for(Line *line : lines)
+  /* A frame runs several steps, so zones with the same name are added
+   * up. They are listed in the order they first showed up in, those of
+   * the simulation first. */
+  const unsigned int MaxRows = 24;
+  const char *names[MaxRows];
+  unsigned int depths[MaxRows];
+  double times[MaxRows];
+  unsigned int rows = 0;
+
+  const std::vector<ProfileZone> *frames[] = { &frame.Zones, &drawProfiler.GetLastFrame() };
+
+  for(const std::vector<ProfileZone> *zones : frames)
   {
-    line->SetRestitution(globalRestitution);
-  }
-}
+    for(const ProfileZone &zone : *zones)
+    {
+      unsigned int row = 0;
+      while(row < rows && names[row] != zone.Name)
+      {
+        row++;
+      }
 
-Gdiplus::Point Window::TransformToWindow(const Vector2D &vec) const
-{
-  Vector2D transformed = Vector2D::Transform(vec, screenTransformMat);
+      if(row == rows)
+      {
+        if(rows == MaxRows)
+        {
+          continue;
+        }
 
-  return Gdiplus::Point(static_cast<int>(transformed.X),
-    static_cast<int>(transformed.Y));
-}
+        names[row] = zone.Name;
+        depths[row] = zone.Depth;
+        times[row] = 0.0;
+        rows++;
+      }
 
-void Window::GetFpsString(WCHAR *buffer, int size)
-{
-  if(size < 11) return;
+      times[row] += zone.Duration;
+    }
+  }
 
-  double fps = frames + (lastFps * (1.0 - frameTimer));
-  swprintf(buffer, L"FPS: %4.2f ", fps);
+  wchar_t buffer[64];
+  float y = 50;
+
+  for(unsigned int row = 0; row < rows; ++row, y += 18)
+  {
+    swprintf(buffer, L"%*S%-16S%7.3f ms\0", static_cast<int>(depths[row] * 2), "", names[row], times[row] / 1000.0);
+    g->DrawString(buffer, lstrlenW(buffer), fpsFont, PointF(width - 320, y), NULL, brush);
+  }
+
+  y += 10;
+  for(unsigned int i = 0; i < CounterCount; ++i, y += 18)
+  {
+    ProfileCounter counter = static_cast<ProfileCounter>(i);
+    swprintf(buffer, L"%-18S%9llu\0", Profiler::GetCounterName(counter), frame.Counts[counter]);
+    g->DrawString(buffer, lstrlenW(buffer), fpsFont, PointF(width - 320, y), NULL, brush);
+  }
 }
 
 void Window::Draw()
 {  
-  Gdiplus::SolidBrush clearBrush(Color(0, 0, 0));
-
-  bufferGraphics->FillRectangle(&clearBrush, 0, 0, width, height);
+  ProfileScope drawZone(&drawProfiler, "draw");
+  // The latest step the simulation thread has finished, it may be busy with the next.
+  const FrameState &frame = simulation.AcquireFrame();
 
-
-  for(Line *line : lines)
   {
-    line->Draw(bufferGraphics);
+    // The renderer blends it over the scene, so it has to be ready first.
+    ProfileScope zone(&drawProfiler, "hud");
+    DrawHud(frame);
   }
 
-  for(Ball *ball : balls)
   {
-    ball->Draw(bufferGraphics);
+    ProfileScope zone(&drawProfiler, "scene");
+    DrawScene(frame, frame.GetAlpha(GameTimer::Now()));
   }
 
+  ProfileScope zone(&drawProfiler, "present");
+  Present();
+}
+
+void Window::ClearHud(const PixelRect &rect)
+{
+  hudLayer.Fill(rect, 0);
+  renderer.Invalidate(rect);
+}
 
+void Window::DrawHud(const FrameState &frame)
+{
   SolidBrush fontBrush(Color(255, 255, 255));
-  GetFpsString(fpsStrBuffer, 20);
-  bufferGraphics->DrawString(
-    fpsStrBuffer,
-    lstrlenW(fpsStrBuffer),
-    fpsFont,
-    PointF(width - 200, 20),
-    NULL,
-    &fontBrush
-  );
 
-  wchar_t buffer[30];
-  swprintf(buffer, L"Reset Balls\t\t[SPACE]\0");
-    bufferGraphics->DrawString(
-    buffer,
-    lstrlenW(buffer),
-    fpsFont,
-    PointF(20, 20),
-    NULL,
-    &fontBrush
-  );
+  if(!hudDrawn || shownFps != lastFps)
+  {
+    ClearHud(PixelRect(width - 210, 15, width, 45));
+
+    GetFpsString(fpsStrBuffer, 20);
+    hudGraphics->DrawString(
+      fpsStrBuffer,
+      lstrlenW(fpsStrBuffer),
+      fpsFont,
+      PointF(width - 200, 20),
+      NULL,
+      &fontBrush
+    );
+    shownFps = lastFps;
+  }
 
-  swprintf(buffer, L"Add Ball\t\t[C]\0");
-    bufferGraphics->DrawString(
-    buffer,
-    lstrlenW(buffer),
-    fpsFont,
-    PointF(20, 45),
-    NULL,
-    &fontBrush
-  );
+  // In lockstep the step number changes every frame, otherwise only a key does.
+  bool menuChanged = !hudDrawn || shownCollisions != frame.BallCollisions ||
+    shownRestitution != frame.Restitution || shownLockstep != frame.Lockstep ||
+    shownProfiler != showProfiler || shownFollowing != camera.IsFollowing() ||
+    (frame.Lockstep && shownStep != frame.StepCount);
 
-  wchar_t *onStr = ballCollisionsOn ? L"ON" : L"OFF";
-  swprintf(buffer, L"BallCollisions: %s\t[B]\0", onStr);
-  bufferGraphics->DrawString(
-    buffer,
-    lstrlenW(buffer),
-    fpsFont,
-    PointF(20, 67),
-    NULL,
-    &fontBrush
-  );
+  if(menuChanged)
+  {
+    ClearHud(PixelRect(0, 15, 440, 215));
+
+    wchar_t buffer[30];
+    swprintf(buffer, L"Reset Balls\t\t[SPACE]\0");
+    hudGraphics->DrawString(
+      buffer,
+      lstrlenW(buffer),
+      fpsFont,
+      PointF(20, 20),
+      NULL,
+      &fontBrush
+    );
+
+    swprintf(buffer, L"Add Ball\t\t[C]\0");
+    hudGraphics->DrawString(
+      buffer,
+      lstrlenW(buffer),
+      fpsFont,
+      PointF(20, 45),
+      NULL,
+      &fontBrush
+    );
+
+    wchar_t *onStr = frame.BallCollisions ? L"ON" : L"OFF";
+    swprintf(buffer, L"BallCollisions: %s\t[B]\0", onStr);
+    hudGraphics->DrawString(
+      buffer,
+      lstrlenW(buffer),
+      fpsFont,
+      PointF(20, 67),
+      NULL,
+      &fontBrush
+    );
+
+    swprintf(buffer, L"Restitution: %1.2f\t[UP][DOWN]\0", frame.Restitution);
+    hudGraphics->DrawString(
+      buffer,
+      lstrlenW(buffer),
+      fpsFont,
+      PointF(20, 87),
+      NULL,
+      &fontBrush
+    );
+
+    swprintf(buffer, L"Save/Load World\t[F5][F9]\0");
+    hudGraphics->DrawString(
+      buffer,
+      lstrlenW(buffer),
+      fpsFont,
+      PointF(20, 107),
+      NULL,
+      &fontBrush
+    );
+
+    onStr = frame.Lockstep ? L"ON" : L"OFF";
+    swprintf(buffer, L"Lockstep: %s\t\t[L]\0", onStr);
+    hudGraphics->DrawString(
+      buffer,
+      lstrlenW(buffer),
+      fpsFont,
+      PointF(20, 127),
+      NULL,
+      &fontBrush
+    );
+
+    onStr = showProfiler ? L"ON" : L"OFF";
+    swprintf(buffer, L"Profiler: %s\t\t[P]\0", onStr);
+    hudGraphics->DrawString(
+      buffer,
+      lstrlenW(buffer),
+      fpsFont,
+      PointF(20, 147),
+      NULL,
+      &fontBrush
+    );
+
+    onStr = camera.IsFollowing() ? L"ON" : L"OFF";
+    swprintf(buffer, L"Follow: %s\t\t[F]\0", onStr);
+    hudGraphics->DrawString(
+      buffer,
+      lstrlenW(buffer),
+      fpsFont,
+      PointF(20, 167),
+      NULL,
+      &fontBrush
+    );
+
+    // Runs with the same input can be compared by this, step by step.
+    if(frame.Lockstep)
+    {
+      wchar_t hashBuffer[48];
+      swprintf(hashBuffer, L"Step %u  %016llx\0", frame.StepCount, frame.StateHash);
+      hudGraphics->DrawString(
+        hashBuffer,
+        lstrlenW(hashBuffer),
+        fpsFont,
+        PointF(20, 187),
+        NULL,
+        &fontBrush
+      );
+    }
 
-  swprintf(buffer, L"Restitution: %1.2f\t[UP][DOWN]\0", globalRestitution);
-  bufferGraphics->DrawString(
-    buffer,
-    lstrlenW(buffer),
-    fpsFont,
-    PointF(20, 87),
-    NULL,
-    &fontBrush
-  );
+    shownCollisions = frame.BallCollisions;
+    shownRestitution = frame.Restitution;
+    shownLockstep = frame.Lockstep;
+    shownFollowing = camera.IsFollowing();
+    shownStep = frame.StepCount;
+  }
+
+  // The times change every frame, once more to wipe them when turned off.
+  if(showProfiler || (hudDrawn && shownProfiler))
+  {
+    ClearHud(PixelRect(width - 330, 45, width, height));
+    if(showProfiler)
+    {
+      DrawProfiler(hudGraphics, &fontBrush, frame);
+    }
+  }
+
+  shownProfiler = showProfiler;
+  hudDrawn = true;
+}
 
+void Window::Present()
+{
+  const std::vector<PixelRect> &rects = renderer.GetDirtyRects();
 
+  // Many small copies cost more than one big one.
+  if(presentAll || rects.size() > MaxPresentRects)
+  {
+    windowGraphics->DrawImage(backBuffer, 0, 0, 0, 0, width, height, Unit::UnitPixel);
+    presentAll = false;
+    return;
+  }
 
-  windowGraphics->DrawImage(backBuffer, 0, 0, 0, 0, width, height, Unit::UnitPixel);
+  for(const PixelRect &rect : rects)
+  {
+    windowGraphics->DrawImage(backBuffer, rect.Left, rect.Top, rect.Left, rect.Top,
+      rect.GetWidth(), rect.GetHeight(), Unit::UnitPixel);
+  }
 }
 
 
@@ -451,29 +695,84 @@ LRESULT CALLBACK Window::WinProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPar
   case WM_DESTROY:
     PostQuitMessage(0);
     return 0;
+  case WM_PAINT:
+    // Whatever covered the window took its pixels, the next frame copies them all.
+    presentAll = true;
+    ValidateRect(hwnd, NULL);
+    return 0;
   case WM_KEYDOWN:
     keycode = LOWORD(wParam);
     switch(keycode)
     {
     case VK_UP:
-      globalRestitution += 0.05;
-      UpdateGlobalRestitution();
+      ChangeRestitution(0.05);
       break;
     case VK_DOWN:
-      globalRestitution -= 0.05;
-      UpdateGlobalRestitution();
+      ChangeRestitution(-0.05);
       break;
     case VK_SPACE:
       ResetBalls();
       break;
+    case VK_F5:
+      SaveWorld();
+      break;
+    case VK_F9:
+      LoadWorld();
+      break;
     }
     return 0;
   case WM_CHAR:
     keycode = LOWORD(wParam);
     if(keycode == 'b')
-      ballCollisionsOn = !ballCollisionsOn;
+      simulation.Post(SimCommand(CommandToggleBallCollisions));
     else if(keycode == 'c')
       AddBall();
+    else if(keycode == 'l')
+      simulation.Post(SimCommand(CommandToggleLockstep));
+    else if(keycode == 'p')
+      showProfiler = !showProfiler;
+    else if(keycode == 'f')
+    {
+      // Picks the ball under the mouse, or lets go of the one followed.
+      if(camera.IsFollowing())
+        camera.StopFollowing();
+      else
+        pickFollowed = true;
+    }
+    else if(keycode == 'h')
+      ResetCamera();
+    else if(keycode == '+' || keycode == '=')
+      camera.ZoomAt(ZoomStep, width * 0.5, height * 0.5);
+    else if(keycode == '-')
+      camera.ZoomAt(1.0 / ZoomStep, width * 0.5, height * 0.5);
+    return 0;
+  case WM_LBUTTONDOWN:
+    // Dragging with the left button pans the view.
+    dragging = true;
+    mouseX = static_cast<short>(LOWORD(lParam));
+    mouseY = static_cast<short>(HIWORD(lParam));
+    SetCapture(hwnd);
+    return 0;
+  case WM_LBUTTONUP:
+    dragging = false;
+    ReleaseCapture();
+    return 0;
+  case WM_MOUSEMOVE:
+    {
+      int x = static_cast<short>(LOWORD(lParam));
+      int y = static_cast<short>(HIWORD(lParam));
+      if(dragging)
+      {
+        camera.Pan(x - mouseX, y - mouseY);
+      }
+      mouseX = x;
+      mouseY = y;
+    }
+    return 0;
+  case WM_MOUSEWHEEL:
+    // Zooms in on what is under the mouse. The wheel gives screen positions, so use the last move.
+    camera.ZoomAt(std::pow(ZoomStep, static_cast<short>(HIWORD(wParam)) / static_cast<double>(WHEEL_DELTA)),
+      mouseX, mouseY);
     return 0;
   default:
     return DefWindowProc(hwnd, msg, wParam, lParam);
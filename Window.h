@@ -5,15 +5,19 @@
 #include <gdiplus.h>
 #include <vector>
 #include "GameTimer.h"
+#include "World.h"
+#include "StepScheduler.h"
+#include "SimulationThread.h"
+#include "Profiler.h"
+#include "Renderer.h"
+#include "Camera.h"
+#include "LineTree.h"
 #include "Matrix3x3.h"
+#include "Random.h"
 #include "Vector2D.h"
 
 using namespace Gdiplus;
 
-// Prototype.
-class Ball;
-class Line;
-
 class Window
 {
 public:
@@ -37,38 +41,122 @@ private:
   // Needs to be static due to memberfunction pointers being dumb.
   static LRESULT CALLBACK StaticWinProc(HWND, UINT, WPARAM, LPARAM);
   
-  // Updates the physics
-  void UpdateSimulation(double);
-
   // Called to draw the state of the physics.
   void Draw();
 
+  /* Draws the lines and balls of a frame that are in view, alpha blends
+   * between steps. */
+  void DrawScene(const FrameState &frame, double alpha);
+
+  // Points the camera at the ball followed, or picks one to follow.
+  void UpdateFollow(const FrameState &frame, double alpha);
+
+  // Shows the box the window starts with.
+  void ResetCamera();
+
+  // Turns the picture of the ball into the sprite balls are drawn with.
+  void LoadBallSprite(const WCHAR *path);
+
   void GetFpsString(WCHAR *buffer, int size);
 
-  void UpdateGlobalRestitution();
+  // Draws the parts of the HUD whose text changed since they were last drawn.
+  void DrawHud(const FrameState &frame);
+
+  // Wipes a part of the HUD and has the renderer draw what is under it again.
+  void ClearHud(const PixelRect &rect);
+
+  // Copies the parts of the back buffer the last frame changed to the window.
+  void Present();
+
+  /* Draws the time taken by each zone of the last simulation frame and
+   * the last drawn frame, and the counters of the simulation. */
+  void DrawProfiler(Graphics *g, Brush *brush, const FrameState &frame);
+
+  // These only post commands, the simulation thread carries them out.
+  void ChangeRestitution(double change);
   void ResetBalls();
-  void DoBallCollisions(Ball *pBall);
   void AddBall();
 
+  // Keeps the whole world in a snapshot file next to the program.
+  void SaveWorld();
+  void LoadWorld();
+
   // ---- "Game" Variables ---- //
   // Timer used for precision timing.
   GameTimer timer;
-  std::vector<Ball *> balls;
-  std::vector<Line *> lines;
+
+  // The simulation, the window only drives and draws it.
+  World world;
+  StepScheduler scheduler;
+
+  // Threads the simulation steps are spread over.
+  ThreadPool threadPool;
+
+  /* Times every simulation frame and every drawn one, shown on top of
+   * the scene when showProfiler is set. */
+  Profiler profiler;
+  Profiler drawProfiler;
+  bool showProfiler;
+
+  // Steps the world while the window draws, declared last of the above
+  // since it uses all of them.
+  SimulationThread simulation;
+
+  // New balls are placed from this, reseeded whenever the balls are reset.
+  Random random;
 
   // ---- Window variables ---- //
   HINSTANCE appInstance;
   HWND hWindow;
   UINT width, height;
-  double globalRestitution;
-  bool ballCollisionsOn;
   
   // ---- Graphics and GDI ---- //
-  Graphics *bufferGraphics;
+  // The scene is drawn into the framebuffer, GDI+ only adds the text.
+  Framebuffer framebuffer;
+  Renderer renderer;
   Graphics *windowGraphics;
   ULONG gdiStartToken;
+
+  // Shares its pixels with the framebuffer.
   Bitmap *backBuffer;
-  Matrix3x3 screenTransformMat;
+
+  /* The text is drawn into a layer of its own that the renderer blends
+   * over the scene. It is kept between frames and only the parts whose
+   * text changed are drawn again. */
+  Framebuffer hudLayer;
+  Bitmap *hudBitmap;
+  Graphics *hudGraphics;
+  bool hudDrawn;
+  int shownFps;
+  bool shownCollisions;
+  bool shownLockstep;
+  bool shownProfiler;
+  bool shownFollowing;
+  double shownRestitution;
+  unsigned int shownStep;
+
+  // Set when the window was uncovered, all of it is copied again.
+  bool presentAll;
+
+  // What part of the world is shown, and what it was drawn with last.
+  Camera camera;
+  unsigned int drawnCameraVersion;
+
+  /* Lines by where they are, rebuilt when they change, to find those in
+   * view. Balls are found through the grid of the frame. */
+  LineTree lineTree;
+  std::vector<Line> treeLines;
+  std::vector<unsigned int> visibleLines;
+  std::vector<unsigned int> visibleBalls;
+
+  // The ball the camera follows, picked near the mouse on the next frame.
+  BallHandle followed;
+  bool pickFollowed;
+
+  // The mouse in pixels, and whether it drags the view.
+  int mouseX, mouseY;
+  bool dragging;
+
   int frames;
   int lastFps;
   WCHAR *fpsStrBuffer;
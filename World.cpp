@@ -0,0 +1,945 @@
+#include "World.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "Physics.h"
+#include "Snapshot.h"
+#include "GameTimer.h"
+
+// How much work goes into each chunk handed to the thread pool.
+const unsigned int BallGrain = 256;
+const unsigned int RowGrain = 4;
+const unsigned int ContactGrain = 128;
+
+// Bounciness and grip between two balls.
+const double BallRestitution = 0.85;
+const double BallFriction = 0.4;
+
+// Balls moving further than this part of their radius in a step are swept.
+const double SweepTravel = 0.5;
+
+// Returns the seconds passed since start and moves start up to now.
+static double Lap(long long &start)
+{
+  long long now = GameTimer::Now();
+  double seconds = GameTimer::TicksToSeconds(now - start);
+  start = now;
+  return seconds;
+}
+
+World::World()
+{
+  restitution = 1.0;
+  restitutionSet = false;
+  ballCollisionsOn = true;
+  continuousOn = true;
+  threadPool = nullptr;
+  profiler = nullptr;
+  lineTreeStale = false;
+  sharedLines = nullptr;
+  sharedTree = nullptr;
+  timings = StepTimings();
+
+  sleepingGridStale = true;
+  sleepingOn = true;
+  sleepLinearVelocity = 0.05;
+  sleepAngularVelocity = 0.5;
+  timeToSleep = 0.5;
+
+  AddForceField(GravityDirection * GravityCoefficient);
+}
+
+World::~World()
+{
+
+}
+
+/* Every phase is split into chunks that only depend on their own part of
+ * the data, and whatever gets merged is merged in chunk order. So the
+ * result is the same no matter how many threads run the chunks. */
+void World::Step(double dt)
+{
+  ProfileScope stepZone(profiler, "step");
+  long long start = GameTimer::Now();
+
+  // Moved lines and awake balls may wake up sleeping ones, so this goes
+  // first. Sleeping balls are not touched by anything below.
+  {
+    ProfileScope zone(profiler, "line tree");
+    UpdateLineTree();
+  }
+  timings.LineCollisions = Lap(start);
+
+  if(sleepingOn)
+  {
+    ProfileScope zone(profiler, "wake");
+    WakeTouching();
+  }
+  timings.Sleeping = Lap(start);
+
+  unsigned int count = balls.AwakeCount();
+
+  // Force accumulation, each ball on its own.
+  {
+    ProfileScope zone(profiler, "forces");
+    ParallelFor(threadPool, count, BallGrain, [this, dt](unsigned int begin, unsigned int end)
+    {
+      unsigned int applied = UpdateForces(balls, begin, end, dt);
+      if(profiler)
+      {
+        profiler->Count(CounterForces, applied);
+      }
+    });
+  }
+  timings.Forces = Lap(start);
+
+  // All fields together are a single acceleration shared by every ball.
+  fieldAcceleration = Vector2D(0, 0);
+  for(const Vector2D &field : forceFields)
+  {
+    fieldAcceleration += field;
+  }
+
+  /* Move the balls first and then fix up whatever they ran into. That way
+   * the solver sees the velocity gravity added this step, and a ball
+   * resting on something ends the step standing still. */
+  {
+    ProfileScope zone(profiler, "integrate");
+    ParallelFor(threadPool, count, BallGrain, [this, dt](unsigned int begin, unsigned int end)
+    {
+      Integrate(balls, begin, end, fieldAcceleration, dt);
+    });
+  }
+  timings.Integrate = Lap(start);
+
+  solver.Clear();
+
+  // Every chunk of balls collects its own line contacts.
+  unsigned int numChunks = (count + BallGrain - 1) / BallGrain;
+  if(chunkContacts.size() < numChunks)
+  {
+    chunkContacts.resize(numChunks);
+    chunkImpacts.resize(numChunks);
+  }
+
+  {
+    ProfileScope zone(profiler, "line contacts");
+    ParallelFor(threadPool, count, BallGrain, [this, dt](unsigned int begin, unsigned int end)
+    {
+      std::vector<Contact> &found = chunkContacts[begin / BallGrain];
+      std::vector<Impact> &impacts = chunkImpacts[begin / BallGrain];
+      found.clear();
+      impacts.clear();
+      FindLineContacts(begin, end, dt, found, impacts);
+    });
+
+    for(unsigned int chunk = 0; chunk < numChunks; ++chunk)
+    {
+      for(const Contact &contact : chunkContacts[chunk])
+      {
+        solver.Add(contact);
+      }
+    }
+  }
+  timings.LineCollisions += Lap(start);
+
+  if(ballCollisionsOn)
+  {
+    ProfileScope zone(profiler, "ball contacts");
+    FindBallContacts();
+  }
+  timings.BallCollisions = Lap(start);
+
+  if(profiler)
+  {
+    profiler->Count(CounterContacts, solver.GetContacts().size());
+  }
+
+  {
+    ProfileScope zone(profiler, "solve");
+    solver.Solve(balls, GetLines(), threadPool);
+  }
+  timings.Solve = Lap(start);
+
+  if(continuousOn)
+  {
+    ProfileScope zone(profiler, "impacts");
+    FinishImpacts();
+  }
+  timings.LineCollisions += Lap(start);
+
+  // Whatever has come to rest falls asleep until something wakes it.
+  if(sleepingOn)
+  {
+    ProfileScope zone(profiler, "sleep");
+    UpdateSleep(dt);
+  }
+  timings.Sleeping += Lap(start);
+}
+
+void World::StorePreviousState()
+{
+  // Sleeping balls already had their previous state set when they fell asleep.
+  unsigned int count = balls.AwakeCount();
+  std::copy(balls.Position.begin(), balls.Position.begin() + count, balls.PreviousPosition.begin());
+  std::copy(balls.Orientation.begin(), balls.Orientation.begin() + count, balls.PreviousOrientation.begin());
+}
+
+BallHandle World::AddBall(double mass, double radius, const Vector2D &position)
+{
+  // New balls are awake, so a sleeping one may move to make room for it.
+  sleepingGridStale = true;
+  return balls.Add(mass, radius, position);
+}
+
+void World::RemoveBall(BallHandle handle)
+{
+  // Whatever was resting on the ball has to fall.
+  WakeBall(handle);
+  balls.Remove(handle);
+  sleepingGridStale = true;
+}
+
+void World::ClearBalls()
+{
+  balls.Clear();
+  sleepingGridStale = true;
+  solver.ResetCache();
+}
+
+void World::ApplyImpulse(BallHandle handle, const Vector2D &impulse)
+{
+  if(balls.IsValid(handle))
+  {
+    WakeBall(handle);
+    balls.ApplyImpulse(balls.IndexOf(handle), impulse);
+  }
+}
+
+bool World::AddForce(BallHandle handle, const Force &force)
+{
+  if(!balls.IsValid(handle))
+  {
+    return false;
+  }
+
+  WakeBall(handle);
+  return balls.AddForce(balls.IndexOf(handle), force);
+}
+
+void World::WakeBall(BallHandle handle)
+{
+  if(!balls.IsValid(handle) || balls.IsAwake(balls.IndexOf(handle)))
+  {
+    return;
+  }
+
+  wakeIslands.clear();
+  wakeIslands.push_back(balls.Island[balls.IndexOf(handle)]);
+  WakeIslands();
+}
+
+unsigned int World::AddLine(const Line &line)
+{
+  lines.push_back(line);
+  lineTreeStale = true;
+  return static_cast<unsigned int>(lines.size() - 1);
+}
+
+Line& World::GetLine(unsigned int index)
+{
+  // Lines are often edited a few times in a row, remember them once.
+  if(editedLines.empty() || editedLines.back() != index)
+  {
+    editedLines.push_back(index);
+  }
+  return lines[index];
+}
+
+void World::ClearLines()
+{
+  lines.clear();
+  lineTreeStale = true;
+
+  // Line indices are about to be handed out again.
+  solver.ResetCache();
+}
+
+unsigned int World::AddForceField(const Vector2D &acceleration)
+{
+  forceFields.push_back(acceleration);
+  WakeAll();
+  return static_cast<unsigned int>(forceFields.size() - 1);
+}
+
+void World::SetForceField(unsigned int index, const Vector2D &acceleration)
+{
+  forceFields[index] = acceleration;
+  WakeAll();
+}
+
+void World::ClearForceFields()
+{
+  forceFields.clear();
+  WakeAll();
+}
+
+void World::SetRestitution(double restitution)
+{
+  this->restitution = restitution;
+  restitutionSet = true;
+
+  for(unsigned int i = 0; i < lines.size(); ++i)
+  {
+    GetLine(i).SetRestitution(restitution);
+  }
+}
+
+void World::ShareLines(const std::vector<Line> *lines, const LineTree *tree)
+{
+  sharedLines = lines && tree ? lines : nullptr;
+  sharedTree = sharedLines ? tree : nullptr;
+
+  // Whatever rests on the old lines has to wake up, like for new lines.
+  solver.ResetCache();
+  lineTreeStale = true;
+}
+
+void World::UpdateLineTree()
+{
+  if(lineTreeStale)
+  {
+    // Lines came or went somewhere, anything could have to move now.
+    WakeAll();
+    RebuildLineTree();
+    return;
+  }
+
+  // Shared lines are kept up to date by whoever owns them.
+  if(sharedLines)
+  {
+    editedLines.clear();
+    return;
+  }
+
+  /* Only lines handed out since the last step can have changed, and of
+   * those only the ones whose version moved on need refitting. */
+  for(unsigned int i : editedLines)
+  {
+    if(lines[i].GetVersion() != lineVersions[i])
+    {
+      // Wake what rested near the line where it was and where it is now.
+      Vector2D min, max;
+      lineTree.GetLeafBounds(i, min, max);
+      WakeInBox(min, max);
+
+      lineTree.Refit(lines, i);
+      lineVersions[i] = lines[i].GetVersion();
+
+      lineTree.GetLeafBounds(i, min, max);
+      WakeInBox(min, max);
+    }
+  }
+
+  editedLines.clear();
+}
+
+void World::RebuildLineTree()
+{
+  lineTree.Build(lines);
+  lineVersions.resize(lines.size());
+  for(unsigned int i = 0; i < lines.size(); ++i)
+  {
+    lineVersions[i] = lines[i].GetVersion();
+  }
+
+  editedLines.clear();
+  lineTreeStale = false;
+}
+
+void World::SetSleeping(bool enabled)
+{
+  sleepingOn = enabled;
+  if(!enabled)
+  {
+    WakeAll();
+  }
+}
+
+void World::SetSleepThresholds(double linearVelocity, double angularVelocity, double time)
+{
+  sleepLinearVelocity = linearVelocity;
+  sleepAngularVelocity = angularVelocity;
+  timeToSleep = time;
+}
+
+// Mixes the bits of every value of an array into the hash.
+template<typename T>
+static unsigned long long HashArray(unsigned long long hash, const std::vector<T> &values)
+{
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(values.data());
+  size_t words = values.size() * sizeof(T) / sizeof(unsigned long long);
+
+  for(size_t i = 0; i < words; ++i)
+  {
+    unsigned long long word;
+    memcpy(&word, bytes + i * sizeof(word), sizeof(word));
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+unsigned long long World::ComputeStateHash() const
+{
+  unsigned long long hash = 0xCBF29CE484222325ULL ^ balls.Count();
+  hash = (hash ^ balls.AwakeCount()) * 0x9E3779B97F4A7C15ULL;
+
+  // Everything else follows from these over the next steps.
+  hash = HashArray(hash, balls.Position);
+  hash = HashArray(hash, balls.Velocity);
+  hash = HashArray(hash, balls.Orientation);
+  hash = HashArray(hash, balls.AngularVelocity);
+  hash = HashArray(hash, balls.SleepTime);
+  return hash;
+}
+
+void World::SaveSnapshot(std::vector<unsigned char> &buffer) const
+{
+  SnapshotWriter writer(buffer);
+
+  // Snapshots only load into builds that lay the data out the same way.
+  writer.Write(SnapshotMagic);
+  writer.Write(SnapshotVersion);
+  writer.Write(static_cast<unsigned int>(sizeof(Vector2D)));
+  writer.Write(MaxForcesPerBall);
+
+  writer.Write(restitution);
+  writer.Write(ballCollisionsOn);
+  writer.Write(continuousOn);
+  writer.Write(sleepingOn);
+  writer.Write(sleepLinearVelocity);
+  writer.Write(sleepAngularVelocity);
+  writer.Write(timeToSleep);
+
+  writer.WriteArray(forceFields);
+
+  writer.Write(static_cast<unsigned int>(GetLines().size()));
+  for(const Line &line : GetLines())
+  {
+    // Shared lines are loaded back as the world's own, as it saw them.
+    if(sharedLines && restitutionSet)
+    {
+      Line copy = line;
+      copy.SetRestitution(restitution);
+      copy.Save(writer);
+      continue;
+    }
+
+    line.Save(writer);
+  }
+
+  balls.Save(writer);
+  solver.Save(writer);
+}
+
+bool World::SaveSnapshot(const char *path) const
+{
+  std::vector<unsigned char> buffer;
+  SaveSnapshot(buffer);
+
+  FILE *file = fopen(path, "wb");
+  if(file == nullptr)
+  {
+    return false;
+  }
+
+  bool written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+  return fclose(file) == 0 && written;
+}
+
+bool World::LoadSnapshot(const unsigned char *data, size_t size)
+{
+  SnapshotReader reader(data, size);
+
+  unsigned int magic = 0, version = 0, vectorSize = 0, maxForces = 0;
+  reader.Read(magic);
+  reader.Read(version);
+  reader.Read(vectorSize);
+  reader.Read(maxForces);
+
+  bool ok = reader.IsValid() && magic == SnapshotMagic && version == SnapshotVersion &&
+    vectorSize == sizeof(Vector2D) && maxForces == MaxForcesPerBall;
+
+  // Everything is read aside and only taken over once all of it was read.
+  double loadedRestitution = 0.0;
+  bool loadedCollisions = false, loadedContinuous = false, loadedSleeping = false;
+  double loadedLinearVelocity = 0.0, loadedAngularVelocity = 0.0, loadedTimeToSleep = 0.0;
+  std::vector<Vector2D> loadedFields;
+  if(ok)
+  {
+    reader.Read(loadedRestitution);
+    reader.Read(loadedCollisions);
+    reader.Read(loadedContinuous);
+    reader.Read(loadedSleeping);
+    reader.Read(loadedLinearVelocity);
+    reader.Read(loadedAngularVelocity);
+    reader.Read(loadedTimeToSleep);
+    ok = reader.IsValid() && reader.ReadArray(loadedFields);
+  }
+
+  // Check the count against the data left before making room for the lines.
+  unsigned int lineCount = 0;
+  ok = ok && reader.Read(lineCount) && lineCount <= reader.GetRemaining() / Line::SnapshotSize;
+
+  std::vector<Line> loadedLines;
+  if(ok)
+  {
+    loadedLines.resize(lineCount);
+    for(unsigned int i = 0; ok && i < lineCount; ++i)
+    {
+      ok = loadedLines[i].Load(reader);
+    }
+  }
+
+  BallStore loadedBalls;
+  ContactSolver loadedSolver;
+  ok = ok && loadedBalls.Load(reader) && loadedSolver.Load(reader);
+
+  if(!ok || !reader.IsValid())
+  {
+    return false;
+  }
+
+  // The lines in the snapshot become the world's own.
+  sharedLines = nullptr;
+  sharedTree = nullptr;
+  restitutionSet = false;
+
+  restitution = loadedRestitution;
+  ballCollisionsOn = loadedCollisions;
+  continuousOn = loadedContinuous;
+  sleepingOn = loadedSleeping;
+  sleepLinearVelocity = loadedLinearVelocity;
+  sleepAngularVelocity = loadedAngularVelocity;
+  timeToSleep = loadedTimeToSleep;
+  forceFields.swap(loadedFields);
+  lines.swap(loadedLines);
+  balls.Exchange(loadedBalls);
+  solver.Exchange(loadedSolver);
+
+  /* Rebuilt right away rather than at the next step, which would take
+   * the new lines for moved ones and wake every ball. */
+  RebuildLineTree();
+  sleepingGridStale = true;
+  return true;
+}
+
+bool World::LoadSnapshot(const char *path)
+{
+  MappedFile file;
+  if(!file.Open(path))
+  {
+    return false;
+  }
+
+  return LoadSnapshot(file.GetData(), file.GetSize());
+}
+
+void World::WakeTouching()
+{
+  unsigned int awake = balls.AwakeCount();
+  if(awake == balls.Count())
+  {
+    return;
+  }
+
+  if(sleepingGridStale)
+  {
+    sleepingGrid.Clear();
+    for(unsigned int i = awake; i < balls.Count(); ++i)
+    {
+      sleepingGrid.Insert(i, balls.Position[i], balls.Radius[i]);
+    }
+    sleepingGrid.Build();
+    sleepingGridStale = false;
+  }
+
+  wakeIslands.clear();
+  for(unsigned int i = 0; i < awake; ++i)
+  {
+    sleepingGrid.Query(balls.Position[i], balls.Radius[i], [this](unsigned int sleeper)
+    {
+      wakeIslands.push_back(balls.Island[sleeper]);
+    });
+  }
+
+  WakeIslands();
+}
+
+void World::WakeInBox(const Vector2D &min, const Vector2D &max)
+{
+  wakeIslands.clear();
+  for(unsigned int i = balls.AwakeCount(); i < balls.Count(); ++i)
+  {
+    const Vector2D &position = balls.Position[i];
+    double radius = balls.Radius[i];
+
+    if(position.X + radius >= min.X && position.X - radius <= max.X &&
+       position.Y + radius >= min.Y && position.Y - radius <= max.Y)
+    {
+      wakeIslands.push_back(balls.Island[i]);
+    }
+  }
+
+  WakeIslands();
+}
+
+void World::WakeIslands()
+{
+  if(wakeIslands.empty())
+  {
+    return;
+  }
+
+  std::sort(wakeIslands.begin(), wakeIslands.end());
+  wakeIslands.erase(std::unique(wakeIslands.begin(), wakeIslands.end()), wakeIslands.end());
+
+  // Waking swaps the ball with the first sleeping one, which has been
+  // looked at already, so one pass in order finds every ball.
+  for(unsigned int i = balls.AwakeCount(); i < balls.Count(); ++i)
+  {
+    if(std::binary_search(wakeIslands.begin(), wakeIslands.end(), balls.Island[i]))
+    {
+      balls.Wake(i);
+    }
+  }
+
+  wakeIslands.clear();
+  sleepingGridStale = true;
+}
+
+void World::WakeAll()
+{
+  if(balls.AwakeCount() == balls.Count())
+  {
+    return;
+  }
+
+  for(unsigned int i = balls.AwakeCount(); i < balls.Count(); ++i)
+  {
+    balls.Wake(i);
+  }
+  sleepingGridStale = true;
+}
+
+unsigned int World::FindIsland(unsigned int index)
+{
+  // Path halving keeps the trees flat.
+  while(islandParent[index] != index)
+  {
+    islandParent[index] = islandParent[islandParent[index]];
+    index = islandParent[index];
+  }
+  return index;
+}
+
+void World::UpdateSleep(double dt)
+{
+  unsigned int awake = balls.AwakeCount();
+
+  // Every ball keeps track of how long it has been resting.
+  ParallelFor(threadPool, awake, BallGrain, [this, dt](unsigned int begin, unsigned int end)
+  {
+    double linear = sleepLinearVelocity * sleepLinearVelocity;
+
+    for(unsigned int i = begin; i < end; ++i)
+    {
+      bool resting = balls.Velocity[i].LengthSquared() < linear &&
+        std::fabs(balls.AngularVelocity[i]) < sleepAngularVelocity;
+      balls.SleepTime[i] = resting ? balls.SleepTime[i] + dt : 0.0;
+    }
+  });
+
+  // Balls that touched this step belong to the same island.
+  islandParent.resize(awake);
+  for(unsigned int i = 0; i < awake; ++i)
+  {
+    islandParent[i] = i;
+  }
+
+  for(const Contact &contact : solver.GetContacts())
+  {
+    if(contact.B != NoBall)
+    {
+      unsigned int a = FindIsland(contact.A);
+      unsigned int b = FindIsland(contact.B);
+      islandParent[a < b ? b : a] = a < b ? a : b;
+    }
+  }
+
+  // An island can only sleep as long as its most restless ball.
+  islandSleepTime.assign(awake, timeToSleep);
+  for(unsigned int i = 0; i < awake; ++i)
+  {
+    unsigned int root = FindIsland(i);
+    islandSleepTime[root] = std::min(islandSleepTime[root], balls.SleepTime[i]);
+  }
+
+  /* The slot of the island's root names the island while it sleeps. No
+   * other live ball has that slot and islands only wake up as a whole,
+   * so two sleeping islands never share a name. */
+  sleepers.clear();
+  for(unsigned int i = 0; i < awake; ++i)
+  {
+    unsigned int root = FindIsland(i);
+    if(islandSleepTime[root] >= timeToSleep)
+    {
+      balls.Island[i] = balls.HandleOf(root).Slot;
+      sleepers.push_back(i);
+    }
+  }
+
+  // Highest first, putting a ball to sleep only moves balls above it.
+  for(unsigned int i = static_cast<unsigned int>(sleepers.size()); i > 0; --i)
+  {
+    balls.Sleep(sleepers[i - 1]);
+  }
+
+  if(!sleepers.empty())
+  {
+    sleepingGridStale = true;
+  }
+}
+
+void World::FindLineContacts(unsigned int begin, unsigned int end, double dt,
+                             std::vector<Contact> &found, std::vector<Impact> &impacts)
+{
+  const std::vector<Line> &lines = GetLines();
+  const LineTree &lineTree = GetLineTree();
+  const PackedLines &packed = lineTree.GetPackedLines();
+  LineKernel touchBlock = GetLineKernel();
+  bool overrideRestitution = sharedLines && restitutionSet;
+
+  // Rounded the way Line keeps it, so sharing the lines changes nothing.
+  double lineRestitution = static_cast<float>(restitution);
+  unsigned int blocksTested = 0;
+
+  for(unsigned int i = begin; i < end; ++i)
+  {
+    unsigned int swept = NoLine;
+
+    /* A fast ball could have jumped over a line, so go back to where it
+     * started the step and look for the first line on its way there.
+     * The integrator moved it by v * dt - a * dt^2 / 2 with its new velocity. */
+    Vector2D motion = balls.Velocity[i] * dt - balls.Acceleration[i] * (0.5 * dt * dt);
+    double reach = SweepTravel * balls.Radius[i];
+    if(continuousOn && motion.LengthSquared() > reach * reach)
+    {
+      Vector2D startPosition = balls.Position[i] - motion;
+      double toi;
+      Vector2D normal;
+
+      if(SweepLines(startPosition, motion, balls.Radius[i], toi, swept, normal))
+      {
+        balls.Position[i] = startPosition + motion * toi;
+
+        const Line &line = lines[swept];
+        Contact contact = Contact();
+        contact.A = i;
+        contact.B = NoBall;
+        contact.Line = swept;
+        contact.Penetration = 0.0;
+        contact.Restitution = overrideRestitution ? lineRestitution : line.GetRestitution();
+        contact.Friction = line.GetFrictionCoeff();
+        contact.Normal = normal;
+        found.push_back(contact);
+
+        Impact impact;
+        impact.Ball = i;
+        impact.TimeLeft = (1.0 - toi) * dt;
+        impacts.push_back(impact);
+      }
+    }
+
+    // Only leaves with boxes overlapping the box around the ball can touch it.
+    const Vector2D center = balls.Position[i];
+    double radius = balls.Radius[i];
+    double radiusSq = radius * radius;
+    Vector2D extent(radius, radius);
+
+    lineTree.QueryBlocks(center - extent, center + extent, [&](unsigned int block)
+    {
+      // All lines of the leaf at once, most of them are too far away.
+      unsigned int mask = touchBlock(packed, block, center, radiusSq);
+      blocksTested++;
+
+      for(unsigned int k = 0; mask != 0; ++k, mask >>= 1)
+      {
+        unsigned int lane = block * LineLanes + k;
+
+        // The line the ball was swept into already has its contact.
+        if((mask & 1) == 0 || packed.Index[lane] == swept)
+        {
+          continue;
+        }
+
+        Vector2D diff = OffsetFromLine(packed, lane, center);
+        double distance = std::sqrt(diff.LengthSquared());
+
+        Contact contact = Contact();
+        contact.A = i;
+        contact.B = NoBall;
+        contact.Line = packed.Index[lane];
+        contact.Penetration = radius - distance;
+        contact.Restitution = overrideRestitution ? lineRestitution : packed.Restitution[lane];
+        contact.Friction = packed.Friction[lane];
+
+        // A ball centered right on the line is pushed out along its normal.
+        contact.Normal = distance > 0.0 ? diff * (1.0 / distance) :
+          Vector2D(packed.NormalX[lane], packed.NormalY[lane]);
+
+        found.push_back(contact);
+      }
+    });
+  }
+
+  if(profiler)
+  {
+    profiler->Count(CounterLineTests, blocksTested);
+  }
+}
+
+bool World::SweepLines(const Vector2D &start, const Vector2D &motion, double radius,
+                       double &toi, unsigned int &line, Vector2D &normal) const
+{
+  const std::vector<Line> &lines = GetLines();
+  Vector2D end = start + motion;
+  Vector2D boxMin(std::min(start.X, end.X) - radius, std::min(start.Y, end.Y) - radius);
+  Vector2D boxMax(std::max(start.X, end.X) + radius, std::max(start.Y, end.Y) + radius);
+
+  // The earliest hit wins, on a tie the first line the tree hands out.
+  bool hit = false;
+  toi = 2.0;
+
+  GetLineTree().Query(boxMin, boxMax, [&](unsigned int index)
+  {
+    double lineToi;
+    Vector2D lineNormal;
+    if(SweepCircleSegment(start, motion, radius, lines[index], lineToi, lineNormal) &&
+       lineToi < toi)
+    {
+      hit = true;
+      toi = lineToi;
+      line = index;
+      normal = lineNormal;
+    }
+  });
+
+  return hit;
+}
+
+void World::FinishImpacts()
+{
+  unsigned int numChunks = (balls.AwakeCount() + BallGrain - 1) / BallGrain;
+
+  /* The solver has turned the balls away from the lines they hit. Move
+   * them on for the time they had left, but no further than the next line
+   * on the way; they pick that one up as a contact next step. */
+  ParallelFor(threadPool, numChunks, 1, [this](unsigned int begin, unsigned int end)
+  {
+    for(unsigned int chunk = begin; chunk < end; ++chunk)
+    {
+      for(const Impact &impact : chunkImpacts[chunk])
+      {
+        unsigned int i = impact.Ball;
+        Vector2D motion = balls.Velocity[i] * impact.TimeLeft;
+        double toi;
+        unsigned int line;
+        Vector2D normal;
+
+        if(SweepLines(balls.Position[i], motion, balls.Radius[i], toi, line, normal))
+        {
+          motion = motion * toi;
+        }
+        balls.Position[i] += motion;
+      }
+    }
+  });
+}
+
+void World::FindBallContacts()
+{
+  // Rebuild the broad phase from where the balls are this step.
+  ballGrid.Clear();
+  for(unsigned int i = 0; i < balls.AwakeCount(); ++i)
+  {
+    ballGrid.Insert(i, balls.Position[i], balls.Radius[i]);
+  }
+  ballGrid.Build();
+
+  // Only pairs that are actually touching come out of the grid, and each
+  // of them only once. Every band of rows collects its own pairs.
+  unsigned int rows = ballGrid.GetRowCount();
+  unsigned int numBands = (rows + RowGrain - 1) / RowGrain;
+  if(bandPairs.size() < numBands)
+  {
+    bandPairs.resize(numBands);
+  }
+
+  ParallelFor(threadPool, numBands, 1, [this](unsigned int begin, unsigned int end)
+  {
+    unsigned long long tests = 0;
+    for(unsigned int band = begin; band < end; ++band)
+    {
+      bandPairs[band].clear();
+      tests += ballGrid.FindPairs(band * RowGrain, (band + 1) * RowGrain, bandPairs[band]);
+    }
+
+    if(profiler)
+    {
+      profiler->Count(CounterPairTests, tests);
+    }
+  });
+
+  ballPairs.clear();
+  for(unsigned int band = 0; band < numBands; ++band)
+  {
+    ballPairs.insert(ballPairs.end(), bandPairs[band].begin(), bandPairs[band].end());
+  }
+
+  // Narrow phase, works out the normal and overlap of every pair.
+  ballContacts.resize(ballPairs.size());
+  ParallelFor(threadPool, static_cast<unsigned int>(ballPairs.size()), ContactGrain,
+    [this](unsigned int begin, unsigned int end)
+  {
+    for(unsigned int i = begin; i < end; ++i)
+    {
+      FindContact(ballPairs[i], ballContacts[i]);
+    }
+  });
+
+  for(const Contact &contact : ballContacts)
+  {
+    solver.Add(contact);
+  }
+}
+
+void World::FindContact(const BallPair &pair, Contact &contact) const
+{
+  // The collision normal is easy to find with circles, its simply the vector
+  // between the two centers, pointing from the other ball towards this one.
+  Vector2D diff = balls.Position[pair.A] - balls.Position[pair.B];
+  double distance = diff.Length();
+
+  contact.A = pair.A;
+  contact.B = pair.B;
+  contact.Line = 0;
+  contact.Penetration = balls.Radius[pair.A] + balls.Radius[pair.B] - distance;
+  contact.Restitution = BallRestitution;
+  contact.Friction = BallFriction;
+
+  // Balls sitting exactly on top of each other are pushed apart sideways.
+  contact.Normal = distance > 0.0 ? diff * (1.0 / distance) : Vector2D(1, 0);
+}
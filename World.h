@@ -0,0 +1,270 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <vector>
+#include "Vector2D.h"
+#include "BallStore.h"
+#include "BroadPhase.h"
+#include "Line.h"
+#include "LineTree.h"
+#include "ThreadPool.h"
+#include "ContactSolver.h"
+#include "Profiler.h"
+
+// Wall time spent in each phase of the last step, in seconds.
+struct StepTimings
+{
+  double Forces;
+  double LineCollisions;
+  double BallCollisions;
+  double Integrate;
+  double Solve;
+
+  // Waking balls up and putting them to sleep.
+  double Sleeping;
+};
+
+/* The simulation itself: owns all balls and lines and advances them.
+ * It has no idea about windows or drawing, frontends read the state
+ * through GetBalls and GetLines after each step. */
+class World
+{
+public:
+  // Constructor
+  World();
+
+  // Destructor
+  ~World();
+
+  // Advances the simulation by dt seconds.
+  void Step(double dt);
+
+  /* Remembers the current ball positions and orientations as the
+   * previous state, so that drawing can blend between two steps. */
+  void StorePreviousState();
+
+  // Adds a ball at rest and returns its handle.
+  BallHandle AddBall(double mass, double radius, const Vector2D &position);
+  void RemoveBall(BallHandle handle);
+  void ClearBalls();
+
+  /* Pushes a ball, waking it up first. Going through the BallStore
+   * instead does not wake a sleeping ball. */
+  void ApplyImpulse(BallHandle handle, const Vector2D &impulse);
+  bool AddForce(BallHandle handle, const Force &force);
+
+  // Wakes a ball together with the island it fell asleep with.
+  void WakeBall(BallHandle handle);
+
+  // Adds a static line and returns its index.
+  unsigned int AddLine(const Line &line);
+  void ClearLines();
+
+  /* Makes the world collide with lines it does not own, for instance the
+   * same walls shared by many worlds. The tree must have been built from
+   * the lines, and neither may change while the world is stepped or
+   * before ShareLines(nullptr, nullptr) goes back to the world's own lines.
+   * The world's own lines are kept but ignored in the meantime. */
+  void ShareLines(const std::vector<Line> *lines, const LineTree *tree);
+  bool IsSharingLines() const;
+
+  /* Gives access to a line so it can be moved or changed. Changes to the
+   * ends or the material of a line are picked up at the start of the next
+   * step, so get the line again after every step it changes in; its
+   * color can be changed at any time. */
+  Line& GetLine(unsigned int index);
+
+  /* Force fields act on every ball alike, as an acceleration that is
+   * the same for all of them. A new world starts out with gravity as its
+   * only field. Returns the index of the field. */
+  unsigned int AddForceField(const Vector2D &acceleration);
+  void SetForceField(unsigned int index, const Vector2D &acceleration);
+  void ClearForceFields();
+  const std::vector<Vector2D>& GetForceFields() const;
+
+  /* Sets how many passes the contact solver makes over the velocities
+   * and over the positions every step. More passes make for stiffer stacks. */
+  void SetSolverIterations(unsigned int velocity, unsigned int position);
+
+  /* Sets the restitution of every line. Shared lines are left as they
+   * are; the restitution is used for this world's contacts with them. */
+  void SetRestitution(double restitution);
+  double GetRestitution() const;
+
+  void SetBallCollisions(bool enabled);
+  bool GetBallCollisions() const;
+
+  /* Balls that move further than half their radius in a step are swept
+   * along their path against the lines, so small fast balls cannot pass
+   * through a line between two steps. A ball that hits a line is stopped
+   * where it touched it, bounces off and moves on for the rest of the step. */
+  void SetContinuousCollisions(bool enabled);
+  bool GetContinuousCollisions() const;
+
+  /* Balls touching each other form islands. Once every ball of an island
+   * has moved and turned slower than the thresholds for the given time,
+   * the whole island falls asleep and the step skips it. It wakes up when
+   * an awake ball touches it, when it is pushed through the world or when
+   * a line near it is moved. Turning sleeping off wakes every ball. */
+  void SetSleeping(bool enabled);
+  bool GetSleeping() const;
+  void SetSleepThresholds(double linearVelocity, double angularVelocity, double time);
+
+  /* Spreads the work of each step over a thread pool, or runs it all on
+   * the calling thread if pool is null. The pool is not owned by the world.
+   * Results are the same with and without a pool. */
+  void SetThreadPool(ThreadPool *pool);
+  ThreadPool* GetThreadPool() const;
+
+  /* Times the phases of each step as zones of a profiler and counts the
+   * work done in them, or nothing if profiler is null. The profiler is
+   * not owned by the world, and zones only show up inside its frames. */
+  void SetProfiler(Profiler *profiler);
+  Profiler* GetProfiler() const;
+
+  /* Returns a hash over the state of every ball. Worlds set up and
+   * stepped the same way hash the same on every machine and with any
+   * number of threads, so runs can be checked against each other step by
+   * step without comparing the state itself. */
+  unsigned long long ComputeStateHash() const;
+
+  /* A snapshot holds the complete state of the world: every ball with
+   * its forces and handle, the lines, the force fields, the settings and
+   * the impulses the contact solver carries over to the next step. A world
+   * loaded from one steps on exactly like the world it was saved from.
+   * The thread pool is not part of it. Files are mapped into memory to be
+   * loaded. If loading fails the world is left as it was. */
+  void SaveSnapshot(std::vector<unsigned char> &buffer) const;
+  bool SaveSnapshot(const char *path) const;
+  bool LoadSnapshot(const unsigned char *data, size_t size);
+  bool LoadSnapshot(const char *path);
+
+  // Accessors
+  const StepTimings& GetStepTimings() const;
+  BallStore& GetBalls();
+  const BallStore& GetBalls() const;
+  // Returns the lines the world collides with, shared ones if any.
+  const std::vector<Line>& GetLines() const;
+
+private:
+  // Brings the line tree up to date with any added or moved lines.
+  void UpdateLineTree();
+  void RebuildLineTree();
+
+  // Wakes the sleeping islands touched by awake balls.
+  void WakeTouching();
+
+  // Wakes every sleeping island with a ball overlapping the box.
+  void WakeInBox(const Vector2D &min, const Vector2D &max);
+
+  // Wakes the islands listed in wakeIslands.
+  void WakeIslands();
+  void WakeAll();
+
+  // Puts the islands that have been resting long enough to sleep.
+  void UpdateSleep(double dt);
+  unsigned int FindIsland(unsigned int index);
+
+  // A ball stopped at a line, with the part of the step it has left.
+  struct Impact
+  {
+    unsigned int Ball;
+    double TimeLeft;
+  };
+
+  /* Finds the lines touched by the balls in [begin, end). Fast balls are
+   * moved back to the first line on their way this step. */
+  void FindLineContacts(unsigned int begin, unsigned int end, double dt,
+                        std::vector<Contact> &found, std::vector<Impact> &impacts);
+
+  /* Finds the first line a ball moving from start along motion runs into.
+   * Returns false if there is none. */
+  bool SweepLines(const Vector2D &start, const Vector2D &motion, double radius,
+                  double &toi, unsigned int &line, Vector2D &normal) const;
+
+  // Moves the balls stopped at a line on for the rest of the step.
+  void FinishImpacts();
+
+  // Finds touching balls through the broad phase.
+  void FindBallContacts();
+  void FindContact(const BallPair &pair, Contact &contact) const;
+
+  BallStore balls;
+  std::vector<Line> lines;
+
+  // Lines are only looked up through the tree. It is rebuilt after lines
+  // were added and refit for lines whose version has changed since.
+  LineTree lineTree;
+  std::vector<unsigned int> lineVersions;
+  bool lineTreeStale;
+
+  // Lines handed out by GetLine since the last step, which may have changed.
+  std::vector<unsigned int> editedLines;
+
+  // Lines and tree shared with other worlds, used instead of the above.
+  const std::vector<Line> *sharedLines;
+  const LineTree *sharedTree;
+
+  // The tree the step looks lines up in, the world's own or the shared one.
+  const LineTree& GetLineTree() const;
+
+  // Broad phase for ball collisions, rebuilt every step.
+  UniformGrid ballGrid;
+  std::vector<std::vector<BallPair> > bandPairs;
+  std::vector<BallPair> ballPairs;
+
+  // Contacts found by each chunk of balls, and by the narrow phase.
+  std::vector<std::vector<Contact> > chunkContacts;
+  std::vector<std::vector<Impact> > chunkImpacts;
+  std::vector<Contact> ballContacts;
+  ContactSolver solver;
+
+  std::vector<Vector2D> forceFields;
+  Vector2D fieldAcceleration;
+
+  // Sleeping balls, the grid is rebuilt whenever the sleeping set changes.
+  UniformGrid sleepingGrid;
+  bool sleepingGridStale;
+  std::vector<unsigned int> wakeIslands;
+  std::vector<unsigned int> islandParent;
+  std::vector<double> islandSleepTime;
+  std::vector<unsigned int> sleepers;
+
+  bool sleepingOn;
+  double sleepLinearVelocity;
+  double sleepAngularVelocity;
+  double timeToSleep;
+
+  ThreadPool *threadPool;
+  Profiler *profiler;
+  StepTimings timings;
+
+  double restitution;
+
+  // True once SetRestitution was called, it then also covers shared lines.
+  bool restitutionSet;
+  bool ballCollisionsOn;
+  bool continuousOn;
+};
+
+// Inlined accessors
+inline const StepTimings& World::GetStepTimings() const { return timings; }
+inline BallStore& World::GetBalls() { return balls; }
+inline const BallStore& World::GetBalls() const { return balls; }
+inline const std::vector<Line>& World::GetLines() const { return sharedLines ? *sharedLines : lines; }
+inline const LineTree& World::GetLineTree() const { return sharedTree ? *sharedTree : lineTree; }
+inline bool World::IsSharingLines() const { return sharedLines != nullptr; }
+inline double World::GetRestitution() const { return restitution; }
+inline const std::vector<Vector2D>& World::GetForceFields() const { return forceFields; }
+inline bool World::GetBallCollisions() const { return ballCollisionsOn; }
+inline void World::SetBallCollisions(bool enabled) { ballCollisionsOn = enabled; }
+inline bool World::GetContinuousCollisions() const { return continuousOn; }
+inline void World::SetContinuousCollisions(bool enabled) { continuousOn = enabled; }
+inline bool World::GetSleeping() const { return sleepingOn; }
+inline void World::SetThreadPool(ThreadPool *pool) { threadPool = pool; }
+inline ThreadPool* World::GetThreadPool() const { return threadPool; }
+inline void World::SetProfiler(Profiler *profiler) { this->profiler = profiler; }
+inline Profiler* World::GetProfiler() const { return profiler; }
+inline void World::SetSolverIterations(unsigned int velocity, unsigned int position) { solver.SetIterations(velocity, position); }
+
+#endif
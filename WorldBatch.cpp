@@ -0,0 +1,146 @@
+#include "WorldBatch.h"
+#include <algorithm>
+#include "GameTimer.h"
+
+WorldBatch::WorldBatch()
+{
+  lastSteps = 0;
+  lastSeconds = 0.0;
+  lineTree.Build(lines);
+}
+
+WorldBatch::~WorldBatch()
+{
+  Clear();
+}
+
+void WorldBatch::SetLines(const std::vector<Line> &lines)
+{
+  this->lines = lines;
+  lineTree.Build(this->lines);
+
+  // Sharing again wakes the balls resting on the old lines.
+  for(World *world : worlds)
+  {
+    world->ShareLines(&this->lines, &lineTree);
+  }
+}
+
+unsigned int WorldBatch::AddWorld()
+{
+  World *world = new World();
+  world->ShareLines(&lines, &lineTree);
+  worlds.push_back(world);
+  return static_cast<unsigned int>(worlds.size() - 1);
+}
+
+void WorldBatch::Clear()
+{
+  for(World *world : worlds)
+  {
+    delete world;
+  }
+
+  worlds.clear();
+  results.clear();
+}
+
+void WorldBatch::Run(double dt, unsigned int steps, ThreadPool *pool)
+{
+  results.resize(worlds.size());
+  lastSteps = steps;
+
+  long long start = GameTimer::Now();
+
+  /* One world per chunk: the worlds only read the shared lines, so they
+   * can all step at once, and each one steps on a single thread. */
+  ParallelFor(pool, static_cast<unsigned int>(worlds.size()), 1,
+    [this, dt, steps](unsigned int begin, unsigned int end)
+  {
+    for(unsigned int w = begin; w < end; ++w)
+    {
+      World &world = *worlds[w];
+      ThreadPool *own = world.GetThreadPool();
+      world.SetThreadPool(nullptr);
+
+      long long worldStart = GameTimer::Now();
+      for(unsigned int step = 0; step < steps; ++step)
+      {
+        world.Step(dt);
+      }
+
+      WorldResult &result = results[w];
+      result.Seconds = GameTimer::TicksToSeconds(GameTimer::Now() - worldStart);
+      world.SetThreadPool(own);
+
+      const BallStore &balls = world.GetBalls();
+      result.Balls = balls.Count();
+      result.Awake = balls.AwakeCount();
+      result.KineticEnergy = 0.0;
+      result.MeanHeight = 0.0;
+
+      for(unsigned int i = 0; i < balls.Count(); ++i)
+      {
+        result.KineticEnergy += 0.5 * balls.Mass[i] * balls.Velocity[i].LengthSquared();
+        result.MeanHeight += balls.Position[i].Y;
+      }
+
+      if(balls.Count() > 0)
+      {
+        result.MeanHeight /= balls.Count();
+      }
+
+      result.StateHash = world.ComputeStateHash();
+    }
+  });
+
+  lastSeconds = GameTimer::TicksToSeconds(GameTimer::Now() - start);
+}
+
+// Sums up one value of every result.
+static BatchStatistic Summarize(const std::vector<WorldResult> &results,
+                                double (*value)(const WorldResult &))
+{
+  BatchStatistic statistic;
+  statistic.Min = 0.0;
+  statistic.Max = 0.0;
+  statistic.Mean = 0.0;
+
+  for(unsigned int i = 0; i < results.size(); ++i)
+  {
+    double v = value(results[i]);
+    statistic.Min = i == 0 ? v : std::min(statistic.Min, v);
+    statistic.Max = i == 0 ? v : std::max(statistic.Max, v);
+    statistic.Mean += v;
+  }
+
+  if(!results.empty())
+  {
+    statistic.Mean /= results.size();
+  }
+
+  return statistic;
+}
+
+static double KineticEnergyOf(const WorldResult &result) { return result.KineticEnergy; }
+static double MeanHeightOf(const WorldResult &result) { return result.MeanHeight; }
+static double AwakeOf(const WorldResult &result) { return result.Awake; }
+
+BatchSummary WorldBatch::Summarize() const
+{
+  BatchSummary summary;
+  summary.Worlds = static_cast<unsigned int>(results.size());
+  summary.Steps = lastSteps;
+  summary.Seconds = lastSeconds;
+  summary.BallSteps = 0.0;
+
+  for(const WorldResult &result : results)
+  {
+    summary.BallSteps += static_cast<double>(result.Balls) * lastSteps;
+  }
+
+  summary.KineticEnergy = ::Summarize(results, KineticEnergyOf);
+  summary.MeanHeight = ::Summarize(results, MeanHeightOf);
+  summary.Awake = ::Summarize(results, AwakeOf);
+  return summary;
+}
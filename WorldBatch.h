@@ -0,0 +1,109 @@
+#ifndef WORLDBATCH_H
+#define WORLDBATCH_H
+
+#include <vector>
+#include "World.h"
+#include "Line.h"
+#include "LineTree.h"
+#include "ThreadPool.h"
+
+// How a world of a batch ended up after stepping.
+struct WorldResult
+{
+  unsigned int Balls;
+  unsigned int Awake;
+
+  // Sum of m * v^2 / 2 over all balls, in joules.
+  double KineticEnergy;
+
+  // Average height of the balls, in meters.
+  double MeanHeight;
+
+  unsigned long long StateHash;
+
+  // Wall time spent stepping this world.
+  double Seconds;
+};
+
+// A value summed up over every world of a batch.
+struct BatchStatistic
+{
+  double Min;
+  double Max;
+  double Mean;
+};
+
+// The results of all worlds of a batch, summed up.
+struct BatchSummary
+{
+  unsigned int Worlds;
+  unsigned int Steps;
+
+  // Ball steps taken by all worlds together.
+  double BallSteps;
+
+  // Wall time of the whole batch.
+  double Seconds;
+
+  BatchStatistic KineticEnergy;
+  BatchStatistic MeanHeight;
+  BatchStatistic Awake;
+};
+
+/* Many small independent worlds stepped side by side, for sweeping
+ * settings such as restitution or ball counts in one process.
+ *
+ * Every world collides with the same lines, which the batch owns and
+ * shares between them read only. Each world is set up on its own through
+ * GetWorld and steps on a single thread; the worlds are spread over the
+ * threads of a pool, so a batch of small worlds keeps every core busy
+ * where a single small world could not. Each world steps exactly as it
+ * would on its own, no matter how many threads the batch runs on. */
+class WorldBatch
+{
+public:
+  // Constructor
+  WorldBatch();
+
+  // Destructor
+  ~WorldBatch();
+
+  // Sets the lines shared by every world, they are copied.
+  void SetLines(const std::vector<Line> &lines);
+  const std::vector<Line>& GetLines() const;
+
+  // Adds a world colliding with the shared lines and returns its index.
+  unsigned int AddWorld();
+  World& GetWorld(unsigned int index);
+  unsigned int GetWorldCount() const;
+  void Clear();
+
+  /* Steps every world steps times by dt. Runs on the calling thread if
+   * pool is null. */
+  void Run(double dt, unsigned int steps, ThreadPool *pool);
+
+  // Results of the last Run, one per world in order.
+  const std::vector<WorldResult>& GetResults() const;
+  BatchSummary Summarize() const;
+
+private:
+  // Not copyable, the worlds point at the shared lines.
+  WorldBatch(const WorldBatch &);
+  WorldBatch& operator=(const WorldBatch &);
+
+  std::vector<Line> lines;
+  LineTree lineTree;
+
+  std::vector<World *> worlds;
+  std::vector<WorldResult> results;
+  unsigned int lastSteps;
+  double lastSeconds;
+};
+
+// Inlined accessors
+inline const std::vector<Line>& WorldBatch::GetLines() const { return lines; }
+inline World& WorldBatch::GetWorld(unsigned int index) { return *worlds[index]; }
+inline unsigned int WorldBatch::GetWorldCount() const { return static_cast<unsigned int>(worlds.size()); }
+inline const std::vector<WorldResult>& WorldBatch::GetResults() const { return results; }
+
+#endif